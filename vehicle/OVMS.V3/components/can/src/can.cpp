@@ -38,10 +38,17 @@ static const char *TAG = "can";
 
 #include "can.h"
 #include "canlog.h"
+#include "canplay.h"
 #include <algorithm>
 #include <ctype.h>
+#include <stdlib.h>
 #include <string.h>
+#include "esp_timer.h"
 #include "ovms_command.h"
+#include "ovms_config.h"
+#include "ovms_events.h"
+#include "ovms_metrics.h"
+#include "metrics_standard.h"
 
 can MyCan __attribute__ ((init_priority (4500)));;
 
@@ -152,6 +159,7 @@ void can_rx(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const
 
   CAN_frame_t frame;
   frame.origin = sbus;
+  frame.time = 0;
   frame.FIR.U = 0;
   frame.FIR.B.DLC = argc-1;
   frame.FIR.B.FF = smode;
@@ -165,61 +173,115 @@ void can_rx(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const
 
 
 // Shell command:
-//    can log <type> [path] [filter1] [filter2] [filter3]
-//    can log off
+//    can log trigger [reason]
+// 
+void can_log_trigger(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  int cnt = 0;
+  for (canlog* cl : MyCan.GetLoggers())
+    {
+    if (cl->IsRingMode())
+      {
+      cl->Trigger((argc > 0) ? argv[0] : "command");
+      cnt++;
+      }
+    }
+  if (cnt == 0)
+    writer->puts("Error: no ring capture active");
+  else
+    writer->printf("Ring capture triggered on %d logger(s)\n", cnt);
+  }
+
+
+// Shell command:
+//    can log convert <binpath> <crtdpath>
+// 
+void can_log_convert(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  if (MyConfig.ProtectedPath(argv[1]))
+    {
+    writer->printf("Error: protected path '%s'\n", argv[1]);
+    return;
+    }
+  std::string error;
+  uint32_t records = 0;
+  if (!canlog_bin::ConvertToCRTD(argv[0], argv[1], error, &records))
+    writer->printf("Error: %s (%u records converted)\n", error.c_str(), records);
+  else
+    writer->printf("%u records converted to '%s'\n", records, argv[1]);
+  }
+
+
+static void can_log_stop(OvmsWriter* writer, canlog* cl)
+  {
+  writer->printf("Closing log: %s\n", cl->GetInfo().c_str());
+  MyCan.RemoveLogger(cl);   // no log calls running into cl after this
+  cl->StopTasks();          // process queued messages, terminate tasks
+  cl->Close();
+  writer->printf("Statistics: %s\n", cl->GetStats().c_str());
+  delete cl;
+  }
+
+// Shell command:
+//    can log <type> [path] [filter1] [filter2] [...]
+//    can log off [<nr>|<type>|<path>]
 //    can log status
 // 
-// Filter: [bus:][id][-id]
+// Filter: see CANLOG_FILTER_HELP
 // Examples:
 //    can log trace                     → enable syslog tracing for all buses, all ids
 //    can log trace 1 3:780-7ff         → enable syslog for bus 1 and id range 780-7ff on bus 3
 //    can log crtd /sd/cap1 2:100-1ff   → capture id range 100-1ff of bus 2 in crtd file /sd/cap1
 // 
-// Path and filters can be changed on the fly.
+// Multiple loggers can run simultaneously, each with its own filters & queue.
+// Filters of a running logger (same type & path) can be changed on the fly.
 // 
 void can_log(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
   {
   const char* type = cmd->GetName();
   bool is_trace = (strcmp(type, "trace") == 0);
-  canlog* cl = MyCan.GetLogger();
+  std::list<canlog*> loggers = MyCan.GetLoggers();
   
   if (strcmp(type, "status") == 0)
     {
-    if (cl)
-      writer->printf("CAN logging active: %s\nStatistics: %s\n", cl->GetInfo().c_str(), cl->GetStats().c_str());
-    else
+    if (loggers.empty())
+      {
       writer->puts("CAN logging inactive.");
+      return;
+      }
+    int nr = 0;
+    for (canlog* cl : loggers)
+      writer->printf("#%d: %s\n    Statistics: %s\n", ++nr, cl->GetInfo().c_str(), cl->GetStats().c_str());
     return;
     }
   
   if (strcmp(type, "off") == 0)
     {
-    if (!cl)
+    if (loggers.empty())
       {
       writer->puts("CAN logging inactive.");
       return;
       }
-    writer->printf("Closing log: %s\n", cl->GetInfo().c_str());
-    MyCan.UnsetLogger();
-    vTaskDelay(pdMS_TO_TICKS(100)); // give logger task time to finish
-    cl->Close();
-    writer->printf("Statistics: %s\n", cl->GetStats().c_str());
-    delete cl;
-    writer->puts("CAN logging stopped.");
-    return;
-    }
-  
-  if (cl && strcmp(type, cl->GetType()) != 0)
-    {
-    writer->printf("Error: logger of type '%s' still running, please stop first\n", cl->GetType());
+    int nr = 0, cnt = 0;
+    for (canlog* cl : loggers)
+      {
+      nr++;
+      if (argc > 0 && atoi(argv[0]) != nr && strcmp(argv[0], cl->GetType()) != 0 && cl->GetPath() != argv[0])
+        continue;
+      can_log_stop(writer, cl);
+      cnt++;
+      }
+    if (cnt == 0)
+      writer->printf("Error: no logger '%s' found\n", argv[0]);
+    else
+      writer->printf("CAN logging stopped (%d logger(s)).\n", cnt);
     return;
     }
   
   // parse args:
   
-  const char* path = (cl && !is_trace) ? cl->GetPath().c_str() : "";
-  canlog_filter_t filter[CANLOG_MAX_FILTERS] = {};
-  int fcnt = 0;
+  const char* path = "";
+  canlog_filter_list_t filter;
   
   for (int i=0; i<argc; i++)
     {
@@ -227,35 +289,10 @@ void can_log(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, cons
       {
       path = argv[i];
       }
-    else if (fcnt < CANLOG_MAX_FILTERS)
+    else if (!canlogfilter::ParseList(argv[i], filter))
       {
-      char* s = (char*) argv[i];
-      if (s[1] == 0)
-        {
-        filter[fcnt].bus = s[0];
-        filter[fcnt].id_from = 0;
-        filter[fcnt].id_to = UINT32_MAX;
-        }
-      else
-        {
-        if (s[1] == ':')
-          {
-          filter[fcnt].bus = s[0];
-          s += 2;
-          }
-        filter[fcnt].id_from = strtol(s, &s, 16);
-        if (*s)
-          filter[fcnt].id_to = strtol(s+1, NULL, 16); // id range
-        else
-          filter[fcnt].id_to = filter[fcnt].id_from; // single id
-        if (filter[fcnt].id_to < filter[fcnt].id_from)
-          {
-          uint32_t tmp = filter[fcnt].id_to;
-          filter[fcnt].id_to = filter[fcnt].id_from;
-          filter[fcnt].id_from = tmp;
-          }
-        }
-      fcnt++;
+      writer->printf("Error: invalid filter '%s'\n", argv[i]);
+      return;
       }
     }
   
@@ -265,37 +302,42 @@ void can_log(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, cons
     return;
     }
   
-  // start / reconfigure logger:
+  // reconfigure running logger:
   
-  if (!cl)
+  for (canlog* cl : loggers)
     {
-    cl = canlog::Instantiate(type);
-    if (!cl)
+    if (is_trace ? (strcmp(cl->GetType(), "trace") != 0) : (cl->GetPath() != path))
+      continue;
+    if (strcmp(type, cl->GetType()) != 0)
       {
-      writer->printf("Error: cannot create logger of type '%s'\n", type);
+      writer->printf("Error: path '%s' in use by logger of type '%s'\n", path, cl->GetType());
       return;
       }
+    cl->SetFilter(filter);
+    MyCan.UpdateAcceptanceFilters();
+    writer->printf("CAN logging active: %s\n", cl->GetInfo().c_str());
+    return;
     }
   
-  if (!is_trace && cl->IsOpen() && cl->GetPath() != path)
+  // start new logger:
+  
+  canlog* cl = canlog::Instantiate(type);
+  if (!cl)
     {
-    writer->printf("Closing path '%s'\n", cl->GetPath().c_str());
-    MyCan.UnsetLogger();
-    vTaskDelay(pdMS_TO_TICKS(100)); // give logger task time to finish
-    writer->printf("Statistics: %s\n", cl->GetStats().c_str());
-    cl->Close();
+    writer->printf("Error: cannot create logger of type '%s'\n", type);
+    return;
     }
   
-  cl->SetFilter(fcnt, filter);
+  cl->SetFilter(filter);
   
-  if (!is_trace && !cl->IsOpen() && !cl->Open(path))
+  if (!is_trace && !cl->Open(path))
     {
     writer->printf("Error: cannot open log path '%s'\n", path);
     delete cl;
     return;
     }
   
-  MyCan.SetLogger(cl);
+  MyCan.AddLogger(cl);
   writer->printf("CAN logging active: %s\n", cl->GetInfo().c_str());
   if (is_trace)
     writer->puts("Note: info logging is done at log level debug, frame logging at verbose");
@@ -321,11 +363,161 @@ void can_status(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, c
   writer->printf("Rx pkt:    %20d\n",sbus->m_status.packets_rx);
   writer->printf("Rx err:    %20d\n",sbus->m_status.errors_rx);
   writer->printf("Rx ovrflw: %20d\n",sbus->m_status.rxbuf_overflow);
+  if (sbus->m_rxring.GetSize())
+    {
+    writer->printf("Rx ring:   %20d\n",sbus->m_rxring.GetSize());
+    writer->printf("Rx rhwm:   %20d\n",sbus->m_rxring.m_hwm);
+    writer->printf("Rx rovrfl: %20d\n",sbus->m_rxring.m_overflow);
+    }
+  writer->printf("Rx batchs: %20d\n",sbus->m_rxbatch_count);
+  writer->printf("Rx bavg:   %20.1f\n",(sbus->m_rxbatch_count)
+                                        ? (float)sbus->m_rxbatch_frames / sbus->m_rxbatch_count : 0.0f);
+  writer->printf("Rx bmax:   %20d\n",sbus->m_rxbatch_max);
   writer->printf("Tx pkt:    %20d\n",sbus->m_status.packets_tx);
   writer->printf("Tx delays: %20d\n",sbus->m_status.txbuf_delay);
   writer->printf("Tx err:    %20d\n",sbus->m_status.errors_tx);
   writer->printf("Tx ovrflw: %20d\n",sbus->m_status.txbuf_overflow);
   writer->printf("Err flags: %#x\n",sbus->m_status.error_flags);
+  writer->printf("Load fps:  %20.1f\n",sbus->m_load.fps);
+  writer->printf("Load Bps:  %20.0f\n",sbus->m_load.bps);
+  writer->printf("Load bus:  %19.1f%%\n",sbus->m_load.load);
+  writer->printf("\nRx latency[us]");
+  for (int i=0; i<CAN_LATENCY_BUCKETS-1; i++)
+    writer->printf(" <=%-6d", canlatency::GetBucketLimit(i));
+  writer->printf("  >%-6d      avg      max\n", canlatency::GetBucketLimit(CAN_LATENCY_BUCKETS-2));
+  for (int k=0; k<2; k++)
+    {
+    canlatency& lat = (k==0) ? sbus->m_lat_dispatch : sbus->m_lat_listener;
+    writer->printf("%-14s", (k==0) ? "dispatch" : "listener");
+    for (int i=0; i<CAN_LATENCY_BUCKETS; i++)
+      writer->printf(" %8d", lat.m_count[i]);
+    writer->printf(" %8d %8d\n", lat.m_n ? (uint32_t)(lat.m_sum / lat.m_n) : 0, lat.m_max);
+    }
+  writer->printf("\nTx class       sent  delayed  dropped  expired  lat.avg[us]  lat.max[us]  budget[fps]\n");
+  for (int i=0; i<CAN_TX_CLASSES; i++)
+    {
+    CAN_txclass_status_t& tc = sbus->m_txclass[i];
+    writer->printf("%-9s %9d %8d %8d %8d %12d %12d %12d\n",
+      canbus::GetTxClassName((CAN_txclass_t)i), tc.sent, tc.delayed, tc.dropped, tc.expired,
+      tc.sent ? (uint32_t)(tc.latency_sum / tc.sent) : 0, tc.latency_max, tc.budget);
+    }
+  writer->puts("");
+  writer->printf("Pool size: %20d\n",MyCan.m_framepool.GetSize());
+  writer->printf("Pool used: %20d\n",MyCan.m_framepool.GetUsed());
+  writer->printf("Pool hwm:  %20d\n",MyCan.m_framepool.m_hwm);
+  writer->printf("Pool fail: %20d\n",MyCan.m_framepool.m_allocfail);
+  writer->printf("Lst drops: %20d\n",MyCan.m_listener_drops);
+  std::vector<uint32_t> drops = MyCan.GetListenerDrops();
+  for (int i=0; i<(int)drops.size(); i++)
+    {
+    if (drops[i])
+      writer->printf("  lst #%-2d: %20d\n", i+1, drops[i]);
+    }
+  }
+
+void can_ids(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  const char* bus = cmd->GetParent()->GetName();
+  canbus* sbus = (canbus*)MyPcpApp.FindDeviceByName(bus);
+  if (sbus == NULL)
+    {
+    writer->puts("Error: Cannot find named CAN bus");
+    return;
+    }
+
+  std::vector<CAN_idstat_t> ids;
+  uint32_t overflow = 0;
+  if (!MyCan.GetIdTable(sbus, ids, &overflow))
+    {
+    writer->printf("ID statistics for %s not enabled, use 'can %s ids on'\n", bus, bus);
+    return;
+    }
+
+  int64_t now = esp_timer_get_time();
+  writer->printf("ID         DLC      count  period.avg[ms]  min[ms]   max[ms]  last[s]\n");
+  for (auto& e : ids)
+    {
+    if (e.key & CAN_IDKEY_EXT)
+      writer->printf("%08x  ", e.key & ~CAN_IDKEY_EXT);
+    else
+      writer->printf("%03x       ", e.key);
+    if (e.count > 1)
+      writer->printf("%3d %10d %15.1f %8.1f %9.1f %8.1f\n", e.dlc, e.count,
+        (float)(e.last - e.first) / (e.count - 1) / 1000.0f,
+        (float)e.period_min / 1000.0f, (float)e.period_max / 1000.0f,
+        (float)(now - e.last) / 1000000.0f);
+    else
+      writer->printf("%3d %10d %15s %8s %9s %8.1f\n", e.dlc, e.count, "-", "-", "-",
+        (float)(now - e.last) / 1000000.0f);
+    }
+  writer->printf("%d IDs, %d frames lost due to table full\n", ids.size(), overflow);
+  }
+
+void can_ids_set(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  const char* bus = cmd->GetParent()->GetParent()->GetName();
+  const char* mode = cmd->GetName();
+  canbus* sbus = (canbus*)MyPcpApp.FindDeviceByName(bus);
+  if (sbus == NULL)
+    {
+    writer->puts("Error: Cannot find named CAN bus");
+    return;
+    }
+
+  uint32_t size = 0;
+  if (strcmp(mode, "on") == 0)
+    size = (argc > 0) ? atoi(argv[0]) : CAN_IDTABLE_SIZE;
+  else if (strcmp(mode, "clear") == 0)
+    size = sbus->m_idtable ? sbus->m_idtable->GetCapacity() : 0;
+
+  if (strcmp(mode, "off") != 0 && size == 0)
+    {
+    writer->puts("Error: ID statistics not enabled");
+    return;
+    }
+  if (!MyCan.SetIdTable(sbus, size))
+    {
+    writer->puts("Error: cannot allocate ID table");
+    return;
+    }
+  if (size)
+    writer->printf("%s ID statistics reset, capacity %d IDs\n", bus, sbus->m_idtable->GetCapacity());
+  else
+    writer->printf("%s ID statistics disabled\n", bus);
+  }
+
+void can_txbudget(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  const char* bus = cmd->GetParent()->GetParent()->GetName();
+  canbus* sbus = (canbus*)MyPcpApp.FindDeviceByName(bus);
+  if (sbus == NULL)
+    {
+    writer->puts("Error: Cannot find named CAN bus");
+    return;
+    }
+
+  int txclass;
+  for (txclass=0; txclass<CAN_TX_CLASSES; txclass++)
+    {
+    if (strcmp(argv[0], canbus::GetTxClassName((CAN_txclass_t)txclass)) == 0)
+      break;
+    }
+  if (txclass == CAN_TX_CLASSES)
+    {
+    writer->puts("Error: unknown TX class");
+    return;
+    }
+
+  int fps = atoi(argv[1]);
+  if (fps < 0)
+    {
+    writer->puts("Error: invalid budget");
+    return;
+    }
+
+  sbus->SetTxBudget((CAN_txclass_t)txclass, fps);
+  writer->printf("%s TX class %s budget: %s\n", sbus->GetName(), argv[0],
+    fps ? argv[1] : "unlimited");
   }
 
 static void CAN_rxtask(void *pvParameters)
@@ -340,13 +532,27 @@ static void CAN_rxtask(void *pvParameters)
       switch(msg.type)
         {
         case CAN_frame:
-          me->IncomingFrame(&msg.body.frame);
+          me->IncomingFrame(msg.body.frame);
+          me->m_framepool.Release(msg.body.frame);
           break;
         case CAN_rxcallback:
-          while (msg.body.bus->RxCallback(&msg.body.frame))
+          {
+          CAN_frame_t frame;
+          uint32_t cnt = 0;
+          while (msg.body.bus->RxCallback(&frame))
             {
-            me->IncomingFrame(&msg.body.frame);
+            // the first frame was received no later than the interrupt:
+            if (cnt == 0 && msg.time && msg.time < frame.time)
+              frame.time = msg.time;
+            me->IncomingFrame(&frame);
+            cnt++;
             }
+          if (cnt)
+            msg.body.bus->CountRxBatch(cnt);
+          }
+          break;
+        case CAN_rxring:
+          me->DrainRxRing(msg.body.bus);
           break;
         case CAN_txcallback:
           msg.body.bus->TxCallback();
@@ -354,6 +560,9 @@ static void CAN_rxtask(void *pvParameters)
         case CAN_logerror:
           msg.body.bus->LogStatus(CAN_LogStatus_Error);
           break;
+        case CAN_acceptfilter:
+          msg.body.bus->AcceptanceFilterCallback();
+          break;
         default:
           break;
         }
@@ -367,9 +576,14 @@ can::can()
 
   OvmsCommand* cmd_can = MyCommandApp.RegisterCommand("can","CAN framework",NULL, "", 0, 0, true);
   
-  for (int k=1;k<4;k++)
+#if defined(CONFIG_OVMS_COMP_VCAN) && CONFIG_OVMS_COMP_VCAN_BUS == 4
+  int buses = 4;
+#else
+  int buses = 3;
+#endif // #ifdef CONFIG_OVMS_COMP_VCAN
+  for (int k=1;k<=buses;k++)
     {
-    static const char* name[4] = {"can1", "can2", "can3"};
+    static const char* name[4] = {"can1", "can2", "can3", "can4"};
     OvmsCommand* cmd_canx = cmd_can->RegisterCommand(name[k-1],"CANx framework",NULL, "", 0, 0, true);
     OvmsCommand* cmd_canstart = cmd_canx->RegisterCommand("start","CAN start framework", NULL, "", 0, 0, true);
     cmd_canstart->RegisterCommand("listen","Start CAN bus in listen mode",can_start,"<baud>", 1, 1, true);
@@ -378,177 +592,912 @@ can::can()
     OvmsCommand* cmd_cantx = cmd_canx->RegisterCommand("tx","CAN tx framework", NULL, "", 0, 0, true);
     cmd_cantx->RegisterCommand("standard","Transmit standard CAN frame",can_tx,"<id> <data...>", 1, 9, true);
     cmd_cantx->RegisterCommand("extended","Transmit extended CAN frame",can_tx,"<id> <data...>", 1, 9, true);
+    cmd_cantx->RegisterCommand("budget","Set TX class rate limit",can_txbudget,
+      "<class> <fps>\n"
+      "Class: control / response / normal / bulk\n"
+      "fps: max frames per second, 0 = unlimited", 2, 2, true);
     OvmsCommand* cmd_canrx = cmd_canx->RegisterCommand("rx","CAN rx framework", NULL, "", 0, 0, true);
     cmd_canrx->RegisterCommand("standard","Simulate reception of standard CAN frame",can_rx,"<id> <data...>", 1, 9, true);
     cmd_canrx->RegisterCommand("extended","Simulate reception of extended CAN frame",can_rx,"<id> <data...>", 1, 9, true);
     cmd_canx->RegisterCommand("status","Show CAN status",can_status,"", 0, 0, true);
+    OvmsCommand* cmd_canids = cmd_canx->RegisterCommand("ids","Show CAN per ID statistics",can_ids,"", 0, 0, true);
+    cmd_canids->RegisterCommand("on","Enable / reset per ID statistics",can_ids_set,
+      "[size]\nsize: max number of IDs (default 256, max 1536)", 0, 1, true);
+    cmd_canids->RegisterCommand("off","Disable per ID statistics",can_ids_set,"", 0, 0, true);
+    cmd_canids->RegisterCommand("clear","Reset per ID statistics",can_ids_set,"", 0, 0, true);
     }
 
   OvmsCommand* cmd_canlog = cmd_can->RegisterCommand("log", "CAN logging framework", NULL, "", 0, 0, true);
   cmd_canlog->RegisterCommand("trace", "Logging to syslog", can_log,
-    "[filter1] [filter2] [filter3]\n"
-    "Filter: <bus> / <id>[-<id>] / <bus>:<id>[-<id>]\n"
-    "Example: 2:2a0-37f", 0, 3, true);
+    "[filter1] [filter2] [...]\n"
+    CANLOG_FILTER_HELP, 0, 9, true);
   const char* const* logtype = canlog::GetTypeList();
   while (*logtype)
     {
     if (strcmp(*logtype, "trace") != 0)
       {
       cmd_canlog->RegisterCommand(*logtype, "...format logging", can_log,
-        "<path> [filter1] [filter2] [filter3]\n"
-        "Filter: <bus> / <id>[-<id>] / <bus>:<id>[-<id>]\n"
-        "Example: 2:2a0-37f", 1, 4, true);
+        "<path> [filter1] [filter2] [...]\n"
+        CANLOG_FILTER_HELP, 1, 9, true);
       }
     logtype++;
     }
-  cmd_canlog->RegisterCommand("off", "Stop logging", can_log, "", 0, 0, true);
+  cmd_canlog->RegisterCommand("off", "Stop logging", can_log,
+    "[<nr>|<type>|<path>]\n"
+    "Stops all loggers or the logger(s) given by number, type or path", 0, 1, true);
   cmd_canlog->RegisterCommand("status", "Logging status", can_log, "", 0, 0, true);
+  cmd_canlog->RegisterCommand("trigger", "Trigger ring capture", can_log_trigger,
+    "[reason]", 0, 1, true);
+  cmd_canlog->RegisterCommand("convert", "Convert binary log to CRTD", can_log_convert,
+    "<binpath> <crtdpath>", 2, 2, true);
+
+  OvmsCommand* cmd_canplay = cmd_can->RegisterCommand("play", "CAN log replay framework", NULL, "", 0, 0, true);
+  cmd_canplay->RegisterCommand("start", "Replay CRTD file", can_play_start,
+    "<path> [<speed>] [<bus>]\n"
+    "speed: time scale, 1 = original timing (default), 0 = as fast as possible\n"
+    "bus: inject all frames on this bus (default: bus of log record)", 1, 3, true);
+  cmd_canplay->RegisterCommand("stop", "Stop replay", can_play_stop, "", 0, 0, true);
+  cmd_canplay->RegisterCommand("status", "Replay status", can_play_status, "", 0, 0, true);
   
+  MyConfig.RegisterParam("can", "CAN framework", true, true);
+
+  m_framepool.Init(CAN_FRAMEPOOL_SIZE);
+  m_listener_drops = 0;
+  m_listeners_mutex = xSemaphoreCreateMutex();
   m_rxqueue = xQueueCreate(20,sizeof(CAN_msg_t));
   xTaskCreatePinnedToCore(CAN_rxtask, "CanRxTask", 4096, (void*)this, 10, &m_rxtask, 0);
-  m_logger = NULL;
+  m_loggers_mutex = xSemaphoreCreateMutex();
+  m_logcount = 0;
+
+  using std::placeholders::_1;
+  using std::placeholders::_2;
+  MyEvents.RegisterEvent(TAG, "ticker.1", std::bind(&can::EventListener, this, _1, _2));
   }
 
 can::~can()
   {
   }
 
+/**
+ * can::IncomingFrame -- pass a received frame to the listeners & logger
+ *    - p_frame may be a pool handle or a frame buffer of the caller
+ *    - the frame is copied into the pool once (if not pooled), listeners
+ *      receive references on the pooled frame
+ *    - p_frame->time: reception time taken by the driver, 0 = now
+ */
 void can::IncomingFrame(CAN_frame_t* p_frame)
   {
-  p_frame->origin->m_status.packets_rx++;
+  canbus* bus = p_frame->origin;
+  bus->m_status.packets_rx++;
+  bus->CountLoad(bus->m_load.rx, p_frame);
+  
+  int64_t now = esp_timer_get_time();
+  if (p_frame->time && p_frame->time <= now)
+    bus->m_lat_dispatch.Add(now - p_frame->time);
+  else
+    p_frame->time = now;
+  
+  xSemaphoreTake(m_listeners_mutex, portMAX_DELAY);
+  if (bus->m_idtable)
+    bus->m_idtable->Count(p_frame);
   
-  for (auto n : m_listeners)
+  CAN_frame_t* frame = m_framepool.Ref(p_frame, true);
+  if (frame)
     {
-    xQueueSend(n,p_frame,0);
+    for (auto& n : m_listeners)
+      {
+      if (n.filter == NULL || n.filter->Match(frame))
+        {
+        if (uxQueueMessagesWaiting(n.queue) >= n.quota)
+          {
+          // frame pool share used up, don't starve the other consumers:
+          n.dropped++;
+          m_listener_drops++;
+          continue;
+          }
+        m_framepool.Retain(frame);
+        if (xQueueSend(n.queue,&frame,0) != pdTRUE)
+          {
+          m_framepool.Release(frame);
+          n.dropped++;
+          m_listener_drops++;
+          }
+        }
+      }
     }
+  xSemaphoreGive(m_listeners_mutex);
+  if (!frame)
+    return; // pool exhausted, counted by pool
   
-  p_frame->origin->LogFrame(CAN_LogFrame_RX, p_frame);
+  frame->origin->LogFrame(CAN_LogFrame_RX, frame);
+  m_framepool.Release(frame);
   }
 
-void can::RegisterListener(QueueHandle_t queue)
+/**
+ * can::ReleaseFrame -- listener done with a frame
+ *    - records the reception to release latency of the frame's bus
+ *      (RX frames only, non-RX pool copies have time = 0)
+ *    - loggers use ReleaseLogFrame(), so they don't count as listeners
+ */
+void can::ReleaseFrame(CAN_frame_t* frame)
   {
-  m_listeners.push_back(queue);
+  if (!m_framepool.IsPooled(frame))
+    return;
+  if (frame->time && frame->origin)
+    {
+    int64_t now = esp_timer_get_time();
+    if (now >= frame->time)
+      frame->origin->m_lat_listener.Add(now - frame->time);
+    }
+  m_framepool.Release(frame);
   }
 
-void can::DeregisterListener(QueueHandle_t queue)
+/**
+ * can::EventListener -- bus load & latency metrics update
+ */
+void can::EventListener(std::string event, void* data)
   {
-  auto it = std::find(m_listeners.begin(), m_listeners.end(), queue);
-  if (it != m_listeners.end())
+  if (event == "ticker.1")
     {
-    m_listeners.erase(it);
+    int64_t now = esp_timer_get_time();
+    xSemaphoreTake(m_listeners_mutex, portMAX_DELAY);
+    for (canbus* bus : m_buses)
+      bus->UpdateLoad(now);
+    xSemaphoreGive(m_listeners_mutex);
     }
   }
 
+/**
+ * can::DrainRxRing -- process all frames queued by a driver ISR
+ *    - called by CanRxTask on a CAN_rxring wakeup message
+ *    - the wakeup flag is cleared before draining, so the ISR will send
+ *      a new wakeup for frames added after this point
+ */
+void can::DrainRxRing(canbus* bus)
+  {
+  canrxring& ring = bus->m_rxring;
+  CAN_frame_t* frame;
+  uint32_t cnt = 0;
 
+  ring.m_signalled = false;
+  while ((frame = ring.Front()) != NULL)
+    {
+    IncomingFrame(frame);
+    ring.Pop();
+    cnt++;
+    }
+  if (cnt)
+    bus->CountRxBatch(cnt);
+  }
 
-canbus::canbus(const char* name)
-  : pcp(name)
+/**
+ * can::SetIdTable -- enable / reset / disable per ID statistics of a bus
+ *    - size: number of IDs to track, 0 = disable
+ *    - an existing table is replaced (i.e. statistics are reset)
+ */
+bool can::SetIdTable(canbus* bus, uint32_t size)
   {
-  m_txqueue = xQueueCreate(20, sizeof(CAN_frame_t));
-  m_mode = CAN_MODE_OFF;
-  m_speed = CAN_SPEED_1000KBPS;
-  memset(&m_status, 0, sizeof(m_status));
-  m_status_chksum = 0;
+  canidtable* table = NULL;
+  if (size)
+    {
+    uint32_t tsize = 16;
+    while (tsize - (tsize >> 2) < size && tsize < CAN_IDTABLE_MAXSIZE)
+      tsize <<= 1;
+    table = new canidtable(tsize);
+    if (table->GetSize() == 0)
+      {
+      delete table;
+      return false;
+      }
+    }
+  xSemaphoreTake(m_listeners_mutex, portMAX_DELAY);
+  canidtable* old = bus->m_idtable;
+  bus->m_idtable = table;
+  xSemaphoreGive(m_listeners_mutex);
+  if (old)
+    delete old;
+  return true;
   }
 
-canbus::~canbus()
+/**
+ * can::GetIdTable -- get a snapshot of the per ID statistics of a bus
+ *    - returns false if the table is disabled
+ *    - result is sorted by frame format & ID
+ */
+bool can::GetIdTable(canbus* bus, std::vector<CAN_idstat_t>& result, uint32_t* overflow /*=NULL*/)
   {
-  vQueueDelete(m_txqueue);
+  bool enabled = false;
+  result.clear();
+  xSemaphoreTake(m_listeners_mutex, portMAX_DELAY);
+  if (bus->m_idtable)
+    {
+    enabled = true;
+    result.reserve(bus->m_idtable->GetUsed());
+    bus->m_idtable->GetEntries(result);
+    if (overflow)
+      *overflow = bus->m_idtable->GetOverflow();
+    }
+  xSemaphoreGive(m_listeners_mutex);
+  std::sort(result.begin(), result.end(),
+    [](const CAN_idstat_t& a, const CAN_idstat_t& b) { return a.key < b.key; });
+  return enabled;
   }
 
-esp_err_t canbus::Start(CAN_mode_t mode, CAN_speed_t speed)
+/**
+ * can::RegisterListener -- subscribe a queue to received frames
+ *    - the queue receives frame pool handles (CAN_frame_t*), the listener
+ *      needs to call MyCan.ReleaseFrame() for every frame received
+ *    - filter: NULL = all frames, else frames matching the filter
+ *    - the filter is owned by the framework after registration
+ *    - registering a queue again replaces its filter
+ */
+void can::RegisterListener(QueueHandle_t queue, canfilter* filter /*=NULL*/)
   {
-  // clear statistics:
-  memset(&m_status, 0, sizeof(m_status));
-  m_status_chksum = 0;
-  return ESP_FAIL;
+  xSemaphoreTake(m_listeners_mutex, portMAX_DELAY);
+  for (auto& n : m_listeners)
+    {
+    if (n.queue == queue)
+      {
+      if (n.filter)
+        delete n.filter;
+      n.filter = filter;
+      xSemaphoreGive(m_listeners_mutex);
+      UpdateAcceptanceFilters();
+      return;
+      }
+    }
+  CAN_listener_t listener;
+  listener.queue = queue;
+  listener.filter = filter;
+  listener.dropped = 0;
+  listener.quota = 0;
+  m_listeners.push_back(listener);
+  xSemaphoreGive(m_listeners_mutex);
+  UpdateFrameQuotas();
+  UpdateAcceptanceFilters();
   }
 
-esp_err_t canbus::Stop()
+void can::DeregisterListener(QueueHandle_t queue)
   {
-  return ESP_FAIL;
+  xSemaphoreTake(m_listeners_mutex, portMAX_DELAY);
+  for (auto it = m_listeners.begin(); it != m_listeners.end(); it++)
+    {
+    if (it->queue == queue)
+      {
+      if (it->filter)
+        delete it->filter;
+      m_listeners.erase(it);
+      break;
+      }
+    }
+  xSemaphoreGive(m_listeners_mutex);
+
+  // release frames still queued:
+  CAN_frame_t* frame;
+  while (xQueueReceive(queue, &frame, 0) == pdTRUE)
+    m_framepool.Release(frame);
+
+  UpdateFrameQuotas();
+  UpdateAcceptanceFilters();
   }
 
-bool canbus::RxCallback(CAN_frame_t* frame)
+void can::RegisterBus(canbus* bus)
   {
-  return false;
+  xSemaphoreTake(m_listeners_mutex, portMAX_DELAY);
+  m_buses.push_back(bus);
+  xSemaphoreGive(m_listeners_mutex);
   }
 
-void canbus::TxCallback()
+void can::DeregisterBus(canbus* bus)
   {
+  xSemaphoreTake(m_listeners_mutex, portMAX_DELAY);
+  m_buses.remove(bus);
+  xSemaphoreGive(m_listeners_mutex);
+  }
+
+void can::AddLogger(canlog* logger)
+  {
+  xSemaphoreTake(m_loggers_mutex, portMAX_DELAY);
+  m_loggers.push_back(logger);
+  m_logcount = m_loggers.size();
+  xSemaphoreGive(m_loggers_mutex);
+  UpdateFrameQuotas();
+  UpdateAcceptanceFilters();
   }
 
 /**
- * canbus::Write -- main TX API
- *    - returns ESP_OK, ESP_QUEUED or ESP_FAIL
- *      … ESP_OK = frame delivered to CAN transceiver (not necessarily sent!)
- *      … ESP_FAIL = TX queue is full (TX overflow)
- *    - actual TX implementation in driver override
- *    - here: counting & logging of frames sent (called by driver after a successful TX)
+ * can::RemoveLogger -- detach a logger
+ *    - no log calls are running into the logger when this returns
  */
-esp_err_t canbus::Write(const CAN_frame_t* p_frame, TickType_t maxqueuewait /*=0*/)
+void can::RemoveLogger(canlog* logger)
   {
-  m_status.packets_tx++;
-  LogFrame(CAN_LogFrame_TX, p_frame);
-  return ESP_OK;
+  xSemaphoreTake(m_loggers_mutex, portMAX_DELAY);
+  m_loggers.remove(logger);
+  m_logcount = m_loggers.size();
+  xSemaphoreGive(m_loggers_mutex);
+  UpdateFrameQuotas();
+  UpdateAcceptanceFilters();
   }
 
 /**
- * canbus::QueueWrite -- add a frame to the TX queue for later delivery
- *    - internal method, called by driver if no TX buffer is available
+ * can::UpdateFrameQuotas -- share the frame pool among listeners & loggers
+ *    - all consumers take their frame references from one pool, so a
+ *      consumer falling behind could exhaust it and cause frame loss
+ *      for all others
+ *    - each consumer may queue up to its queue size as long as the sum
+ *      fits into the pool (minus a reserve for frames in dispatch),
+ *      else the pool is shared in proportion to the queue sizes, so a
+ *      slow consumer can only drop its own frames
+ *    - called on changes of listeners or loggers
  */
-esp_err_t canbus::QueueWrite(const CAN_frame_t* p_frame, TickType_t maxqueuewait /*=0*/)
+void can::UpdateFrameQuotas()
   {
-  if (xQueueSend(m_txqueue, p_frame, maxqueuewait) == pdTRUE)
+  uint32_t avail = m_framepool.GetSize() - CAN_FRAMEPOOL_RESERVE;
+  uint32_t total = 0;
+
+  xSemaphoreTake(m_listeners_mutex, portMAX_DELAY);
+  xSemaphoreTake(m_loggers_mutex, portMAX_DELAY);
+  for (auto& n : m_listeners)
+    total += uxQueueMessagesWaiting(n.queue) + uxQueueSpacesAvailable(n.queue);
+  for (canlog* logger : m_loggers)
+    total += uxQueueMessagesWaiting(logger->m_queue) + uxQueueSpacesAvailable(logger->m_queue);
+  for (auto& n : m_listeners)
     {
-    m_status.txbuf_delay++;
-    LogFrame(CAN_LogFrame_TX_Queue, p_frame);
-    return ESP_QUEUED;
+    uint32_t size = uxQueueMessagesWaiting(n.queue) + uxQueueSpacesAvailable(n.queue);
+    n.quota = (total <= avail) ? size : std::max<uint32_t>(1, (uint64_t)avail * size / total);
     }
-  else
+  for (canlog* logger : m_loggers)
     {
-    m_status.txbuf_overflow++;
-    LogFrame(CAN_LogFrame_TX_Fail, p_frame);
-    return ESP_FAIL;
+    uint32_t size = uxQueueMessagesWaiting(logger->m_queue) + uxQueueSpacesAvailable(logger->m_queue);
+    logger->m_framequota = (total <= avail) ? size : std::max<uint32_t>(1, (uint64_t)avail * size / total);
     }
+  xSemaphoreGive(m_loggers_mutex);
+  xSemaphoreGive(m_listeners_mutex);
+  if (total > avail)
+    ESP_LOGW(TAG, "Frame pool overcommitted (%u queue slots, %u pool slots), queues limited to their share",
+      total, avail);
   }
 
 /**
- * canbus::WriteExtended -- application TX utility
+ * can::GetListenerDrops -- frames lost per listener (queue full), in registration order
  */
-esp_err_t canbus::WriteExtended(uint32_t id, uint8_t length, uint8_t *data, TickType_t maxqueuewait /*=0*/)
+std::vector<uint32_t> can::GetListenerDrops()
   {
-  if (length > 8)
-    {
-    abort();
-    }
-
-  CAN_frame_t frame;
-  memset(&frame, 0, sizeof(frame));
+  std::vector<uint32_t> drops;
+  xSemaphoreTake(m_listeners_mutex, portMAX_DELAY);
+  for (auto& n : m_listeners)
+    drops.push_back(n.dropped);
+  xSemaphoreGive(m_listeners_mutex);
+  return drops;
+  }
 
-  frame.origin = this;
-  frame.FIR.U = 0;
-  frame.FIR.B.DLC = length;
-  frame.FIR.B.FF = CAN_frame_ext;
-  frame.MsgID = id;
-  memcpy(frame.data.u8, data, length);
-  return this->Write(&frame, maxqueuewait);
+std::list<canlog*> can::GetLoggers()
+  {
+  xSemaphoreTake(m_loggers_mutex, portMAX_DELAY);
+  std::list<canlog*> loggers = m_loggers;
+  xSemaphoreGive(m_loggers_mutex);
+  return loggers;
   }
 
 /**
- * canbus::WriteStandard -- application TX utility
+ * can::UpdateAcceptanceFilters -- plan hardware acceptance filters
+ *    - called on changes of listeners or logger
+ *    - per bus, the union of the ID interests of all consumers is passed
+ *      to the driver; the driver reduces it to its filter capabilities
+ *    - a consumer without ID rules or a bus without consumers
+ *      results in accept all
  */
-esp_err_t canbus::WriteStandard(uint16_t id, uint8_t length, uint8_t *data, TickType_t maxqueuewait /*=0*/)
+void can::UpdateAcceptanceFilters()
   {
-  if (length > 8)
+  std::list< std::pair<canbus*,canfilter*> > plans;
+
+  xSemaphoreTake(m_listeners_mutex, portMAX_DELAY);
+  for (canbus* bus : m_buses)
     {
-    abort();
+    canfilter* plan = new canfilter();
+    bool all = false, any = false;
+    for (auto& n : m_listeners)
+      {
+      if (n.filter && !n.filter->MatchBus(bus))
+        continue;
+      any = true;
+      if (!n.filter || !n.filter->m_idfilter)
+        {
+        all = true;
+        break;
+        }
+      plan->Merge(*n.filter);
+      }
+    if (!all)
+      {
+      xSemaphoreTake(m_loggers_mutex, portMAX_DELAY);
+      for (canlog* logger : m_loggers)
+        {
+        if (!logger->IsOpen())
+          continue;
+        any = true;
+        if (!logger->MergeInterest(bus, plan))
+          {
+          all = true;
+          break;
+          }
+        }
+      xSemaphoreGive(m_loggers_mutex);
+      }
+    if (all || !any)
+      {
+      delete plan;
+      plan = NULL;
+      }
+    plans.push_back(std::make_pair(bus, plan));
     }
+  xSemaphoreGive(m_listeners_mutex);
 
-  CAN_frame_t frame;
-  memset(&frame, 0, sizeof(frame));
+  for (auto& p : plans)
+    {
+    p.first->SetAcceptanceFilter(p.second);
+    if (p.second)
+      delete p.second;
+    }
+  }
 
-  frame.origin = this;
+
+static void CAN_txtimer(TimerHandle_t timer)
+  {
+  // rate limit wait done, let CanRxTask schedule the next frames:
+  CAN_msg_t msg;
+  msg.type = CAN_txcallback;
+  msg.body.bus = (canbus*) pvTimerGetTimerID(timer);
+  xQueueSend(MyCan.m_rxqueue, &msg, 0);
+  }
+
+canbus::canbus(const char* name)
+  : pcp(name)
+  {
+  static const int txqueuesize[CAN_TX_CLASSES] = { 10, 10, 20, 20 };
+  for (int i = 0; i < CAN_TX_CLASSES; i++)
+    m_txqueue[i] = xQueueCreate(txqueuesize[i], sizeof(CAN_txentry_t));
+  memset(m_txclass, 0, sizeof(m_txclass));
+  m_txmutex = xSemaphoreCreateMutex();
+  m_txtimer = xTimerCreate("CanTxTimer", 1, pdFALSE, this, CAN_txtimer);
+  m_mode = CAN_MODE_OFF;
+  m_speed = CAN_SPEED_1000KBPS;
+  memset(&m_status, 0, sizeof(m_status));
+  m_status_chksum = 0;
+  m_busnumber = (strncmp(name, "can", 3) == 0) ? atoi(name+3) : 0;
+  m_rxbatch_count = 0;
+  m_rxbatch_frames = 0;
+  m_rxbatch_max = 0;
+  m_acceptfilter = NULL;
+  m_acceptnext = NULL;
+  m_acceptpending = false;
+  m_acceptmutex = xSemaphoreCreateRecursiveMutex();
+  m_idtable = NULL;
+  ClearLoad();
+  m_metric_fps = NULL;
+  m_metric_bps = NULL;
+  m_metric_load = NULL;
+  m_metric_dispatch_avg = NULL;
+  m_metric_dispatch_max = NULL;
+  m_metric_listener_avg = NULL;
+  m_metric_listener_max = NULL;
+  MyCan.RegisterBus(this);
+  }
+
+canbus::~canbus()
+  {
+  MyCan.DeregisterBus(this);
+  if (m_acceptfilter)
+    delete m_acceptfilter;
+  if (m_acceptnext)
+    delete m_acceptnext;
+  vSemaphoreDelete(m_acceptmutex);
+  if (m_idtable)
+    delete m_idtable;
+  xTimerDelete(m_txtimer, 0);
+  vSemaphoreDelete(m_txmutex);
+  for (int i = 0; i < CAN_TX_CLASSES; i++)
+    vQueueDelete(m_txqueue[i]);
+  }
+
+esp_err_t canbus::Start(CAN_mode_t mode, CAN_speed_t speed)
+  {
+  // clear statistics:
+  memset(&m_status, 0, sizeof(m_status));
+  m_status_chksum = 0;
+  m_rxring.ClearStats();
+  m_rxbatch_count = 0;
+  m_rxbatch_frames = 0;
+  m_rxbatch_max = 0;
+  ClearLoad();
+  for (int i = 0; i < CAN_TX_CLASSES; i++)
+    {
+    CAN_txclass_status_t& tc = m_txclass[i];
+    tc.sent = tc.delayed = tc.dropped = tc.expired = 0;
+    tc.latency_sum = 0;
+    tc.latency_max = 0;
+    }
+  return ESP_FAIL;
+  }
+
+esp_err_t canbus::Stop()
+  {
+  return ESP_FAIL;
+  }
+
+/**
+ * canbus::SetAcceptanceFilter -- set hardware acceptance filter plan
+ *    - filter: IDs needed by the consumers of this bus, NULL = accept all
+ *    - the plan is copied and handed to CanRxTask, which applies it
+ *      (if running), so the driver does not need to serialize the
+ *      reprogramming with its RX handling; Start() applies the
+ *      current plan
+ *    - multiple changes before CanRxTask gets to it are coalesced
+ */
+void canbus::SetAcceptanceFilter(const canfilter* filter)
+  {
+  canfilter* plan = filter ? new canfilter(*filter) : NULL;
+  xSemaphoreTakeRecursive(m_acceptmutex, portMAX_DELAY);
+  canfilter* old = m_acceptnext;
+  m_acceptnext = plan;
+  bool post = !m_acceptpending;
+  m_acceptpending = true;
+  xSemaphoreGiveRecursive(m_acceptmutex);
+  if (old)
+    delete old;
+  if (post)
+    {
+    CAN_msg_t msg;
+    msg.type = CAN_acceptfilter;
+    msg.body.bus = this;
+    xQueueSend(MyCan.m_rxqueue, &msg, portMAX_DELAY);
+    }
+  }
+
+/**
+ * canbus::AcceptanceFilterCallback -- apply the pending plan
+ *    - called by CanRxTask on a CAN_acceptfilter message
+ */
+void canbus::AcceptanceFilterCallback()
+  {
+  canfilter* old = NULL;
+  xSemaphoreTakeRecursive(m_acceptmutex, portMAX_DELAY);
+  if (m_acceptpending)
+    {
+    old = m_acceptfilter;
+    m_acceptfilter = m_acceptnext;
+    m_acceptnext = NULL;
+    m_acceptpending = false;
+    }
+  xSemaphoreGiveRecursive(m_acceptmutex);
+  if (old)
+    delete old;
+  ApplyAcceptanceFilter();
+  }
+
+esp_err_t canbus::ApplyAcceptanceFilter()
+  {
+  return ESP_OK; // no hardware filter: accept all
+  }
+
+void canbus::CountRxBatch(uint32_t frames)
+  {
+  m_rxbatch_count++;
+  m_rxbatch_frames += frames;
+  if (frames > m_rxbatch_max)
+    m_rxbatch_max = frames;
+  }
+
+bool canbus::RxCallback(CAN_frame_t* frame)
+  {
+  return false;
+  }
+
+/**
+ * canbus::GetFrameBits -- nominal bit times of a frame on the bus
+ *    - SOF to EOF plus interframe space, bit stuffing not included
+ *      (stuff bits add up to ~20%, so the load is a lower bound)
+ */
+uint32_t canbus::GetFrameBits(const CAN_frame_t* p_frame)
+  {
+  uint32_t bits = (p_frame->FIR.B.FF == CAN_frame_std) ? 47 : 67;
+  if (!p_frame->FIR.B.RTR)
+    bits += 8 * ((p_frame->FIR.B.DLC > 8) ? 8 : p_frame->FIR.B.DLC);
+  return bits;
+  }
+
+void canbus::ClearLoad()
+  {
+  memset(&m_load, 0, sizeof(m_load));
+  m_load.time = esp_timer_get_time();
+  m_lat_dispatch.Clear();
+  m_lat_listener.Clear();
+  }
+
+/**
+ * canbus::UpdateLoad -- calculate bus load & latency metrics
+ *    - called once per second by the CAN framework
+ */
+void canbus::UpdateLoad(int64_t now)
+  {
+  if (m_mode == CAN_MODE_OFF)
+    {
+    m_load.time = now;
+    return;
+    }
+
+  CAN_loadcount_t total;
+  total.frames = m_load.rx.frames + m_load.tx.frames;
+  total.bytes = m_load.rx.bytes + m_load.tx.bytes;
+  total.bits = m_load.rx.bits + m_load.tx.bits;
+  
+  float secs = (now - m_load.time) / 1000000.0f;
+  if (secs <= 0)
+    return;
+  m_load.fps = (total.frames - m_load.last.frames) / secs;
+  m_load.bps = (total.bytes - m_load.last.bytes) / secs;
+  m_load.load = (total.bits - m_load.last.bits) / (secs * m_speed * 10.0f);
+  m_load.last = total;
+  m_load.time = now;
+
+  uint32_t dispatch_avg, dispatch_max, listener_avg, listener_max;
+  m_lat_dispatch.TakePeriod(dispatch_avg, dispatch_max);
+  m_lat_listener.TakePeriod(listener_avg, listener_max);
+
+  if (!m_metric_fps)
+    {
+    std::string prefix = "m.can.";
+    prefix.append(GetName());
+    m_metric_fps = MyMetrics.InitFloat(strdup((prefix + ".fps").c_str()), SM_STALE_MIN, 0);
+    m_metric_bps = MyMetrics.InitInt(strdup((prefix + ".bps").c_str()), SM_STALE_MIN, 0);
+    m_metric_load = MyMetrics.InitFloat(strdup((prefix + ".load").c_str()), SM_STALE_MIN, 0, Percentage);
+    m_metric_dispatch_avg = MyMetrics.InitInt(strdup((prefix + ".lat.dispatch.avg").c_str()), SM_STALE_MIN, 0);
+    m_metric_dispatch_max = MyMetrics.InitInt(strdup((prefix + ".lat.dispatch.max").c_str()), SM_STALE_MIN, 0);
+    m_metric_listener_avg = MyMetrics.InitInt(strdup((prefix + ".lat.listener.avg").c_str()), SM_STALE_MIN, 0);
+    m_metric_listener_max = MyMetrics.InitInt(strdup((prefix + ".lat.listener.max").c_str()), SM_STALE_MIN, 0);
+    }
+  m_metric_fps->SetValue(m_load.fps);
+  m_metric_bps->SetValue((int)m_load.bps);
+  m_metric_load->SetValue(m_load.load, Percentage);
+  m_metric_dispatch_avg->SetValue((int)dispatch_avg);
+  m_metric_dispatch_max->SetValue((int)dispatch_max);
+  m_metric_listener_avg->SetValue((int)listener_avg);
+  m_metric_listener_max->SetValue((int)listener_max);
+  }
+
+/**
+ * canbus::TxCallback -- a TX buffer has become available
+ *    - called by the driver (in CanRxTask context), sends queued frames
+ */
+void canbus::TxCallback()
+  {
+  TxSchedule();
+  }
+
+/**
+ * canbus::Write -- main TX API
+ *    - returns ESP_OK, ESP_QUEUED or ESP_FAIL
+ *      … ESP_OK = frame delivered to CAN transceiver (not necessarily sent!)
+ *      … ESP_FAIL = TX queue is full (TX overflow)
+ *    - sends the frame in TX class CAN_TX_NORMAL without deadline
+ */
+esp_err_t canbus::Write(const CAN_frame_t* p_frame, TickType_t maxqueuewait /*=0*/)
+  {
+  return WriteClass(p_frame, CAN_TX_NORMAL, 0, maxqueuewait);
+  }
+
+/**
+ * canbus::WriteClass -- TX API with priority class & deadline
+ *    - txclass: frames of higher classes (lower values) are sent first
+ *    - deadline_ms: drop the frame if it cannot be sent within this time,
+ *      0 = no deadline
+ *    - returns ESP_OK, ESP_QUEUED or ESP_FAIL (see Write)
+ *  The frame is sent immediately if no frames are queued, the class rate
+ *  limit allows it and the driver has a free TX buffer. Otherwise it's
+ *  queued and sent by the scheduler when a TX buffer becomes available.
+ */
+esp_err_t canbus::WriteClass(const CAN_frame_t* p_frame, CAN_txclass_t txclass,
+                             uint32_t deadline_ms /*=0*/, TickType_t maxqueuewait /*=0*/)
+  {
+  CAN_txentry_t entry;
+  int64_t now = esp_timer_get_time();
+
+  if (txclass < 0 || txclass >= CAN_TX_CLASSES)
+    txclass = CAN_TX_NORMAL;
+
+  // try immediate transmission:
+  xSemaphoreTake(m_txmutex, portMAX_DELAY);
+  bool queued = false;
+  for (int i = 0; i < CAN_TX_CLASSES; i++)
+    queued = queued || (uxQueueMessagesWaiting(m_txqueue[i]) > 0);
+  if (!queued && TxTokenAvailable(txclass, now) && TxFrame(p_frame) == ESP_OK)
+    {
+    TxDone(txclass, p_frame, now, now);
+    xSemaphoreGive(m_txmutex);
+    return ESP_OK;
+    }
+  xSemaphoreGive(m_txmutex);
+
+  // queue frame:
+  entry.frame = *p_frame;
+  entry.queued = now;
+  entry.deadline = (deadline_ms) ? now + (int64_t)deadline_ms * 1000 : 0;
+  if (xQueueSend(m_txqueue[txclass], &entry, maxqueuewait) == pdTRUE)
+    {
+    m_status.txbuf_delay++;
+    m_txclass[txclass].delayed++;
+    LogFrame(CAN_LogFrame_TX_Queue, p_frame);
+    // the TX buffer may have become free in the meantime:
+    TxSchedule();
+    return ESP_QUEUED;
+    }
+  else
+    {
+    m_status.txbuf_overflow++;
+    m_txclass[txclass].dropped++;
+    LogFrame(CAN_LogFrame_TX_Fail, p_frame);
+    return ESP_FAIL;
+    }
+  }
+
+/**
+ * canbus::TxFrame -- load frame into a free hardware TX buffer
+ *    - driver implementation, returns ESP_FAIL if no TX buffer is available
+ */
+esp_err_t canbus::TxFrame(const CAN_frame_t* p_frame)
+  {
+  return ESP_FAIL;
+  }
+
+/**
+ * canbus::TxSchedule -- send queued frames as long as TX buffers are available
+ *    - classes are served in priority order, a class exceeding its rate
+ *      limit is skipped and the TX timer is set to the time of its next token
+ *    - expired frames are dropped
+ */
+void canbus::TxSchedule()
+  {
+  CAN_txentry_t entry;
+  int64_t wait = 0;
+
+  xSemaphoreTake(m_txmutex, portMAX_DELAY);
+  int i = 0;
+  while (i < CAN_TX_CLASSES)
+    {
+    CAN_txclass_t txclass = (CAN_txclass_t) i;
+    if (xQueuePeek(m_txqueue[i], &entry, 0) != pdTRUE)
+      {
+      i++;
+      continue;
+      }
+    int64_t now = esp_timer_get_time();
+    if (entry.deadline && now > entry.deadline)
+      {
+      xQueueReceive(m_txqueue[i], &entry, 0);
+      m_txclass[i].expired++;
+      LogFrame(CAN_LogFrame_TX_Fail, &entry.frame);
+      continue;
+      }
+    if (!TxTokenAvailable(txclass, now))
+      {
+      int64_t next = (int64_t)((1.0f - m_txclass[i].tokens) * 1000000 / m_txclass[i].budget) + 1;
+      if (wait == 0 || next < wait)
+        wait = next;
+      i++;
+      continue;
+      }
+    if (TxFrame(&entry.frame) != ESP_OK)
+      break; // no TX buffer available, wait for TxCallback
+    xQueueReceive(m_txqueue[i], &entry, 0);
+    TxDone(txclass, &entry.frame, entry.queued, now);
+    i = 0; // restart with highest class
+    }
+  xSemaphoreGive(m_txmutex);
+
+  if (wait)
+    {
+    TickType_t ticks = pdMS_TO_TICKS((wait + 999) / 1000);
+    xTimerChangePeriod(m_txtimer, (ticks > 0) ? ticks : 1, 0);
+    }
+  }
+
+/**
+ * canbus::TxTokenAvailable -- check & refill class rate limit token bucket
+ *    - the bucket holds up to 100 ms worth of frames (min 1)
+ */
+bool canbus::TxTokenAvailable(CAN_txclass_t txclass, int64_t now)
+  {
+  CAN_txclass_status_t& tc = m_txclass[txclass];
+  if (tc.budget == 0)
+    return true;
+  float burst = (tc.budget >= 10) ? tc.budget / 10 : 1;
+  tc.tokens += (float)(now - tc.refill) * tc.budget / 1000000;
+  if (tc.tokens > burst)
+    tc.tokens = burst;
+  tc.refill = now;
+  return (tc.tokens >= 1.0f);
+  }
+
+/**
+ * canbus::TxDone -- frame loaded into TX buffer: statistics & logging
+ */
+void canbus::TxDone(CAN_txclass_t txclass, const CAN_frame_t* p_frame, int64_t queued, int64_t now)
+  {
+  CAN_txclass_status_t& tc = m_txclass[txclass];
+  if (tc.budget)
+    tc.tokens -= 1.0f;
+  uint32_t latency = now - queued;
+  tc.sent++;
+  tc.latency_sum += latency;
+  if (latency > tc.latency_max)
+    tc.latency_max = latency;
+  m_status.packets_tx++;
+  CountLoad(m_load.tx, p_frame);
+  LogFrame(CAN_LogFrame_TX, p_frame);
+  }
+
+/**
+ * canbus::SetTxBudget -- set class rate limit
+ *    - fps: max frames per second, 0 = unlimited
+ */
+void canbus::SetTxBudget(CAN_txclass_t txclass, uint32_t fps)
+  {
+  xSemaphoreTake(m_txmutex, portMAX_DELAY);
+  m_txclass[txclass].budget = fps;
+  m_txclass[txclass].tokens = 1.0f;
+  m_txclass[txclass].refill = esp_timer_get_time();
+  xSemaphoreGive(m_txmutex);
+  TxSchedule();
+  }
+
+const char* canbus::GetTxClassName(CAN_txclass_t txclass)
+  {
+  switch (txclass)
+    {
+    case CAN_TX_CONTROL:  return "control";
+    case CAN_TX_RESPONSE: return "response";
+    case CAN_TX_NORMAL:   return "normal";
+    case CAN_TX_BULK:     return "bulk";
+    default:              return "?";
+    }
+  }
+
+/**
+ * canbus::WriteExtended -- application TX utility
+ */
+esp_err_t canbus::WriteExtended(uint32_t id, uint8_t length, uint8_t *data, TickType_t maxqueuewait /*=0*/)
+  {
+  if (length > 8)
+    {
+    abort();
+    }
+
+  CAN_frame_t frame;
+  memset(&frame, 0, sizeof(frame));
+
+  frame.origin = this;
+  frame.FIR.U = 0;
+  frame.FIR.B.DLC = length;
+  frame.FIR.B.FF = CAN_frame_ext;
+  frame.MsgID = id;
+  memcpy(frame.data.u8, data, length);
+  return this->Write(&frame, maxqueuewait);
+  }
+
+/**
+ * canbus::WriteStandard -- application TX utility
+ */
+esp_err_t canbus::WriteStandard(uint16_t id, uint8_t length, uint8_t *data, TickType_t maxqueuewait /*=0*/)
+  {
+  if (length > 8)
+    {
+    abort();
+    }
+
+  CAN_frame_t frame;
+  memset(&frame, 0, sizeof(frame));
+
+  frame.origin = this;
   frame.FIR.U = 0;
   frame.FIR.B.DLC = length;
   frame.FIR.B.FF = CAN_frame_std;
@@ -557,6 +1506,585 @@ esp_err_t canbus::WriteStandard(uint16_t id, uint8_t length, uint8_t *data, Tick
   return this->Write(&frame, maxqueuewait);
   }
 
+/**
+ * canfilter: CAN frame subscription filter
+ */
+
+canfilter::canfilter()
+  {
+  m_busmask = 0;
+  m_idfilter = false;
+  m_stdmap = NULL;
+  }
+
+canfilter::canfilter(const canfilter& src)
+  {
+  m_stdmap = NULL;
+  *this = src;
+  }
+
+canfilter& canfilter::operator=(const canfilter& src)
+  {
+  if (this == &src)
+    return *this;
+  Clear();
+  m_busmask = src.m_busmask;
+  m_idfilter = src.m_idfilter;
+  if (src.m_stdmap)
+    {
+    m_stdmap = (uint32_t*) malloc(2048/8);
+    if (m_stdmap)
+      memcpy(m_stdmap, src.m_stdmap, 2048/8);
+    else
+      ESP_LOGE(TAG, "canfilter: cannot allocate std ID map");
+    }
+  m_extranges = src.m_extranges;
+  return *this;
+  }
+
+canfilter::~canfilter()
+  {
+  if (m_stdmap)
+    free(m_stdmap);
+  }
+
+void canfilter::Clear()
+  {
+  m_busmask = 0;
+  m_idfilter = false;
+  if (m_stdmap)
+    {
+    free(m_stdmap);
+    m_stdmap = NULL;
+    }
+  m_extranges.clear();
+  }
+
+void canfilter::AddBus(int busnumber)
+  {
+  if (busnumber >= 1 && busnumber <= 32)
+    m_busmask |= (1 << (busnumber-1));
+  }
+
+void canfilter::AddBus(canbus* bus)
+  {
+  if (bus)
+    AddBus(bus->m_busnumber);
+  }
+
+bool canfilter::MatchBus(const canbus* bus) const
+  {
+  if (m_busmask == 0)
+    return true;
+  if (!bus || bus->m_busnumber < 1 || bus->m_busnumber > 32)
+    return false;
+  return (m_busmask & (1 << (bus->m_busnumber-1))) != 0;
+  }
+
+/**
+ * canfilter::AllocStandard -- allocate empty std ID map
+ *    - on failure no std IDs will match
+ */
+bool canfilter::AllocStandard()
+  {
+  m_stdmap = (uint32_t*) calloc(2048/32, sizeof(uint32_t));
+  if (!m_stdmap)
+    ESP_LOGE(TAG, "canfilter: cannot allocate std ID map");
+  return (m_stdmap != NULL);
+  }
+
+void canfilter::AddStandard(uint16_t from, uint16_t to)
+  {
+  m_idfilter = true;
+  if (from > to || from > 0x7ff)
+    return;
+  if (to > 0x7ff)
+    to = 0x7ff;
+  if (!m_stdmap && !AllocStandard())
+    return;
+  for (uint32_t id = from; id <= to; id++)
+    m_stdmap[id >> 5] |= (1 << (id & 0x1f));
+  }
+
+/**
+ * canfilter::AddExtended -- add extended ID range
+ *    - keeps the range list sorted and merges overlapping / adjacent ranges
+ */
+void canfilter::AddExtended(uint32_t from, uint32_t to)
+  {
+  m_idfilter = true;
+  if (from > to || from > 0x1fffffff)
+    return;
+  if (to > 0x1fffffff)
+    to = 0x1fffffff;
+
+  // find first range that may touch the new one:
+  auto it = std::lower_bound(m_extranges.begin(), m_extranges.end(), from,
+    [](const CAN_idrange_t& r, uint32_t id) { return r.to + 1 < id; });
+
+  // merge all touching ranges:
+  auto last = it;
+  while (last != m_extranges.end() && last->from <= to + 1)
+    {
+    from = std::min(from, last->from);
+    to = std::max(to, last->to);
+    last++;
+    }
+  it = m_extranges.erase(it, last);
+  CAN_idrange_t range = { from, to };
+  m_extranges.insert(it, range);
+  }
+
+bool canfilter::MatchExtended(uint32_t id) const
+  {
+  auto it = std::upper_bound(m_extranges.begin(), m_extranges.end(), id,
+    [](uint32_t id, const CAN_idrange_t& r) { return id < r.from; });
+  if (it == m_extranges.begin())
+    return false;
+  it--;
+  return (id <= it->to);
+  }
+
+/**
+ * canfilter::Merge -- add the ID rules of another filter (bus mask unchanged)
+ */
+void canfilter::Merge(const canfilter& src)
+  {
+  if (!src.m_idfilter)
+    return;
+  m_idfilter = true;
+  if (src.m_stdmap)
+    {
+    if (m_stdmap || AllocStandard())
+      {
+      for (int i = 0; i < 2048/32; i++)
+        m_stdmap[i] |= src.m_stdmap[i];
+      }
+    }
+  for (auto& r : src.m_extranges)
+    AddExtended(r.from, r.to);
+  }
+
+// Number of IDs covered by a code/mask pair:
+static uint64_t idmask_coverage(const CAN_idmask_t& m, int idbits)
+  {
+  return 1ULL << (idbits - __builtin_popcount(m.mask));
+  }
+
+// Smallest code/mask pair covering both pairs:
+static CAN_idmask_t idmask_merge(const CAN_idmask_t& a, const CAN_idmask_t& b)
+  {
+  CAN_idmask_t m;
+  m.mask = a.mask & b.mask & ~(a.code ^ b.code);
+  m.code = a.code & m.mask;
+  return m;
+  }
+
+// Decompose ID range into aligned power of 2 blocks:
+static void idmask_addrange(std::vector<CAN_idmask_t>& list, uint32_t from, uint32_t to, uint32_t idmask)
+  {
+  uint64_t id = from;
+  while (id <= to)
+    {
+    uint64_t size = 1;
+    while ((id & (size*2-1)) == 0 && id + size*2 - 1 <= to && size*2 <= (uint64_t)idmask+1)
+      size *= 2;
+    CAN_idmask_t m;
+    m.code = id;
+    m.mask = idmask & ~(size-1);
+    list.push_back(m);
+    id += size;
+    }
+  }
+
+/**
+ * canfilter::PlanAcceptance -- plan hardware acceptance code/mask pairs
+ *    - extended: plan for extended (29 bit) or standard (11 bit) IDs
+ *    - maxmasks: max number of pairs available
+ *    - result: pairs covering (at least) all IDs of the format, empty = no IDs
+ *    - returns false if the pairs cover more than half of the ID space,
+ *      i.e. hardware filtering isn't worth it
+ *  The ID set is split into aligned blocks, which are then merged greedily
+ *  choosing the pair adding the fewest unwanted IDs.
+ */
+bool canfilter::PlanAcceptance(bool extended, int maxmasks, std::vector<CAN_idmask_t>& result) const
+  {
+  uint32_t idmask = extended ? 0x1fffffff : 0x7ff;
+  int idbits = extended ? 29 : 11;
+  std::vector<CAN_idmask_t> list;
+
+  result.clear();
+  if (!m_idfilter || maxmasks < 1)
+    return false;
+
+  // Collect blocks:
+  if (extended)
+    {
+    for (auto& r : m_extranges)
+      idmask_addrange(list, r.from, r.to, idmask);
+    }
+  else if (m_stdmap)
+    {
+    int from = -1;
+    for (int id = 0; id <= 0x800; id++)
+      {
+      bool set = (id < 0x800) && (m_stdmap[id >> 5] & (1 << (id & 0x1f)));
+      if (set && from < 0)
+        from = id;
+      else if (!set && from >= 0)
+        {
+        idmask_addrange(list, from, id-1, idmask);
+        from = -1;
+        }
+      }
+    }
+  if (list.empty())
+    return true;
+
+  // Merge pairs until the list fits; large lists are first reduced
+  // by merging neighbours only to limit the effort:
+  while (list.size() > (size_t)maxmasks)
+    {
+    size_t best_a = 0, best_b = 1;
+    uint64_t best_cov = UINT64_MAX;
+    bool neighbours = (list.size() > 32);
+    for (size_t a = 0; a < list.size()-1; a++)
+      {
+      for (size_t b = a+1; b < (neighbours ? a+2 : list.size()); b++)
+        {
+        CAN_idmask_t m = idmask_merge(list[a], list[b]);
+        uint64_t cov = idmask_coverage(m, idbits);
+        if (cov < best_cov)
+          {
+          best_cov = cov;
+          best_a = a;
+          best_b = b;
+          }
+        }
+      }
+    CAN_idmask_t m = idmask_merge(list[best_a], list[best_b]);
+    list[best_a] = m;
+    list.erase(list.begin() + best_b);
+    // remove pairs covered by the new one:
+    for (size_t i = 0; i < list.size(); )
+      {
+      if (i != best_a && (list[i].mask & m.mask) == m.mask && (list[i].code & m.mask) == m.code)
+        {
+        list.erase(list.begin() + i);
+        if (i < best_a) best_a--;
+        }
+      else
+        i++;
+      }
+    }
+
+  uint64_t covered = 0;
+  for (auto& m : list)
+    covered += idmask_coverage(m, idbits);
+  result = list;
+  return (covered <= (1ULL << (idbits-1)));
+  }
+
+/**
+ * canframepool: reference counted CAN frame pool
+ */
+
+canframepool::canframepool()
+  {
+  m_slots = NULL;
+  m_size = 0;
+  m_free = -1;
+  m_mux = portMUX_INITIALIZER_UNLOCKED;
+  m_used = 0;
+  m_hwm = 0;
+  m_allocfail = 0;
+  }
+
+canframepool::~canframepool()
+  {
+  if (m_slots)
+    free(m_slots);
+  }
+
+bool canframepool::Init(uint32_t size)
+  {
+  m_slots = (slot_t*) calloc(size, sizeof(slot_t));
+  if (!m_slots)
+    {
+    ESP_LOGE(TAG, "canframepool: cannot allocate %d slots", size);
+    return false;
+    }
+  m_size = size;
+  for (uint32_t i = 0; i < size; i++)
+    m_slots[i].next = (i+1 < size) ? i+1 : -1;
+  m_free = 0;
+  return true;
+  }
+
+/**
+ * canframepool::Alloc -- get a free slot with reference count 1
+ *    - returns NULL if the pool is exhausted
+ */
+CAN_frame_t* canframepool::Alloc()
+  {
+  slot_t* slot = NULL;
+  portENTER_CRITICAL(&m_mux);
+  if (m_free >= 0)
+    {
+    slot = &m_slots[m_free];
+    m_free = slot->next;
+    slot->refcnt = 1;
+    if (++m_used > m_hwm)
+      m_hwm = m_used;
+    }
+  else
+    {
+    m_allocfail++;
+    }
+  portEXIT_CRITICAL(&m_mux);
+  return slot ? &slot->frame : NULL;
+  }
+
+/**
+ * canframepool::Ref -- get a reference on a frame
+ *    - pooled frames get their reference count incremented
+ *    - other frames are copied into a new slot
+ *    - rx: keep the reception time of the copy, else time is cleared
+ *      (i.e. TX frames built on the stack may carry garbage)
+ *    - returns NULL if the pool is exhausted
+ */
+CAN_frame_t* canframepool::Ref(const CAN_frame_t* frame, bool rx)
+  {
+  if (IsPooled(frame))
+    {
+    Retain((CAN_frame_t*)frame);
+    return (CAN_frame_t*)frame;
+    }
+  CAN_frame_t* copy = Alloc();
+  if (copy)
+    {
+    *copy = *frame;
+    if (!rx)
+      copy->time = 0;
+    }
+  return copy;
+  }
+
+void canframepool::Retain(CAN_frame_t* frame)
+  {
+  slot_t* slot = (slot_t*)frame;
+  portENTER_CRITICAL(&m_mux);
+  slot->refcnt++;
+  portEXIT_CRITICAL(&m_mux);
+  }
+
+void canframepool::Release(CAN_frame_t* frame)
+  {
+  if (!IsPooled(frame))
+    return;
+  slot_t* slot = (slot_t*)frame;
+  portENTER_CRITICAL(&m_mux);
+  if (--slot->refcnt == 0)
+    {
+    slot->next = m_free;
+    m_free = slot - m_slots;
+    m_used--;
+    }
+  portEXIT_CRITICAL(&m_mux);
+  }
+
+/**
+ * canlatency: RX latency histogram
+ */
+
+canlatency::canlatency()
+  {
+  m_mux = portMUX_INITIALIZER_UNLOCKED;
+  Clear();
+  }
+
+void canlatency::Clear()
+  {
+  portENTER_CRITICAL(&m_mux);
+  memset(m_count, 0, sizeof(m_count));
+  m_n = 0;
+  m_max = 0;
+  m_sum = 0;
+  m_period_n = 0;
+  m_period_max = 0;
+  m_period_sum = 0;
+  portEXIT_CRITICAL(&m_mux);
+  }
+
+uint32_t canlatency::GetBucketLimit(int bucket)
+  {
+  static const uint32_t limit[CAN_LATENCY_BUCKETS] =
+    { 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 100000, UINT32_MAX };
+  return limit[bucket];
+  }
+
+void canlatency::Add(uint32_t us)
+  {
+  int bucket = 0;
+  while (bucket < CAN_LATENCY_BUCKETS-1 && us > GetBucketLimit(bucket))
+    bucket++;
+  portENTER_CRITICAL(&m_mux);
+  m_count[bucket]++;
+  m_n++;
+  m_sum += us;
+  if (us > m_max)
+    m_max = us;
+  m_period_n++;
+  m_period_sum += us;
+  if (us > m_period_max)
+    m_period_max = us;
+  portEXIT_CRITICAL(&m_mux);
+  }
+
+/**
+ * canlatency::TakePeriod -- get & reset period average & maximum [us]
+ */
+void canlatency::TakePeriod(uint32_t& avg, uint32_t& max)
+  {
+  portENTER_CRITICAL(&m_mux);
+  avg = m_period_n ? (uint32_t)(m_period_sum / m_period_n) : 0;
+  max = m_period_max;
+  m_period_n = 0;
+  m_period_max = 0;
+  m_period_sum = 0;
+  portEXIT_CRITICAL(&m_mux);
+  }
+
+/**
+ * canidtable: per ID traffic statistics
+ */
+
+canidtable::canidtable(uint32_t size)
+  {
+  m_entries = (CAN_idstat_t*) calloc(size, sizeof(CAN_idstat_t));
+  if (!m_entries)
+    {
+    ESP_LOGE(TAG, "canidtable: cannot allocate %u entries", size);
+    size = 0;
+    }
+  m_size = size;
+  m_mask = size ? size - 1 : 0;
+  m_used = 0;
+  m_overflow = 0;
+  }
+
+canidtable::~canidtable()
+  {
+  if (m_entries)
+    free(m_entries);
+  }
+
+/**
+ * canidtable::Count -- account a received frame
+ */
+void canidtable::Count(const CAN_frame_t* p_frame)
+  {
+  int64_t time = p_frame->time;
+  if (!m_size)
+    return;
+  uint32_t key = p_frame->MsgID;
+  if (p_frame->FIR.B.FF == CAN_frame_ext)
+    key |= CAN_IDKEY_EXT;
+
+  // Fibonacci hashing, linear probing:
+  uint32_t slot = (key * 2654435761u) & m_mask;
+  CAN_idstat_t* e;
+  while (true)
+    {
+    e = &m_entries[slot];
+    if (e->count == 0)
+      {
+      if (m_used >= GetCapacity())
+        {
+        m_overflow++;
+        return;
+        }
+      m_used++;
+      e->key = key;
+      e->count = 1;
+      e->first = e->last = time;
+      e->period_min = UINT32_MAX;
+      e->period_max = 0;
+      e->dlc = p_frame->FIR.B.DLC;
+      return;
+      }
+    if (e->key == key)
+      break;
+    slot = (slot + 1) & m_mask;
+    }
+
+  uint32_t period = (time > e->last) ? (uint32_t)(time - e->last) : 0;
+  if (period < e->period_min)
+    e->period_min = period;
+  if (period > e->period_max)
+    e->period_max = period;
+  e->count++;
+  e->last = time;
+  e->dlc = p_frame->FIR.B.DLC;
+  }
+
+void canidtable::GetEntries(std::vector<CAN_idstat_t>& result) const
+  {
+  for (uint32_t i = 0; i < m_size; i++)
+    {
+    if (m_entries[i].count)
+      result.push_back(m_entries[i]);
+    }
+  }
+
+/**
+ * canrxring: ISR to CanRxTask frame ring
+ */
+
+canrxring::canrxring()
+  {
+  m_buf = NULL;
+  m_size = 0;
+  m_mask = 0;
+  m_head = 0;
+  m_tail = 0;
+  m_signalled = false;
+  ClearStats();
+  }
+
+canrxring::~canrxring()
+  {
+  if (m_buf)
+    free(m_buf);
+  }
+
+/**
+ * canrxring::Init -- allocate ring buffer
+ *    - size must be a power of 2
+ *    - must be called before the producer is enabled
+ */
+bool canrxring::Init(uint32_t size)
+  {
+  if (m_buf || size == 0 || (size & (size-1)) != 0)
+    return false;
+  m_buf = (CAN_frame_t*) calloc(size, sizeof(CAN_frame_t));
+  if (!m_buf)
+    {
+    ESP_LOGE(TAG, "canrxring: cannot allocate %u frames", size);
+    return false;
+    }
+  m_size = size;
+  m_mask = size - 1;
+  m_head = m_tail = 0;
+  return true;
+  }
+
+void canrxring::ClearStats()
+  {
+  m_hwm = 0;
+  m_overflow = 0;
+  }
+
 /**
  * CAN_frame_t::Write -- main TX API
  *    - returns ESP_OK, ESP_QUEUED or ESP_FAIL
@@ -575,22 +2103,42 @@ esp_err_t CAN_frame_t::Write(canbus* bus /*=NULL*/, TickType_t maxqueuewait /*=0
  * Tracing/logging
  */
 
+/**
+ * can::LogFrame -- fan out a frame to all loggers
+ *    - the first logger taking the frame creates a pool copy, all others
+ *      get references to it, so the payload is copied once at most
+ */
 void can::LogFrame(canbus* bus, CAN_LogEntry_t type, const CAN_frame_t* frame)
   {
-  if (m_logger)
-    m_logger->LogFrame(bus, type, frame);
+  if (m_logcount == 0)
+    return;
+  CAN_frame_t* shared = NULL;
+  xSemaphoreTake(m_loggers_mutex, portMAX_DELAY);
+  for (canlog* logger : m_loggers)
+    logger->LogFrame(bus, type, frame, shared);
+  xSemaphoreGive(m_loggers_mutex);
+  if (shared)
+    m_framepool.Release(shared);
   }
 
 void can::LogStatus(canbus* bus, CAN_LogEntry_t type, const CAN_status_t* status)
   {
-  if (m_logger)
-    m_logger->LogStatus(bus, type, status);
+  if (m_logcount == 0)
+    return;
+  xSemaphoreTake(m_loggers_mutex, portMAX_DELAY);
+  for (canlog* logger : m_loggers)
+    logger->LogStatus(bus, type, status);
+  xSemaphoreGive(m_loggers_mutex);
   }
 
 void can::LogInfo(canbus* bus, CAN_LogEntry_t type, const char* text)
   {
-  if (m_logger)
-    m_logger->LogInfo(bus, type, text);
+  if (m_logcount == 0)
+    return;
+  xSemaphoreTake(m_loggers_mutex, portMAX_DELAY);
+  for (canlog* logger : m_loggers)
+    logger->LogInfo(bus, type, text);
+  xSemaphoreGive(m_loggers_mutex);
   }
 
 
@@ -601,7 +2149,7 @@ void canbus::LogFrame(CAN_LogEntry_t type, const CAN_frame_t* frame)
 
 void canbus::LogStatus(CAN_LogEntry_t type)
   {
-  if (!MyCan.GetLogger() || (type==CAN_LogStatus_Error && !StatusChanged()))
+  if (!MyCan.HasLoggers() || (type==CAN_LogStatus_Error && !StatusChanged()))
     return;
   MyCan.LogStatus(this, type, &m_status);
   }
@@ -39,8 +39,13 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/timers.h"
 #include <stdint.h>
+#include <string>
 #include <list>
+#include <vector>
+#include <type_traits>
 #include "pcp.h"
 #include <esp_err.h>
 
@@ -48,6 +53,13 @@
 #define ESP_QUEUED           1    // frame has been queued for later processing
 #endif
 
+#define CAN_RXRING_SIZE      256  // RX ring buffer size for ISR based drivers (frames, power of 2)
+#define CAN_FRAMEPOOL_SIZE   160  // Frame pool size (frames in transit to listeners & loggers)
+#define CAN_FRAMEPOOL_RESERVE 24  // Pool slots kept out of consumer quotas (CanRxTask queue & dispatch)
+#define CAN_LATENCY_BUCKETS  10   // RX latency histogram size
+#define CAN_IDTABLE_SIZE     256  // Per ID statistics default capacity (IDs)
+#define CAN_IDTABLE_MAXSIZE  2048 // Per ID statistics max table size (slots, power of 2)
+
 
 class canbus; // Forward definition
 
@@ -108,6 +120,7 @@ struct CAN_frame_t
     uint8_t   u8[8];                    // Payload byte access
     uint32_t  u32[2];                   // Payload u32 access (Att: little endian!)
     } data;
+  int64_t     time;                     // RX: reception time [us since boot], 0 = unknown
   
   esp_err_t Write(canbus* bus=NULL, TickType_t maxqueuewait=0);  // bus: NULL=origin
   };
@@ -155,13 +168,330 @@ class canbitset
   };
 
 
+/**
+ * cansignal / cansignals<...>: compile time multi-signal extraction
+ *  Signal descriptors are template arguments, so all shifts are constants
+ *  and all signals of a frame are extracted from a single load. The store
+ *  type is chosen automatically: uint32_t if the bit span covered by the
+ *  signals fits into 32 bits, else uint64_t. Only the bytes covering the
+ *  span are loaded.
+ *  Usage example (Twizy 0x556, five 12 bit cell voltages):
+ *    typedef cansignals< cansignal<0,12>, cansignal<12,12>, cansignal<24,12>,
+ *      cansignal<36,12>, cansignal<48,12> > twizy_cells_t;
+ *    twizy_cells_t cells(p_frame->data.u8);
+ *    volt = cells[2];
+ *  Bit positions are compatible to canbitset: 0=MSB of first msg byte.
+ *  Values are returned as the signed store type; unsigned 32 bit fields
+ *  need to be cast back to uint32_t.
+ */
+template <int Start, int Length, bool Signed=false>
+struct cansignal
+  {
+  static_assert(Length > 0 && Start >= 0 && Start + Length <= 64, "cansignal: invalid bit range");
+  static constexpr int start = Start;
+  static constexpr int length = Length;
+  static constexpr int end = Start + Length;
+  static constexpr bool is_signed = Signed;
+
+  // extract from store, span beginning at bit 'base':
+  template <typename StoreType, typename ValueType, int Base>
+  static inline ValueType get(StoreType store)
+    {
+    return is_signed
+      ? (ValueType) (((ValueType) (store << (Start - Base))) >> ((sizeof(StoreType)<<3) - Length))
+      : (ValueType) ((store << (Start - Base)) >> ((sizeof(StoreType)<<3) - Length));
+    }
+  };
+
+// Bit span of a signal list:
+template <typename... Signals> struct cansignals_span;
+template <> struct cansignals_span<>
+  {
+  static constexpr int first = 64;
+  static constexpr int end = 0;
+  };
+template <typename Signal, typename... Signals> struct cansignals_span<Signal, Signals...>
+  {
+  static constexpr int first = (Signal::start < cansignals_span<Signals...>::first)
+    ? Signal::start : cansignals_span<Signals...>::first;
+  static constexpr int end = (Signal::end > cansignals_span<Signals...>::end)
+    ? Signal::end : cansignals_span<Signals...>::end;
+  };
+
+// Store type selection by span size:
+template <bool Fits32> struct cansignals_store
+  {
+  typedef uint64_t type;
+  typedef int64_t value_type;
+  };
+template <> struct cansignals_store<true>
+  {
+  typedef uint32_t type;
+  typedef int32_t value_type;
+  };
+
+template <typename... Signals>
+class cansignals
+  {
+  public:
+    static constexpr int count = sizeof...(Signals);
+    static constexpr int first_byte = cansignals_span<Signals...>::first >> 3;
+    static constexpr int end_byte = (cansignals_span<Signals...>::end + 7) >> 3;
+    static constexpr int bytes = end_byte - first_byte;
+    typedef typename cansignals_store<(bytes <= 4)>::type store_type;
+    typedef typename cansignals_store<(bytes <= 4)>::value_type value_type;
+
+  public:
+    value_type val[count];
+
+  public:
+    cansignals(const uint8_t* src)
+      : cansignals(load(src), 0)
+      {
+      }
+
+    value_type operator[](int i) const
+      {
+      return val[i];
+      }
+
+    // load span bytes left aligned:
+    static inline store_type load(const uint8_t* src)
+      {
+      store_type store = 0;
+      for (int i = first_byte; i < end_byte; i++)
+        store = (store << 8) | src[i];
+      return store << ((sizeof(store_type) - bytes) << 3);
+      }
+
+  private:
+    cansignals(store_type store, int)
+      : val { Signals::template get<store_type, value_type, (first_byte << 3)>(store)... }
+      {
+      }
+  };
+
+
+/**
+ * canrxring: single producer / single consumer CAN frame ring buffer
+ *  The producer (driver ISR) fetches frames directly into the ring slots,
+ *  the consumer (CanRxTask) drains all pending frames in one batch per wakeup.
+ *  Usage (producer):
+ *    CAN_frame_t* frame = ring.PushSlot() -- NULL = ring full
+ *    ...fill frame...
+ *    ring.Push()
+ *  Usage (consumer):
+ *    while ((frame = ring.Front()) != NULL) { ...process frame...; ring.Pop(); }
+ *  Note: no locking, only one producer & one consumer allowed.
+ */
+class canrxring
+  {
+  public:
+    canrxring();
+    ~canrxring();
+
+  public:
+    bool Init(uint32_t size);
+    void ClearStats();
+    uint32_t GetSize() { return m_size; }
+    uint32_t GetUsed() { return m_head - m_tail; }
+
+  public:
+    // Producer side:
+    inline CAN_frame_t* PushSlot()
+      {
+      if (m_head - m_tail >= m_size)
+        {
+        m_overflow++;
+        return NULL;
+        }
+      return &m_buf[m_head & m_mask];
+      }
+    inline void Push()
+      {
+      __sync_synchronize();
+      m_head++;
+      uint32_t used = m_head - m_tail;
+      if (used > m_hwm)
+        m_hwm = used;
+      }
+
+  public:
+    // Consumer side:
+    inline CAN_frame_t* Front()
+      {
+      if (m_tail == m_head)
+        return NULL;
+      __sync_synchronize();
+      return &m_buf[m_tail & m_mask];
+      }
+    inline void Pop()
+      {
+      __sync_synchronize();
+      m_tail++;
+      }
+
+  protected:
+    CAN_frame_t*        m_buf;
+    uint32_t            m_size;
+    uint32_t            m_mask;
+    volatile uint32_t   m_head;         // next slot to write (producer)
+    volatile uint32_t   m_tail;         // next slot to read (consumer)
+
+  public:
+    volatile bool       m_signalled;    // consumer wakeup pending
+    uint32_t            m_hwm;          // high water mark (frames)
+    uint32_t            m_overflow;     // frames lost due to ring full
+  };
+
+
+/**
+ * canfilter: CAN frame subscription filter
+ *  - bus mask: bit (n-1) selects bus "canN", no bus added = all buses
+ *  - standard IDs: 2048 bit bitmap, one lookup per frame
+ *  - extended IDs: sorted list of disjoint ID ranges, binary search
+ *  A filter without ID rules matches all IDs on the selected buses.
+ *  Usage example:
+ *    canfilter* filter = new canfilter();
+ *    filter->AddBus(m_can1);
+ *    filter->AddStandard(0x7e8, 0x7ef);
+ *    filter->AddExtended(0x18daf100, 0x18daf1ff);
+ *  PlanAcceptance() reduces the ID set of one frame format to a limited
+ *  number of code/mask pairs for hardware acceptance filters.
+ */
+typedef struct
+  {
+  uint32_t from;
+  uint32_t to;
+  } CAN_idrange_t;
+
+// CAN ID code/mask pair (mask bit set = ID bit must match code)
+typedef struct
+  {
+  uint32_t code;
+  uint32_t mask;
+  } CAN_idmask_t;
+
+class canfilter
+  {
+  public:
+    canfilter();
+    canfilter(const canfilter& src);
+    canfilter& operator=(const canfilter& src);
+    ~canfilter();
+
+  public:
+    void Clear();
+    void AddBus(int busnumber);
+    void AddBus(canbus* bus);
+    void AddStandard(uint16_t from, uint16_t to);
+    void AddStandard(uint16_t id) { AddStandard(id, id); }
+    void AddExtended(uint32_t from, uint32_t to);
+    void AddExtended(uint32_t id) { AddExtended(id, id); }
+
+  public:
+    void Merge(const canfilter& src);
+    bool HasStandard() const { return (m_stdmap != NULL); }
+    bool HasExtended() const { return !m_extranges.empty(); }
+    bool PlanAcceptance(bool extended, int maxmasks, std::vector<CAN_idmask_t>& result) const;
+
+  protected:
+    bool AllocStandard();
+
+  public:
+    bool MatchBus(const canbus* bus) const;
+    bool MatchExtended(uint32_t id) const;
+    inline bool Match(const CAN_frame_t* frame) const
+      {
+      if (m_busmask && !MatchBus(frame->origin))
+        return false;
+      if (!m_idfilter)
+        return true;
+      if (frame->FIR.B.FF == CAN_frame_std)
+        return (m_stdmap && (m_stdmap[(frame->MsgID & 0x7ff) >> 5] & (1 << (frame->MsgID & 0x1f))));
+      else
+        return MatchExtended(frame->MsgID);
+      }
+
+  public:
+    uint32_t                    m_busmask;    // 0 = all buses
+    bool                        m_idfilter;   // false = all IDs
+    uint32_t*                   m_stdmap;     // 2048 bit std ID bitmap, NULL = no std IDs
+    std::vector<CAN_idrange_t>  m_extranges;  // sorted ext ID ranges
+  };
+
+// CAN listener registration
+typedef struct
+  {
+  QueueHandle_t queue;              // receives frame pool handles (CAN_frame_t*)
+  canfilter* filter;                // NULL = all frames
+  uint32_t dropped;                 // frames lost due to queue full or quota
+  uint32_t quota;                   // max frames queued (frame pool share)
+  } CAN_listener_t;
+
+/**
+ * canframepool: fixed size pool of reference counted CAN frames
+ *  Frames are passed to CAN listeners & loggers as pool handles (CAN_frame_t*)
+ *  instead of copies. Each consumer holds a reference on the frame and
+ *  releases it when done, the slot is freed when the last reference
+ *  has been released.
+ *  Usage:
+ *    CAN_frame_t* frame = pool.Ref(&myframe) -- pooled copy or new reference
+ *    ...pass frame handle via queue...
+ *    pool.Release(frame) -- done with frame
+ *  Note: thread safe, not to be used from ISRs.
+ */
+class canframepool
+  {
+  public:
+    canframepool();
+    ~canframepool();
+
+  public:
+    bool Init(uint32_t size);
+    CAN_frame_t* Alloc();
+    CAN_frame_t* Ref(const CAN_frame_t* frame, bool rx=false);
+    void Retain(CAN_frame_t* frame);
+    void Release(CAN_frame_t* frame);
+    bool IsPooled(const CAN_frame_t* frame) const
+      {
+      return ((const void*)frame >= (const void*)m_slots && (const void*)frame < (const void*)(m_slots + m_size));
+      }
+
+  public:
+    uint32_t GetSize() { return m_size; }
+    uint32_t GetUsed() { return m_used; }
+
+  protected:
+    typedef struct
+      {
+      CAN_frame_t       frame;          // must be first member
+      int32_t           refcnt;
+      int32_t           next;           // free list link, -1 = end
+      } slot_t;
+
+  protected:
+    slot_t*             m_slots;
+    uint32_t            m_size;
+    int32_t             m_free;         // free list head, -1 = empty
+    portMUX_TYPE        m_mux;
+
+  public:
+    uint32_t            m_used;         // slots in use
+    uint32_t            m_hwm;          // high water mark (slots)
+    uint32_t            m_allocfail;    // allocation failures (pool exhausted)
+  };
+
+
 // CAN message type
 typedef enum
   {
   CAN_frame = 0,
   CAN_rxcallback,
   CAN_txcallback,
-  CAN_logerror
+  CAN_logerror,
+  CAN_rxring,
+  CAN_acceptfilter
   } CAN_MSGID_t;
 
 // CAN message
@@ -170,11 +500,44 @@ typedef struct
   CAN_MSGID_t type;
   union
     {
-    CAN_frame_t frame;  // CAN_frame
-    canbus* bus;        // CAN_rxcallback, CAN_txcallback, CAN_logerror
+    CAN_frame_t* frame; // CAN_frame (pool handle)
+    canbus* bus;        // CAN_rxcallback, CAN_txcallback, CAN_logerror, CAN_rxring, CAN_acceptfilter
     } body;
+  int64_t time;         // CAN_rxcallback: interrupt time [us], 0 = unknown
   } CAN_msg_t;
 
+// CAN TX priority class (in scheduling order)
+typedef enum
+  {
+  CAN_TX_CONTROL = 0,               // vehicle control frames
+  CAN_TX_RESPONSE,                  // protocol responses (flow control, ECU replies)
+  CAN_TX_NORMAL,                    // default (i.e. poll requests)
+  CAN_TX_BULK,                      // bulk transfers (i.e. CANopen SDO)
+  CAN_TX_CLASSES
+  } CAN_txclass_t;
+
+// CAN TX queue entry
+typedef struct
+  {
+  CAN_frame_t frame;
+  int64_t queued;                   // time of queueing [us]
+  int64_t deadline;                 // drop if not sent until [us], 0 = no deadline
+  } CAN_txentry_t;
+
+// CAN TX class statistics & rate limit
+typedef struct
+  {
+  uint32_t sent;                    // frames loaded into TX buffers
+  uint32_t delayed;                 // frames routed through the class queue
+  uint32_t dropped;                 // class queue overflows
+  uint32_t expired;                 // frames dropped due to deadline
+  uint64_t latency_sum;             // sum of queue latencies [us]
+  uint32_t latency_max;             // max queue latency [us]
+  uint32_t budget;                  // rate limit [frames per second], 0 = unlimited
+  float tokens;                     // rate limit tokens available
+  int64_t refill;                   // time of last token refill [us]
+  } CAN_txclass_status_t;
+
 // CAN status
 typedef struct
   {
@@ -188,6 +551,102 @@ typedef struct
   uint16_t errors_tx;               // TX error counter
   } CAN_status_t;
 
+// CAN bus load counters (frames, payload bytes, nominal bit times)
+typedef struct
+  {
+  uint32_t frames;
+  uint32_t bytes;
+  uint32_t bits;
+  } CAN_loadcount_t;
+
+// CAN bus load statistics
+typedef struct
+  {
+  CAN_loadcount_t rx;               // running totals (wrapping)
+  CAN_loadcount_t tx;
+  CAN_loadcount_t last;             // rx+tx totals at last update
+  int64_t time;                     // time of last update [us]
+  float fps;                        // frames per second
+  float bps;                        // payload bytes per second
+  float load;                       // bit time utilisation [%]
+  } CAN_load_t;
+
+/**
+ * canlatency: RX latency histogram
+ *  Bucket upper limits see GetBucketLimit(), the last bucket is unlimited.
+ *  The period average & maximum are reset by TakePeriod().
+ *  Note: thread safe, not to be used from ISRs.
+ */
+class canlatency
+  {
+  public:
+    canlatency();
+
+  public:
+    void Clear();
+    void Add(uint32_t us);
+    void TakePeriod(uint32_t& avg, uint32_t& max);
+    static uint32_t GetBucketLimit(int bucket);
+
+  public:
+    uint32_t            m_count[CAN_LATENCY_BUCKETS];
+    uint32_t            m_n;            // total samples
+    uint32_t            m_max;          // total max [us]
+    uint64_t            m_sum;          // total sum [us]
+
+  protected:
+    uint32_t            m_period_n;
+    uint32_t            m_period_max;
+    uint64_t            m_period_sum;
+    portMUX_TYPE        m_mux;
+  };
+
+/**
+ * canidtable: per ID traffic statistics
+ *  Open addressing hash table with linear probing, keyed by frame format
+ *  and ID, so Count() is O(1) per frame. Entries are never removed, new IDs
+ *  are rejected (counted as overflow) when the table is 3/4 full to keep
+ *  probe sequences short.
+ *  Note: not thread safe, see can::SetIdTable() / can::GetIdTable().
+ */
+#define CAN_IDKEY_EXT        0x80000000  // key flag: extended frame
+
+typedef struct
+  {
+  uint32_t key;                     // MsgID | CAN_IDKEY_EXT (if extended)
+  uint32_t count;                   // frames seen, 0 = empty slot
+  int64_t first;                    // first seen [us]
+  int64_t last;                     // last seen [us]
+  uint32_t period_min;              // min period [us]
+  uint32_t period_max;              // max period [us]
+  uint8_t dlc;                      // last DLC
+  } CAN_idstat_t;
+
+class canidtable
+  {
+  public:
+    canidtable(uint32_t size);
+    ~canidtable();
+
+  public:
+    void Count(const CAN_frame_t* p_frame);
+    void GetEntries(std::vector<CAN_idstat_t>& result) const;
+    uint32_t GetSize() const { return m_size; }
+    uint32_t GetCapacity() const { return m_size - (m_size >> 2); }
+    uint32_t GetUsed() const { return m_used; }
+    uint32_t GetOverflow() const { return m_overflow; }
+
+  protected:
+    CAN_idstat_t*       m_entries;
+    uint32_t            m_size;
+    uint32_t            m_mask;
+    uint32_t            m_used;
+    uint32_t            m_overflow;     // frames of IDs rejected due to table full
+  };
+
+class OvmsMetricInt;
+class OvmsMetricFloat;
+
 // Log entry types:
 typedef enum
   {
@@ -205,12 +664,13 @@ typedef enum
 // Log message:
 typedef struct
   {
-  uint32_t timestamp;
+  uint32_t timestamp;                 // [ms since boot]
+  int64_t time;                       // [us since boot], RX frames: reception time
   canbus* bus;
   CAN_LogEntry_t type;
   union
     {
-    CAN_frame_t frame;
+    CAN_frame_t* frame;               // pool handle
     CAN_status_t status;
     char* text;
     };
@@ -230,26 +690,82 @@ class canbus : public pcp
 
   public:
     virtual esp_err_t Write(const CAN_frame_t* p_frame, TickType_t maxqueuewait=0);
+    virtual esp_err_t WriteClass(const CAN_frame_t* p_frame, CAN_txclass_t txclass,
+                                 uint32_t deadline_ms=0, TickType_t maxqueuewait=0);
     virtual esp_err_t WriteExtended(uint32_t id, uint8_t length, uint8_t *data, TickType_t maxqueuewait=0);
     virtual esp_err_t WriteStandard(uint16_t id, uint8_t length, uint8_t *data, TickType_t maxqueuewait=0);
     virtual bool RxCallback(CAN_frame_t* frame);
     virtual void TxCallback();
+
+  public:
+    void SetTxBudget(CAN_txclass_t txclass, uint32_t fps);
+    static const char* GetTxClassName(CAN_txclass_t txclass);
   
   protected:
-    virtual esp_err_t QueueWrite(const CAN_frame_t* p_frame, TickType_t maxqueuewait=0);
+    virtual esp_err_t TxFrame(const CAN_frame_t* p_frame);
+    void TxSchedule();
+    bool TxTokenAvailable(CAN_txclass_t txclass, int64_t now);
+    void TxDone(CAN_txclass_t txclass, const CAN_frame_t* p_frame, int64_t queued, int64_t now);
   
   public:
     void LogFrame(CAN_LogEntry_t type, const CAN_frame_t* p_frame);
     void LogStatus(CAN_LogEntry_t type);
     void LogInfo(CAN_LogEntry_t type, const char* text);
     bool StatusChanged();
+
+  public:
+    void CountRxBatch(uint32_t frames);
+    static uint32_t GetFrameBits(const CAN_frame_t* p_frame);
+    inline void CountLoad(CAN_loadcount_t& cnt, const CAN_frame_t* p_frame)
+      {
+      cnt.frames++;
+      if (!p_frame->FIR.B.RTR)
+        cnt.bytes += p_frame->FIR.B.DLC;
+      cnt.bits += GetFrameBits(p_frame);
+      }
+    void UpdateLoad(int64_t now);
+    void ClearLoad();
+
+  public:
+    void SetAcceptanceFilter(const canfilter* filter);
+    void AcceptanceFilterCallback();
+    virtual esp_err_t ApplyAcceptanceFilter();
   
   public:
     CAN_speed_t m_speed;
     CAN_mode_t m_mode;
     CAN_status_t m_status;
     uint32_t m_status_chksum;
-    QueueHandle_t m_txqueue;
+    QueueHandle_t m_txqueue[CAN_TX_CLASSES];
+    CAN_txclass_status_t m_txclass[CAN_TX_CLASSES];
+    SemaphoreHandle_t m_txmutex;
+    TimerHandle_t m_txtimer;          // rate limit wakeup
+    int m_busnumber;                  // N of "canN", 0 = unnumbered
+    canfilter* m_acceptfilter;        // hardware acceptance plan, NULL = accept all
+    canfilter* m_acceptnext;          // plan to be applied by CanRxTask
+    bool m_acceptpending;             // m_acceptnext valid, CAN_acceptfilter queued
+    SemaphoreHandle_t m_acceptmutex;  // protects m_acceptfilter & m_acceptnext (recursive)
+
+  public:
+    canrxring m_rxring;               // ISR → CanRxTask frame ring (if used by driver)
+    uint32_t m_rxbatch_count;         // number of RX batches processed
+    uint32_t m_rxbatch_frames;        // number of frames processed in batches
+    uint32_t m_rxbatch_max;           // max batch size
+
+  public:
+    canidtable* m_idtable;            // per ID statistics, NULL = disabled
+    CAN_load_t m_load;                // bus load (rx+tx)
+    canlatency m_lat_dispatch;        // ISR → CanRxTask latency
+    canlatency m_lat_listener;        // ISR → listener done latency
+
+  protected:
+    OvmsMetricFloat* m_metric_fps;
+    OvmsMetricInt* m_metric_bps;
+    OvmsMetricFloat* m_metric_load;
+    OvmsMetricInt* m_metric_dispatch_avg;
+    OvmsMetricInt* m_metric_dispatch_max;
+    OvmsMetricInt* m_metric_listener_avg;
+    OvmsMetricInt* m_metric_listener_max;
   };
 
 class can
@@ -260,26 +776,57 @@ class can
 
   public:
     void IncomingFrame(CAN_frame_t* p_frame);
+    void DrainRxRing(canbus* bus);
+
+  public:
+    // Frame pool access for listeners & loggers:
+    CAN_frame_t* RefFrame(const CAN_frame_t* frame) { return m_framepool.Ref(frame); }
+    void ReleaseFrame(CAN_frame_t* frame);
+    void ReleaseLogFrame(CAN_frame_t* frame) { m_framepool.Release(frame); }
   
   public:
     QueueHandle_t m_rxqueue;
+    canframepool m_framepool;
+    uint32_t m_listener_drops;        // frames lost due to listener queues full (all listeners)
 
   public:
-    void RegisterListener(QueueHandle_t queue);
+    void RegisterListener(QueueHandle_t queue, canfilter* filter=NULL);
     void DeregisterListener(QueueHandle_t queue);
+    std::vector<uint32_t> GetListenerDrops();
+    void UpdateFrameQuotas();
 
   public:
-    void SetLogger(canlog* logger) { m_logger = logger; }
-    canlog* GetLogger() { return m_logger; }
-    void UnsetLogger() { m_logger = NULL; }
+    void RegisterBus(canbus* bus);
+    void DeregisterBus(canbus* bus);
+    void UpdateAcceptanceFilters();
+
+  public:
+    bool SetIdTable(canbus* bus, uint32_t size);
+    bool GetIdTable(canbus* bus, std::vector<CAN_idstat_t>& result, uint32_t* overflow=NULL);
+
+  public:
+    void AddLogger(canlog* logger);
+    void RemoveLogger(canlog* logger);
+    std::list<canlog*> GetLoggers();
+    bool HasLoggers() { return (m_logcount != 0); }
+    // Lock out log calls (i.e. to replace logger state used by them):
+    void LockLoggers() { xSemaphoreTake(m_loggers_mutex, portMAX_DELAY); }
+    void UnlockLoggers() { xSemaphoreGive(m_loggers_mutex); }
     void LogFrame(canbus* bus, CAN_LogEntry_t type, const CAN_frame_t* frame);
     void LogStatus(canbus* bus, CAN_LogEntry_t type, const CAN_status_t* status);
     void LogInfo(canbus* bus, CAN_LogEntry_t type, const char* text);
+
+  public:
+    void EventListener(std::string event, void* data);
   
   private:
-    std::list<QueueHandle_t> m_listeners;
+    std::list<CAN_listener_t> m_listeners;
+    SemaphoreHandle_t m_listeners_mutex;
+    std::list<canbus*> m_buses;
     TaskHandle_t m_rxtask;            // Task to handle reception
-    canlog* m_logger;
+    std::list<canlog*> m_loggers;
+    SemaphoreHandle_t m_loggers_mutex;
+    volatile uint32_t m_logcount;     // lock free check for active loggers
   };
 
 extern can MyCan;
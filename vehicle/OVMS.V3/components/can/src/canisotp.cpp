@@ -0,0 +1,489 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          18th October 2026
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+#include "ovms_log.h"
+static const char *TAG = "isotp";
+
+#include <string.h>
+#include <algorithm>
+#include "esp_timer.h"
+#include "canisotp.h"
+
+#define ISOTP_FT_SINGLE           0
+#define ISOTP_FT_FIRST            1
+#define ISOTP_FT_CONSECUTIVE      2
+#define ISOTP_FT_FLOWCONTROL      3
+
+#define ISOTP_FC_CTS              0
+#define ISOTP_FC_WAIT             1
+#define ISOTP_FC_OVERFLOW         2
+
+canisotp_session::canisotp_session(canbus* bus, uint32_t txid, uint32_t rxid)
+  {
+  m_bs = ISOTP_DEFAULT_BS;
+  m_stmin = ISOTP_DEFAULT_STMIN;
+  m_timeout = ISOTP_DEFAULT_TIMEOUT;
+  m_padding = 0;
+  m_txclass = CAN_TX_NORMAL;
+  m_rxcb = NULL;
+  m_errcb = NULL;
+
+  m_bus = bus;
+  m_txid = txid;
+  m_rxid = rxid;
+  m_ext = (txid > 0x7ff || rxid > 0x7ff);
+
+  m_rxlen = 0;
+  m_rxpos = 0;
+  m_rxframe = 0;
+  m_rxsn = 0;
+  m_rxbs = 0;
+  m_rxtime = 0;
+  m_rxdeadline = 0;
+
+  m_txstate = TxIdle;
+  m_txpos = 0;
+  m_txsn = 0;
+  m_txbs = 0;
+  m_txblock = 0;
+  m_txstmin = 0;
+  m_txnext = 0;
+  m_txdeadline = 0;
+  }
+
+canisotp::canisotp()
+  {
+  m_mutex = xSemaphoreCreateRecursiveMutex();
+  m_next = 0;
+  m_bs = ISOTP_DEFAULT_BS;
+  m_stmin = ISOTP_DEFAULT_STMIN;
+  }
+
+canisotp::~canisotp()
+  {
+  CloseAll();
+  vSemaphoreDelete(m_mutex);
+  }
+
+/**
+ * Open: get session for (bus, txid, rxid), create if necessary
+ *  Callbacks given replace those of an existing session.
+ */
+canisotp_session* canisotp::Open(canbus* bus, uint32_t txid, uint32_t rxid,
+  canisotp_rxcb_t rxcb, canisotp_errcb_t errcb)
+  {
+  xSemaphoreTakeRecursive(m_mutex, portMAX_DELAY);
+  canisotp_session* s = Find(bus, txid, rxid);
+  if (!s)
+    {
+    s = new canisotp_session(bus, txid, rxid);
+    s->m_bs = m_bs;
+    s->m_stmin = m_stmin;
+    m_sessions.push_back(s);
+    }
+  if (rxcb) s->m_rxcb = rxcb;
+  if (errcb) s->m_errcb = errcb;
+  xSemaphoreGiveRecursive(m_mutex);
+  return s;
+  }
+
+canisotp_session* canisotp::Find(canbus* bus, uint32_t txid, uint32_t rxid)
+  {
+  canisotp_session* found = NULL;
+  xSemaphoreTakeRecursive(m_mutex, portMAX_DELAY);
+  for (canisotp_session* s : m_sessions)
+    {
+    if (s->m_bus == bus && s->m_txid == txid && s->m_rxid == rxid)
+      {
+      found = s;
+      break;
+      }
+    }
+  xSemaphoreGiveRecursive(m_mutex);
+  return found;
+  }
+
+/**
+ * Close: remove session
+ *  Note: must not be called from a session callback.
+ */
+void canisotp::Close(canisotp_session* session)
+  {
+  xSemaphoreTakeRecursive(m_mutex, portMAX_DELAY);
+  auto it = std::find(m_sessions.begin(), m_sessions.end(), session);
+  if (it != m_sessions.end())
+    {
+    m_sessions.erase(it);
+    delete session;
+    }
+  xSemaphoreGiveRecursive(m_mutex);
+  }
+
+void canisotp::CloseAll(canbus* bus)
+  {
+  xSemaphoreTakeRecursive(m_mutex, portMAX_DELAY);
+  for (auto it = m_sessions.begin(); it != m_sessions.end(); )
+    {
+    if (bus == NULL || (*it)->m_bus == bus)
+      {
+      delete *it;
+      it = m_sessions.erase(it);
+      }
+    else
+      ++it;
+    }
+  xSemaphoreGiveRecursive(m_mutex);
+  }
+
+/**
+ * SetFlowControl: set FC parameters for sessions opened from now on
+ *  Open sessions keep their parameters, as a reception may be in progress.
+ */
+void canisotp::SetFlowControl(uint8_t bs, uint8_t stmin)
+  {
+  xSemaphoreTakeRecursive(m_mutex, portMAX_DELAY);
+  m_bs = bs;
+  m_stmin = stmin;
+  xSemaphoreGiveRecursive(m_mutex);
+  }
+
+/**
+ * SetFlowControl: set FC parameters of a session
+ *  Should be called by the owner while the session is not receiving.
+ */
+void canisotp::SetFlowControl(canisotp_session* s, uint8_t bs, uint8_t stmin)
+  {
+  xSemaphoreTakeRecursive(m_mutex, portMAX_DELAY);
+  s->m_bs = bs;
+  s->m_stmin = stmin;
+  xSemaphoreGiveRecursive(m_mutex);
+  }
+
+/**
+ * DecodeSTmin: STmin byte → microseconds
+ */
+uint32_t canisotp::DecodeSTmin(uint8_t stmin)
+  {
+  if (stmin <= 0x7f)
+    return (uint32_t)stmin * 1000;
+  else if (stmin >= 0xf1 && stmin <= 0xf9)
+    return (uint32_t)(stmin - 0xf0) * 100;
+  else
+    return 127000; // reserved: use max
+  }
+
+canisotp_error_t canisotp::WriteFrame(canisotp_session* s, CAN_txclass_t txclass, const uint8_t* data, uint8_t length)
+  {
+  CAN_frame_t frame;
+  memset(&frame, 0, sizeof(frame));
+  frame.origin = s->m_bus;
+  frame.FIR.B.FF = s->m_ext ? CAN_frame_ext : CAN_frame_std;
+  frame.FIR.B.DLC = 8;
+  frame.MsgID = s->m_txid;
+  memcpy(frame.data.u8, data, length);
+  if (length < 8)
+    memset(frame.data.u8 + length, s->m_padding, 8 - length);
+  // don't wait for TX queue space (called from the owner's RX context),
+  // queued frames are dropped if not sent within the session timeout:
+  if (s->m_bus->WriteClass(&frame, txclass, s->m_timeout, 0) == ESP_FAIL)
+    return ISOTP_ERR_TX;
+  return ISOTP_OK;
+  }
+
+void canisotp::SendFlowControl(canisotp_session* s, uint8_t status)
+  {
+  uint8_t fc[3] = { (uint8_t)((ISOTP_FT_FLOWCONTROL << 4) | status), s->m_bs, s->m_stmin };
+  WriteFrame(s, CAN_TX_RESPONSE, fc, 3);
+  s->m_rxbs = s->m_bs;
+  }
+
+/**
+ * SendConsecutive: send the due CFs of a session in TxSending state
+ *  Called on FC reception & by CheckTimeouts(). CFs are paced by the peer's
+ *  STmin via m_txnext, the caller's task is never delayed; the owner wakes
+ *  up for the next CF by GetNextTimeout(). (STmin values below the tick
+ *  period result in one CF per owner wakeup.) A full TX queue is retried
+ *  with the next tick until the session timeout.
+ */
+void canisotp::SendConsecutive(canisotp_session* s, int64_t now)
+  {
+  uint8_t data[8];
+  while (s->m_txstate == canisotp_session::TxSending && now >= s->m_txnext)
+    {
+    uint16_t n = std::min((size_t)7, s->m_txbuf.size() - s->m_txpos);
+    data[0] = (ISOTP_FT_CONSECUTIVE << 4) | s->m_txsn;
+    memcpy(data+1, s->m_txbuf.data() + s->m_txpos, n);
+    if (WriteFrame(s, s->m_txclass, data, n+1) != ISOTP_OK)
+      {
+      if (now > s->m_txdeadline)
+        Abort(s, ISOTP_ERR_TX);
+      else
+        SetDeadline(s->m_txnext, now + portTICK_PERIOD_MS * 1000);
+      return;
+      }
+    s->m_txpos += n;
+    s->m_txsn = (s->m_txsn + 1) & 0x0f;
+    if (s->m_txpos >= s->m_txbuf.size())
+      {
+      s->m_txstate = canisotp_session::TxIdle;
+      s->m_txbuf.clear();
+      return;
+      }
+    if (s->m_txbs > 0 && --s->m_txblock == 0)
+      {
+      // wait for next FC:
+      s->m_txstate = canisotp_session::TxWaitFC;
+      SetDeadline(s->m_txdeadline, now + (int64_t)s->m_timeout * 1000);
+      return;
+      }
+    s->m_txdeadline = now + (int64_t)s->m_timeout * 1000;
+    if (s->m_txstmin)
+      SetDeadline(s->m_txnext, now + s->m_txstmin);
+    }
+  }
+
+void canisotp::Abort(canisotp_session* s, canisotp_error_t error)
+  {
+  ESP_LOGD(TAG, "Session %03x/%03x: error %d", s->m_txid, s->m_rxid, error);
+  if (error == ISOTP_ERR_TIMEOUT_CF || error == ISOTP_ERR_SEQUENCE)
+    {
+    s->m_rxlen = 0;
+    }
+  else
+    {
+    s->m_txstate = canisotp_session::TxIdle;
+    s->m_txbuf.clear();
+    }
+  if (s->m_errcb)
+    s->m_errcb(s, error);
+  }
+
+/**
+ * Send: transmit message
+ *  Messages up to 7 bytes are sent as a SF, longer messages as a FF,
+ *  the CFs follow on FC reception (see IncomingFrame()).
+ */
+canisotp_error_t canisotp::Send(canisotp_session* session, const uint8_t* data, uint16_t length)
+  {
+  uint8_t frame[8];
+  canisotp_error_t res;
+
+  if (length == 0 || length > ISOTP_MAXLEN || (length > 7 && session->m_rxid == 0))
+    return ISOTP_ERR_LENGTH;
+
+  xSemaphoreTakeRecursive(m_mutex, portMAX_DELAY);
+  if (session->m_txstate == canisotp_session::TxWaitFC && esp_timer_get_time() > session->m_txdeadline)
+    Abort(session, ISOTP_ERR_TIMEOUT_FC);
+  if (session->m_txstate != canisotp_session::TxIdle)
+    {
+    xSemaphoreGiveRecursive(m_mutex);
+    return ISOTP_ERR_BUSY;
+    }
+  if (length <= 7)
+    {
+    frame[0] = (ISOTP_FT_SINGLE << 4) | length;
+    memcpy(frame+1, data, length);
+    res = WriteFrame(session, session->m_txclass, frame, length+1);
+    }
+  else
+    {
+    frame[0] = (ISOTP_FT_FIRST << 4) | (length >> 8);
+    frame[1] = length & 0xff;
+    memcpy(frame+2, data, 6);
+    session->m_txbuf.assign((const char*)data, length);
+    session->m_txpos = 6;
+    session->m_txsn = 1;
+    session->m_txstate = canisotp_session::TxWaitFC;
+    SetDeadline(session->m_txdeadline, esp_timer_get_time() + (int64_t)session->m_timeout * 1000);
+    res = WriteFrame(session, session->m_txclass, frame, 8);
+    if (res != ISOTP_OK)
+      {
+      session->m_txstate = canisotp_session::TxIdle;
+      session->m_txbuf.clear();
+      }
+    }
+  xSemaphoreGiveRecursive(m_mutex);
+  return res;
+  }
+
+/**
+ * IncomingFrame: process received frame
+ *  Returns true if the frame has been consumed by a session.
+ *  Sessions without a receive callback only consume FC frames.
+ */
+bool canisotp::IncomingFrame(CAN_frame_t* frame)
+  {
+  bool consumed = false;
+  uint8_t* d = frame->data.u8;
+  uint8_t type = d[0] >> 4;
+  bool ext = (frame->FIR.B.FF == CAN_frame_ext);
+
+  xSemaphoreTakeRecursive(m_mutex, portMAX_DELAY);
+  for (canisotp_session* s : m_sessions)
+    {
+    if (s->m_bus != frame->origin || s->m_rxid != frame->MsgID || s->m_rxid == 0 || s->m_ext != ext)
+      continue;
+    if (type != ISOTP_FT_FLOWCONTROL && !s->m_rxcb)
+      continue;
+
+    consumed = true;
+    int64_t now = frame->time ? frame->time : esp_timer_get_time();
+    switch (type)
+      {
+      case ISOTP_FT_SINGLE:
+        {
+        uint8_t len = d[0] & 0x0f;
+        if (len == 0 || len > 7 || len >= frame->FIR.B.DLC)
+          break;
+        s->m_rxlen = 0;
+        s->m_rxframe = 0;
+        s->m_rxtime = now;
+        s->m_rxcb(s, 0, d+1, len, 0);
+        }
+        break;
+
+      case ISOTP_FT_FIRST:
+        {
+        uint16_t len = ((uint16_t)(d[0] & 0x0f) << 8) | d[1];
+        if (len < 8 || frame->FIR.B.DLC < 8)
+          break;
+        s->m_rxlen = len;
+        s->m_rxpos = 6;
+        s->m_rxframe = 0;
+        s->m_rxsn = 1;
+        s->m_rxtime = now;
+        SetDeadline(s->m_rxdeadline, now + (int64_t)s->m_timeout * 1000);
+        SendFlowControl(s, ISOTP_FC_CTS);
+        s->m_rxcb(s, 0, d+2, 6, len - 6);
+        }
+        break;
+
+      case ISOTP_FT_CONSECUTIVE:
+        {
+        if (s->m_rxlen == 0)
+          break;
+        if ((d[0] & 0x0f) != s->m_rxsn)
+          {
+          ESP_LOGD(TAG, "Session %03x/%03x: sequence error: got %d, expected %d",
+            s->m_txid, s->m_rxid, d[0] & 0x0f, s->m_rxsn);
+          Abort(s, ISOTP_ERR_SEQUENCE);
+          break;
+          }
+        uint16_t n = std::min(7, s->m_rxlen - s->m_rxpos);
+        s->m_rxpos += n;
+        s->m_rxsn = (s->m_rxsn + 1) & 0x0f;
+        s->m_rxframe++;
+        s->m_rxtime = now;
+        SetDeadline(s->m_rxdeadline, now + (int64_t)s->m_timeout * 1000);
+        uint16_t remain = s->m_rxlen - s->m_rxpos;
+        if (remain == 0)
+          s->m_rxlen = 0;
+        else if (s->m_bs > 0 && --s->m_rxbs == 0)
+          SendFlowControl(s, ISOTP_FC_CTS);
+        s->m_rxcb(s, s->m_rxframe, d+1, n, remain);
+        }
+        break;
+
+      case ISOTP_FT_FLOWCONTROL:
+        if (s->m_txstate != canisotp_session::TxWaitFC)
+          break;
+        switch (d[0] & 0x0f)
+          {
+          case ISOTP_FC_CTS:
+            {
+            int64_t txnow = esp_timer_get_time();
+            s->m_txstate = canisotp_session::TxSending;
+            s->m_txbs = s->m_txblock = d[1];
+            s->m_txstmin = DecodeSTmin(d[2]);
+            s->m_txnext = txnow;
+            s->m_txdeadline = txnow + (int64_t)s->m_timeout * 1000;
+            SendConsecutive(s, txnow);
+            }
+            break;
+          case ISOTP_FC_WAIT:
+            SetDeadline(s->m_txdeadline, esp_timer_get_time() + (int64_t)s->m_timeout * 1000);
+            break;
+          default:
+            Abort(s, ISOTP_ERR_OVERFLOW);
+            break;
+          }
+        break;
+
+      default:
+        consumed = false;
+        break;
+      }
+    break;
+    }
+  xSemaphoreGiveRecursive(m_mutex);
+  return consumed;
+  }
+
+/**
+ * SetDeadline: set a session deadline, update the engine's next timeout
+ *  (to be called with m_mutex held)
+ */
+void canisotp::SetDeadline(int64_t& deadline, int64_t time)
+  {
+  deadline = time;
+  if (m_next == 0 || time < m_next)
+    m_next = time;
+  }
+
+/**
+ * CheckTimeouts: abort sessions waiting too long for FC / CF,
+ *  send due CFs of running transmissions
+ *  The owner should call this when GetNextTimeout() has been reached.
+ */
+void canisotp::CheckTimeouts()
+  {
+  int64_t now = esp_timer_get_time();
+  int64_t next = 0;
+  xSemaphoreTakeRecursive(m_mutex, portMAX_DELAY);
+  m_next = 0;
+  for (canisotp_session* s : m_sessions)
+    {
+    if (s->m_rxlen && now > s->m_rxdeadline)
+      Abort(s, ISOTP_ERR_TIMEOUT_CF);
+    if (s->m_txstate == canisotp_session::TxWaitFC && now > s->m_txdeadline)
+      Abort(s, ISOTP_ERR_TIMEOUT_FC);
+    if (s->m_txstate == canisotp_session::TxSending)
+      SendConsecutive(s, now);
+    if (s->m_rxlen && (next == 0 || s->m_rxdeadline < next))
+      next = s->m_rxdeadline;
+    if (s->m_txstate == canisotp_session::TxWaitFC && (next == 0 || s->m_txdeadline < next))
+      next = s->m_txdeadline;
+    if (s->m_txstate == canisotp_session::TxSending && (next == 0 || s->m_txnext < next))
+      next = s->m_txnext;
+    }
+  if (next && (m_next == 0 || next < m_next))
+    m_next = next;
+  xSemaphoreGiveRecursive(m_mutex);
+  }
@@ -0,0 +1,178 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          18th October 2026
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+#ifndef __CANISOTP_H__
+#define __CANISOTP_H__
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <functional>
+#include "can.h"
+
+#define ISOTP_MAXLEN              4095      // max message length (12 bit FF length)
+
+#define ISOTP_DEFAULT_BS          0         // block size: send all frames without further FC
+#define ISOTP_DEFAULT_STMIN       25        // separation time [ms] (legacy poller default)
+#define ISOTP_DEFAULT_TIMEOUT     1000      // N_Bs / N_Cr timeout [ms]
+
+typedef enum
+  {
+  ISOTP_OK = 0,
+  ISOTP_ERR_TIMEOUT_FC,                     // no flow control received (N_Bs)
+  ISOTP_ERR_TIMEOUT_CF,                     // no consecutive frame received (N_Cr)
+  ISOTP_ERR_SEQUENCE,                       // wrong consecutive frame sequence number
+  ISOTP_ERR_OVERFLOW,                       // receiver signalled overflow
+  ISOTP_ERR_LENGTH,                         // invalid message length
+  ISOTP_ERR_BUSY,                           // transmission in progress
+  ISOTP_ERR_TX,                             // CAN write failed
+  } canisotp_error_t;
+
+class canisotp_session;
+
+// Receive data callback, called for every SF / FF / CF received:
+//  frame = index of frame in message (0 = SF/FF), remain = bytes still expected
+typedef std::function<void(canisotp_session* session, uint16_t frame,
+  uint8_t* data, uint16_t length, uint16_t remain)> canisotp_rxcb_t;
+typedef std::function<void(canisotp_session* session, canisotp_error_t error)> canisotp_errcb_t;
+
+/**
+ * canisotp_session: one ISO-TP connection (bus, txid, rxid)
+ *  Flow control parameters (m_bs, m_stmin) are sent to the peer when
+ *  receiving a multi frame message; STmin uses the ISO encoding
+ *  (0x00-0x7F = ms, 0xF1-0xF9 = 100-900 us).
+ */
+class canisotp_session
+  {
+  friend class canisotp;
+
+  public:
+    canisotp_session(canbus* bus, uint32_t txid, uint32_t rxid);
+
+  public:
+    canbus* GetBus() { return m_bus; }
+    uint32_t GetTxId() { return m_txid; }
+    uint32_t GetRxId() { return m_rxid; }
+    int64_t GetRxTime() { return m_rxtime; }
+    bool IsReceiving() { return m_rxlen != 0; }
+    bool IsSending() { return m_txstate != TxIdle; }
+
+  public:
+    uint8_t             m_bs;               // block size sent in FC
+    uint8_t             m_stmin;            // STmin sent in FC
+    uint16_t            m_timeout;          // N_Bs / N_Cr timeout [ms]
+    uint8_t             m_padding;          // frame fill byte
+    CAN_txclass_t       m_txclass;          // TX class for SF / FF / CF
+    canisotp_rxcb_t     m_rxcb;             // NULL = only use for transmission
+    canisotp_errcb_t    m_errcb;
+
+  protected:
+    typedef enum { TxIdle, TxWaitFC, TxSending } txstate_t;
+
+    canbus*             m_bus;
+    uint32_t            m_txid;
+    uint32_t            m_rxid;             // 0 = transmit only (functional addressing)
+    bool                m_ext;              // 29 bit IDs
+
+    // reception:
+    uint16_t            m_rxlen;            // message length, 0 = idle
+    uint16_t            m_rxpos;            // bytes received
+    uint16_t            m_rxframe;          // frame index
+    uint8_t             m_rxsn;             // expected sequence number
+    uint8_t             m_rxbs;             // frames left in block
+    int64_t             m_rxtime;           // reception time of last frame [us]
+    int64_t             m_rxdeadline;       // [us]
+
+    // transmission:
+    txstate_t           m_txstate;
+    std::string         m_txbuf;
+    uint16_t            m_txpos;
+    uint8_t             m_txsn;
+    uint8_t             m_txbs;             // peer block size
+    uint8_t             m_txblock;          // frames left in block
+    uint32_t            m_txstmin;          // peer STmin [us]
+    int64_t             m_txnext;           // next CF due [us]
+    int64_t             m_txdeadline;       // [us]
+  };
+
+/**
+ * canisotp: ISO 15765-2 transport engine
+ *  Manages any number of sessions keyed by (bus, txid, rxid). The owner
+ *  feeds received frames via IncomingFrame() (from its listener task) and
+ *  calls CheckTimeouts() when GetNextTimeout() is reached, preferably from
+ *  the same task; callbacks are executed in the context of these calls.
+ *  Reception: sends FC after FF (and after every m_bs CFs), checks CF
+ *  sequence numbers & N_Cr timeouts, streams data to m_rxcb by frame.
+ *  Transmission: Send() segments messages >7 bytes, CFs are scheduled on
+ *  FC reception and sent by CheckTimeouts() honouring the peer's block
+ *  size & STmin, so the owner's task is not blocked by a transfer.
+ */
+class canisotp
+  {
+  public:
+    canisotp();
+    ~canisotp();
+
+  public:
+    canisotp_session* Open(canbus* bus, uint32_t txid, uint32_t rxid,
+      canisotp_rxcb_t rxcb = NULL, canisotp_errcb_t errcb = NULL);
+    canisotp_session* Find(canbus* bus, uint32_t txid, uint32_t rxid);
+    void Close(canisotp_session* session);
+    void CloseAll(canbus* bus = NULL);
+    void SetFlowControl(uint8_t bs, uint8_t stmin);
+    void SetFlowControl(canisotp_session* s, uint8_t bs, uint8_t stmin);
+
+  public:
+    canisotp_error_t Send(canisotp_session* session, const uint8_t* data, uint16_t length);
+    bool IncomingFrame(CAN_frame_t* frame);
+    void CheckTimeouts();
+    int64_t GetNextTimeout() { return m_next; }
+
+  public:
+    static uint32_t DecodeSTmin(uint8_t stmin);
+
+  protected:
+    canisotp_error_t WriteFrame(canisotp_session* s, CAN_txclass_t txclass, const uint8_t* data, uint8_t length);
+    void SendFlowControl(canisotp_session* s, uint8_t status);
+    void SendConsecutive(canisotp_session* s, int64_t now);
+    void Abort(canisotp_session* s, canisotp_error_t error);
+    void SetDeadline(int64_t& deadline, int64_t time);
+
+  protected:
+    SemaphoreHandle_t                 m_mutex;
+    std::vector<canisotp_session*>    m_sessions;
+    volatile int64_t                  m_next;         // earliest session deadline [us], 0 = none
+    uint8_t                           m_bs;           // defaults for new sessions
+    uint8_t                           m_stmin;
+  };
+
+#endif //#ifndef __CANISOTP_H__
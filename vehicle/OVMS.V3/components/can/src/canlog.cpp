@@ -30,11 +30,17 @@ static const char *TAG = "canlog";
 #include "can.h"
 #include "canlog.h"
 #include <sys/param.h>
+#include "esp_timer.h"
 #include <ctype.h>
 #include <string.h>
 #include <string>
 #include <sstream>
 #include <iomanip>
+#include <time.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <dirent.h>
+#include "esp_heap_caps.h"
 #include "ovms_config.h"
 #include "ovms_events.h"
 #include "metrics_standard.h"
@@ -44,7 +50,7 @@ static const char *TAG = "canlog";
  * canlog Factory
  */
 
-static const char* const typelist[] = { "trace", "crtd", NULL };
+static const char* const typelist[] = { "trace", "crtd", "bin", NULL };
 
 const char* const* canlog::GetTypeList()
   {
@@ -57,6 +63,8 @@ canlog* canlog::Instantiate(const char* type)
     return new canlog_trace();
   if (strcasecmp(type, "crtd") == 0)
     return new canlog_crtd();
+  if (strcasecmp(type, "bin") == 0)
+    return new canlog_bin();
   
   ESP_LOGE(TAG, "canlog::Instantiate: Unknown type '%s'", type);
   return NULL;
@@ -67,21 +75,68 @@ canlog* canlog::Instantiate(const char* type)
  * canlog: Base CAN logger implementation
  */
 
-canlog::canlog(int queuesize /*=30*/)
+canlog::canlog(int queuesize /*=0*/)
   {
+  if (queuesize <= 0)
+    queuesize = MyConfig.GetParamValueInt("can", "log.queuesize", CANLOG_DEFAULT_QUEUESIZE);
   m_file = NULL;
   m_path = "";
-  m_filtercnt = 0;
+  m_filter = NULL;
+  char evcaller[32];
+  snprintf(evcaller, sizeof(evcaller), "canlog-%p", this);
+  m_evcaller = evcaller;
+  m_blockmutex = xSemaphoreCreateMutex();
+  m_block[0] = m_block[1] = NULL;
+  m_blocksize = 0;
+  m_blockfill = 0;
+  m_blockcur = 0;
+  m_blockstart = 0;
+  m_flush = CANLOG_DEFAULT_FLUSH * 1000;
+  m_fsync = 0;
+  m_lastsync = 0;
+  m_wtask = NULL;
+  m_wqueue = xQueueCreate(4, sizeof(canlog_block_t));
+  m_wfree = xSemaphoreCreateCounting(1, 1);
+  m_sync = xSemaphoreCreateBinary();
+  m_wbytes = 0;
+  m_wcount = 0;
+  m_wtime = 0;
+  m_wmax = 0;
+  m_wstart = 0;
+  m_rotatesize = 0;
+  m_rotatetime = 0;
+  m_rotatekeep = 0;
+  m_segment = 0;
+  m_segbytes = 0;
+  m_segstart = 0;
+  m_ring = NULL;
+  m_ringsize = 0;
+  m_ringhead = 0;
+  m_ringcount = 0;
+  m_ringpre = 0;
+  m_ringpost = 0;
+  m_triggered = false;
+  m_captureend = 0;
   m_queue = xQueueCreate(queuesize, sizeof(CAN_LogMsg_t));
   xTaskCreatePinnedToCore(RxTask, "CanLogTask", 4096, (void*)this, 5, &m_task, 1);
   m_msgcount = 0;
   m_dropcount = 0;
+  m_framequota = queuesize;
   }
 
 canlog::~canlog()
   {
-  if (m_task)
-    vTaskDelete(m_task);
+  StopTasks();
+  vQueueDelete(m_wqueue);
+  vSemaphoreDelete(m_wfree);
+  vSemaphoreDelete(m_sync);
+  vSemaphoreDelete(m_blockmutex);
+  free(m_block[0]);
+  free(m_block[1]);
+  if (m_ring)
+    heap_caps_free(m_ring);
+  if (m_filter)
+    delete m_filter;
   
   if (m_queue)
     {
@@ -95,6 +150,12 @@ canlog::~canlog()
         case CAN_LogInfo_Event:
           free(msg.text);
           break;
+        case CAN_LogFrame_RX:
+        case CAN_LogFrame_TX:
+        case CAN_LogFrame_TX_Queue:
+        case CAN_LogFrame_TX_Fail:
+          MyCan.ReleaseLogFrame(msg.frame);
+          break;
         default:
           break;
         }
@@ -103,27 +164,223 @@ canlog::~canlog()
     }
   }
 
+/**
+ * StopTasks: terminate the logger & writer task
+ *  Stop markers are sent through both queues, so all messages & blocks
+ *  queued before are processed. Returns when both tasks have confirmed.
+ *  Note: detach the logger from the CAN framework (can::RemoveLogger())
+ *  before, Close() and delete after.
+ */
+void canlog::StopTasks()
+  {
+  if (m_task)
+    {
+    CAN_LogMsg_t msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = CANLOG_MSG_STOP;
+    xQueueSend(m_queue, &msg, portMAX_DELAY);
+    xSemaphoreTake(m_sync, portMAX_DELAY);
+    m_task = NULL;
+    }
+  if (m_wtask)
+    {
+    canlog_block_t block = { CANLOG_BLOCK_STOP, 0, NULL };
+    xQueueSend(m_wqueue, &block, portMAX_DELAY);
+    xSemaphoreTake(m_sync, portMAX_DELAY);
+    m_wtask = NULL;
+    }
+  }
+
 void canlog::RxTask(void *context)
   {
   canlog* me = (canlog*) context;
   CAN_LogMsg_t msg;
   while (1)
     {
-    if (xQueueReceive(me->m_queue, &msg, (portTickType)portMAX_DELAY) == pdTRUE)
+    TickType_t wait = (me->m_blockfill || me->m_captureend)
+      ? pdMS_TO_TICKS(me->m_flush / 1000) + 1 : portMAX_DELAY;
+    if (xQueueReceive(me->m_queue, &msg, wait) == pdTRUE)
       {
+      if (msg.type == CANLOG_MSG_STOP)
+        {
+        // write the partial block, then confirm:
+        xSemaphoreTake(me->m_blockmutex, portMAX_DELAY);
+        me->FlushBlock();
+        xSemaphoreGive(me->m_blockmutex);
+        xSemaphoreGive(me->m_sync);
+        vTaskDelete(NULL);
+        }
+      xSemaphoreTake(me->m_blockmutex, portMAX_DELAY);
+      if (me->m_triggered)
+        me->RingCapture();
+      bool ringidle = (me->m_ringsize && !me->m_captureend);
+      if (ringidle)
+        me->RingStore(msg);
       switch (msg.type)
         {
         case CAN_LogInfo_Comment:
         case CAN_LogInfo_Config:
         case CAN_LogInfo_Event:
-          me->OutputMsg(msg);
+          if (!ringidle) me->OutputMsg(msg);
           free(msg.text);
           break;
+        case CAN_LogFrame_RX:
+        case CAN_LogFrame_TX:
+        case CAN_LogFrame_TX_Queue:
+        case CAN_LogFrame_TX_Fail:
+          if (!ringidle) me->OutputMsg(msg);
+          MyCan.ReleaseLogFrame(msg.frame);
+          break;
         default:
-          me->OutputMsg(msg);
+          if (!ringidle) me->OutputMsg(msg);
           break;
         }
+      // start next segment when the current one is complete:
+      if (me->m_file && ((me->m_rotatesize && me->m_segbytes >= me->m_rotatesize) ||
+          (me->m_rotatetime && esp_timer_get_time() - me->m_segstart >= me->m_rotatetime)))
+        me->Rotate();
+      xSemaphoreGive(me->m_blockmutex);
+      }
+    // end of ring capture post trigger window:
+    if (me->m_captureend && esp_timer_get_time() >= me->m_captureend)
+      {
+      xSemaphoreTake(me->m_blockmutex, portMAX_DELAY);
+      if (me->m_captureend)
+        me->RingEnd();
+      xSemaphoreGive(me->m_blockmutex);
+      }
+    // write partial block after the flush interval:
+    if (me->m_blockfill && esp_timer_get_time() - me->m_blockstart >= me->m_flush)
+      {
+      xSemaphoreTake(me->m_blockmutex, portMAX_DELAY);
+      me->FlushBlock();
+      xSemaphoreGive(me->m_blockmutex);
+      }
+    }
+  }
+
+/**
+ * WriterTask: write blocks to the file
+ *  Runs decoupled from the formatting, so a slow SD card write only blocks
+ *  the formatter if the second block is full as well.
+ */
+void canlog::WriterTask(void *context)
+  {
+  canlog* me = (canlog*) context;
+  canlog_block_t block;
+  while (1)
+    {
+    if (xQueueReceive(me->m_wqueue, &block, (portTickType)portMAX_DELAY) == pdTRUE)
+      {
+      if (block.index == CANLOG_BLOCK_CLOSE)
+        {
+        // previous segment complete:
+        fclose(block.file);
+        continue;
+        }
+      else if (block.index == CANLOG_BLOCK_SYNC)
+        {
+        xSemaphoreGive(me->m_sync);
+        continue;
+        }
+      else if (block.index == CANLOG_BLOCK_STOP)
+        {
+        xSemaphoreGive(me->m_sync);
+        vTaskDelete(NULL);
+        }
+      int64_t start = esp_timer_get_time();
+      if (block.file)
+        {
+        fwrite(me->m_block[block.index], block.length, 1, block.file);
+        if (me->m_fsync && start - me->m_lastsync >= me->m_fsync)
+          {
+          fsync(fileno(block.file));
+          me->m_lastsync = start;
+          }
+        }
+      uint32_t duration = esp_timer_get_time() - start;
+      me->m_wbytes += block.length;
+      me->m_wcount++;
+      me->m_wtime += duration;
+      if (duration > me->m_wmax)
+        me->m_wmax = duration;
+      xSemaphoreGive(me->m_wfree);
+      }
+    }
+  }
+
+/**
+ * FlushBlock: pass the current block to the writer task, switch to the
+ *  other block (waits for the writer if that is still being written)
+ *  Note: call with m_blockmutex held
+ */
+void canlog::FlushBlock()
+  {
+  if (m_blockfill == 0)
+    return;
+  canlog_block_t block = { m_blockcur, m_blockfill, m_file };
+  xSemaphoreTake(m_wfree, portMAX_DELAY);
+  xQueueSend(m_wqueue, &block, portMAX_DELAY);
+  m_blockcur = 1 - m_blockcur;
+  m_blockfill = 0;
+  }
+
+/**
+ * SyncWriter: wait until the writer task has processed all queued blocks
+ *  (including closing the files of previous segments / captures)
+ */
+void canlog::SyncWriter()
+  {
+  if (!m_wtask)
+    return;
+  canlog_block_t block = { CANLOG_BLOCK_SYNC, 0, NULL };
+  xQueueSend(m_wqueue, &block, portMAX_DELAY);
+  xSemaphoreTake(m_sync, portMAX_DELAY);
+  }
+
+void canlog::Write(const void* data, size_t length)
+  {
+  if (!m_block[0])
+    return;
+  const char* src = (const char*) data;
+  while (length)
+    {
+    if (m_blockfill == 0)
+      m_blockstart = esp_timer_get_time();
+    size_t n = MIN(length, m_blocksize - m_blockfill);
+    memcpy(m_block[m_blockcur] + m_blockfill, src, n);
+    m_blockfill += n;
+    m_segbytes += n;
+    src += n;
+    length -= n;
+    if (m_blockfill == m_blocksize)
+      FlushBlock();
+    }
+  }
+
+void canlog::Printf(const char* fmt, ...)
+  {
+  if (!m_block[0])
+    return;
+  va_list args;
+  for (int retry = 0; retry < 2; retry++)
+    {
+    size_t avail = m_blocksize - m_blockfill;
+    va_start(args, fmt);
+    int len = vsnprintf(m_block[m_blockcur] + m_blockfill, avail, fmt, args);
+    va_end(args);
+    if (len < 0)
+      return;
+    if (m_blockfill == 0)
+      m_blockstart = esp_timer_get_time();
+    if ((size_t)len < avail || m_blockfill == 0)
+      {
+      // fits (or exceeds a whole block: truncate)
+      m_blockfill += MIN((size_t)len, avail-1);
+      m_segbytes += MIN((size_t)len, avail-1);
+      return;
       }
+    FlushBlock();
     }
   }
 
@@ -135,29 +392,363 @@ bool canlog::Open(std::string path)
     return false;
     }
   
-  FILE* file = fopen(path.c_str(), "w");
-  if (!file)
+  size_t ringbytes = MyConfig.GetParamValueInt("can", "log.ring.size", 0) * 1024;
+  m_rotatesize = MyConfig.GetParamValueInt("can", "log.rotate.size", 0) * 1024;
+  m_rotatetime = (int64_t)MyConfig.GetParamValueInt("can", "log.rotate.time", 0) * 60 * 1000000;
+  m_rotatekeep = MyConfig.GetParamValueInt("can", "log.rotate.keep", CANLOG_DEFAULT_KEEP);
+  if (ringbytes)
+    m_rotatesize = m_rotatetime = 0; // one file per capture
+  if (ringbytes)
+    m_segment = GetLastSegment(path);  // captures continue after existing files
+  else
+    m_segment = (m_rotatesize || m_rotatetime) ? GetLastSegment(path) + 1 : 0;
+  
+  std::string segpath = GetSegmentPath(path, m_segment);
+  FILE* file = NULL;
+  if (!ringbytes)
     {
-    ESP_LOGE(TAG, "canlog[%s].Open: can't write to '%s'", GetType(), path.c_str());
-    return false;
+    file = fopen(segpath.c_str(), "w");
+    if (!file)
+      {
+      ESP_LOGE(TAG, "canlog[%s].Open: can't write to '%s'", GetType(), segpath.c_str());
+      return false;
+      }
+    // blocks are written in one call, no need for stdio buffering:
+    setvbuf(file, NULL, _IONBF, 0);
+    }
+  
+  xSemaphoreTake(m_blockmutex, portMAX_DELAY);
+  size_t blocksize = MAX(1, MyConfig.GetParamValueInt("can", "log.blocksize", CANLOG_DEFAULT_BLOCKSIZE)) * 1024;
+  if (blocksize != m_blocksize)
+    {
+    free(m_block[0]);
+    free(m_block[1]);
+    m_block[0] = (char*) malloc(blocksize);
+    m_block[1] = (char*) malloc(blocksize);
+    if (!m_block[0] || !m_block[1])
+      {
+      free(m_block[0]);
+      free(m_block[1]);
+      m_block[0] = m_block[1] = NULL;
+      m_blocksize = 0;
+      xSemaphoreGive(m_blockmutex);
+      if (file) fclose(file);
+      ESP_LOGE(TAG, "canlog[%s].Open: can't allocate %u bytes block buffers", GetType(), blocksize);
+      return false;
+      }
+    m_blocksize = blocksize;
     }
+  m_blockfill = 0;
+  if (ringbytes)
+    {
+    // ring capture buffer, preferably in PSRAM:
+#ifdef CONFIG_SPIRAM_SUPPORT
+    m_ring = (canlog_ringentry_t*) heap_caps_malloc(ringbytes, MALLOC_CAP_SPIRAM);
+    if (!m_ring)
+#endif
+      m_ring = (canlog_ringentry_t*) heap_caps_malloc(ringbytes, MALLOC_CAP_8BIT);
+    if (!m_ring)
+      {
+      xSemaphoreGive(m_blockmutex);
+      ESP_LOGE(TAG, "canlog[%s].Open: can't allocate %u bytes ring buffer", GetType(), ringbytes);
+      return false;
+      }
+    m_ringsize = ringbytes / sizeof(canlog_ringentry_t);
+    m_ringhead = 0;
+    m_ringcount = 0;
+    m_ringpre = (int64_t)MyConfig.GetParamValueInt("can", "log.ring.pre", 0) * 1000000;
+    m_ringpost = (int64_t)MyConfig.GetParamValueInt("can", "log.ring.post", CANLOG_DEFAULT_RINGPOST) * 1000000;
+    m_ringtrigger = "," + MyConfig.GetParamValue("can", "log.ring.trigger", CANLOG_DEFAULT_TRIGGER) + ",";
+    m_triggered = false;
+    m_captureend = 0;
+    }
+  m_flush = MyConfig.GetParamValueInt("can", "log.flush", CANLOG_DEFAULT_FLUSH) * 1000;
+  m_fsync = MyConfig.GetParamValueInt("can", "log.fsync", 0) * 1000000;
+  if (!m_wtask)
+    xTaskCreatePinnedToCore(WriterTask, "CanLogWriter", 3072, (void*)this, 5, &m_wtask, 1);
   
   m_path = path;
   m_file = file;
   m_msgcount = 0;
   m_dropcount = 0;
+  m_wbytes = 0;
+  m_wcount = 0;
+  m_wtime = 0;
+  m_wmax = 0;
+  m_wstart = m_lastsync = esp_timer_get_time();
+  m_segbytes = 0;
+  m_segstart = m_wstart;
+  xSemaphoreGive(m_blockmutex);
+  
+  if (m_ringsize)
+    {
+    using std::placeholders::_1;
+    using std::placeholders::_2;
+    MyEvents.RegisterEvent(m_evcaller + "-ring", "*", std::bind(&canlog::TriggerListener, this, _1, _2));
+    ESP_LOGI(TAG, "canlog[%s].Open: ring capture of %u frames, triggers '%s', captures to '%s'",
+      GetType(), m_ringsize, m_ringtrigger.c_str(), path.c_str());
+    return true;
+    }
   
   LogInfo(NULL, CAN_LogInfo_Config, GetInfo().c_str());
-  ESP_LOGI(TAG, "canlog[%s].Open: writing to '%s'", GetType(), path.c_str());
+  ESP_LOGI(TAG, "canlog[%s].Open: writing to '%s'", GetType(), segpath.c_str());
   return true;
   }
 
+/**
+ * GetSegmentPath: file path of a segment
+ *    segment 0 = no rotation: path as given
+ *    else the segment number is inserted before the extension:
+ *      /sd/can.crtd → /sd/can-0001.crtd
+ */
+std::string canlog::GetSegmentPath(const std::string& path, uint32_t segment)
+  {
+  if (segment == 0)
+    return path;
+  char num[16];
+  snprintf(num, sizeof(num), "-%04u", segment);
+  size_t slash = path.find_last_of('/');
+  size_t dot = path.find_last_of('.');
+  if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+    return path + num;
+  return path.substr(0, dot) + num + path.substr(dot);
+  }
+
+/**
+ * GetLastSegment: find the highest existing segment number of a path
+ *  (so a restarted logger continues after the files of previous runs)
+ */
+uint32_t canlog::GetLastSegment(const std::string& path)
+  {
+  std::string first = GetSegmentPath(path, 1);
+  size_t slash = first.find_last_of('/');
+  std::string dir = (slash == std::string::npos) ? "." : first.substr(0, slash);
+  std::string name = (slash == std::string::npos) ? first : first.substr(slash+1);
+  size_t numpos = name.rfind("-0001");
+  std::string prefix = name.substr(0, numpos+1);
+  std::string suffix = name.substr(numpos+5);
+
+  uint32_t last = 0;
+  DIR* dp = opendir(dir.c_str());
+  if (!dp)
+    return 0;
+  struct dirent* ep;
+  while ((ep = readdir(dp)) != NULL)
+    {
+    std::string entry = ep->d_name;
+    if (entry.size() < prefix.size() + 4 + suffix.size()
+      || entry.compare(0, prefix.size(), prefix) != 0
+      || entry.compare(entry.size() - suffix.size(), suffix.size(), suffix) != 0)
+      continue;
+    std::string num = entry.substr(prefix.size(), entry.size() - prefix.size() - suffix.size());
+    if (num.find_first_not_of("0123456789") != std::string::npos)
+      continue;
+    uint32_t segment = strtoul(num.c_str(), NULL, 10);
+    if (segment > last)
+      last = segment;
+    }
+  closedir(dp);
+  return last;
+  }
+
+/**
+ * Rotate: switch to the next segment
+ *  The next file is opened before the current one is closed, so no message
+ *  is lost. The current file is closed by the writer task after its last block.
+ *  Segments older than log.rotate.keep are removed.
+ *  Note: call with m_blockmutex held
+ */
+void canlog::Rotate()
+  {
+  std::string segpath = GetSegmentPath(m_path, m_segment + 1);
+  FILE* file = fopen(segpath.c_str(), "w");
+  int64_t now = esp_timer_get_time();
+  if (!file)
+    {
+    // continue in current segment, retry with the next size/time limit:
+    ESP_LOGE(TAG, "canlog[%s].Rotate: can't write to '%s'", GetType(), segpath.c_str());
+    m_segbytes = 0;
+    m_segstart = now;
+    return;
+    }
+  setvbuf(file, NULL, _IONBF, 0);
+  
+  FlushBlock();
+  canlog_block_t close = { CANLOG_BLOCK_CLOSE, 0, m_file };
+  xQueueSend(m_wqueue, &close, portMAX_DELAY);
+  m_file = file;
+  m_segment++;
+  m_segbytes = 0;
+  m_segstart = now;
+  
+  if (m_rotatekeep && m_segment > m_rotatekeep)
+    unlink(GetSegmentPath(m_path, m_segment - m_rotatekeep).c_str());
+  ESP_LOGI(TAG, "canlog[%s].Rotate: writing to '%s'", GetType(), segpath.c_str());
+  StartSegment();
+  }
+
+/**
+ * Trigger: start ring capture (or extend the running capture)
+ */
+void canlog::Trigger(const char* reason)
+  {
+  if (!m_ringsize)
+    return;
+  m_triggered = true;
+  std::string text = "trigger ";
+  text.append(reason);
+  LogInfo(NULL, CAN_LogInfo_Event, text.c_str()); // also wakes up the logger task
+  }
+
+void canlog::TriggerListener(std::string event, void* data)
+  {
+  if (m_ringtrigger.find("," + event + ",") != std::string::npos)
+    Trigger(event.c_str());
+  }
+
+/**
+ * RingStore: keep a frame / status message in the ring
+ *  Note: call with m_blockmutex held
+ */
+void canlog::RingStore(const CAN_LogMsg_t& msg)
+  {
+  canlog_ringentry_t& entry = m_ring[m_ringhead];
+  switch (msg.type)
+    {
+    case CAN_LogFrame_RX:
+    case CAN_LogFrame_TX:
+    case CAN_LogFrame_TX_Queue:
+    case CAN_LogFrame_TX_Fail:
+      entry.frame = *msg.frame;
+      break;
+    case CAN_LogStatus_Error:
+    case CAN_LogStatus_Statistics:
+      entry.status = msg.status;
+      break;
+    default:
+      return;
+    }
+  entry.time = msg.time;
+  entry.bus = msg.bus;
+  entry.type = msg.type;
+  m_ringhead = (m_ringhead + 1) % m_ringsize;
+  if (m_ringcount < m_ringsize)
+    m_ringcount++;
+  }
+
+/**
+ * RingCapture: handle trigger, open capture file & write the ring contents
+ *  Note: call with m_blockmutex held
+ */
+void canlog::RingCapture()
+  {
+  m_triggered = false;
+  int64_t now = esp_timer_get_time();
+  if (m_captureend)
+    {
+    m_captureend = now + m_ringpost;
+    return;
+    }
+  
+  std::string segpath = GetSegmentPath(m_path, m_segment + 1);
+  FILE* file = fopen(segpath.c_str(), "w");
+  if (!file)
+    {
+    ESP_LOGE(TAG, "canlog[%s].RingCapture: can't write to '%s'", GetType(), segpath.c_str());
+    return;
+    }
+  setvbuf(file, NULL, _IONBF, 0);
+  m_file = file;
+  m_segment++;
+  m_segbytes = 0;
+  m_segstart = now;
+  if (m_rotatekeep && m_segment > m_rotatekeep)
+    unlink(GetSegmentPath(m_path, m_segment - m_rotatekeep).c_str());
+  ESP_LOGI(TAG, "canlog[%s].RingCapture: writing %u frames to '%s'", GetType(), m_ringcount, segpath.c_str());
+  
+  StartSegment();
+  uint32_t index = (m_ringhead + m_ringsize - m_ringcount) % m_ringsize;
+  for (uint32_t n = 0; n < m_ringcount; n++, index = (index + 1) % m_ringsize)
+    {
+    canlog_ringentry_t& entry = m_ring[index];
+    if (m_ringpre && entry.time < now - m_ringpre)
+      continue;
+    CAN_LogMsg_t msg;
+    msg.time = entry.time;
+    msg.timestamp = entry.time / 1000;
+    msg.bus = entry.bus;
+    msg.type = entry.type;
+    if (entry.type == CAN_LogStatus_Error || entry.type == CAN_LogStatus_Statistics)
+      msg.status = entry.status;
+    else
+      msg.frame = &entry.frame;
+    OutputMsg(msg);
+    }
+  m_ringcount = 0;
+  m_captureend = now + m_ringpost;
+  }
+
+/**
+ * RingEnd: post trigger window complete, close capture file & return to ring mode
+ *  Note: call with m_blockmutex held
+ */
+void canlog::RingEnd()
+  {
+  m_captureend = 0;
+  if (!m_file)
+    return;
+  FlushBlock();
+  canlog_block_t close = { CANLOG_BLOCK_CLOSE, 0, m_file };
+  xQueueSend(m_wqueue, &close, portMAX_DELAY);
+  m_file = NULL;
+  ESP_LOGI(TAG, "canlog[%s].RingEnd: capture '%s' complete",
+    GetType(), GetSegmentPath(m_path, m_segment).c_str());
+  }
+
+/**
+ * StartSegment: write the segment header (logger config info),
+ *  so each segment can be used on its own
+ */
+void canlog::StartSegment()
+  {
+  CAN_LogMsg_t msg;
+  msg.time = esp_timer_get_time();
+  msg.timestamp = msg.time / 1000;
+  msg.bus = NULL;
+  msg.type = CAN_LogInfo_Config;
+  std::string info = GetInfo();
+  msg.text = (char*) info.c_str();
+  OutputMsg(msg);
+  }
+
 void canlog::Close()
   {
-  if (m_file)
+  if (m_ringsize)
+    {
+    MyEvents.DeregisterEvent(m_evcaller + "-ring");
+    xSemaphoreTake(m_blockmutex, portMAX_DELAY);
+    m_ringsize = 0;
+    m_captureend = 0;
+    heap_caps_free(m_ring);
+    m_ring = NULL;
+    xSemaphoreGive(m_blockmutex);
+    if (!m_file)
+      {
+      ESP_LOGI(TAG, "canlog[%s].Close: ring capture stopped. Statistics: %s", GetType(), GetStats().c_str());
+      m_path = "";
+      }
+    }
+  xSemaphoreTake(m_blockmutex, portMAX_DELAY);
+  FILE* file = m_file;
+  if (file)
+    FlushBlock();
+  m_file = NULL;
+  xSemaphoreGive(m_blockmutex);
+  // wait for the writer to finish all queued blocks, including closing
+  // previous segments (Rotate()) or captures (RingEnd()):
+  SyncWriter();
+  if (file)
     {
-    FILE* file = m_file;
-    m_file = NULL;
     fclose(file);
     ESP_LOGI(TAG, "canlog[%s].Close: '%s' closed. Statistics: %s",
       GetType(), m_path.c_str(), GetStats().c_str());
@@ -190,22 +781,18 @@ std::string canlog::GetInfo()
   
   if (IsOpen())
     buf << "; Path:'" << GetPath() << "'";
+  if (m_ringsize)
+    buf << "; Ring:" << m_ringcount << "/" << m_ringsize
+      << (m_captureend ? "; Capturing:" : "; Last capture:") << m_segment;
+  else if (m_segment)
+    buf << "; Segment:" << m_segment;
   
-  if (m_filtercnt)
-    {
-    buf << "; Filter:" << std::hex;
-    for (int i=0; i<m_filtercnt; i++)
-      {
-      buf << ((i==0)?"":",");
-      if (m_filter[i].bus)
-        buf << m_filter[i].bus << ":";
-      buf << m_filter[i].id_from << "-" << m_filter[i].id_to;
-      }
-    }
+  MyCan.LockLoggers();
+  if (m_filter)
+    buf << "; Filter:" << m_filter->GetInfo();
   else
-    {
     buf << "; Filter:off";
-    }
+  MyCan.UnlockLoggers();
   
   buf << "; Vehicle:" << StdMetrics.ms_v_type->AsString() << ";";
   
@@ -222,47 +809,88 @@ std::string canlog::GetStats()
     << " = " << std::fixed << std::setprecision(1) << droprate << "%";
   if (waiting > 0)
     buf << ", waiting: " << waiting;
+  if (m_wcount > 0)
+    {
+    float seconds = (float)(esp_timer_get_time() - m_wstart) / 1000000;
+    buf << ", written: " << (m_wbytes / 1024) << " kB"
+      << " = " << std::setprecision(1) << (seconds > 0 ? m_wbytes / 1024 / seconds : 0) << " kB/s"
+      << ", write latency avg: " << std::setprecision(1) << ((float)m_wtime / m_wcount / 1000) << " ms"
+      << ", max: " << ((float)m_wmax / 1000) << " ms";
+    }
   return buf.str();
   }
 
-void canlog::SetFilter(int filtercnt, canlog_filter_t filter[])
+/**
+ * SetFilter: compile & install a new filter rule set (empty = log all)
+ *    - the filter is swapped with log calls locked out (see can::LogFrame),
+ *      so the old filter can be deleted immediately
+ */
+void canlog::SetFilter(const canlog_filter_list_t& rules)
   {
-  m_filtercnt = MIN(filtercnt, CANLOG_MAX_FILTERS);
-  memcpy(m_filter, filter, m_filtercnt*sizeof(canlog_filter_t));
+  canlogfilter* filter = rules.empty() ? NULL : new canlogfilter(rules);
+  MyCan.LockLoggers();
+  canlogfilter* old = m_filter;
+  m_filter = filter;
+  MyCan.UnlockLoggers();
+  if (old)
+    delete old;
   LogInfo(NULL, CAN_LogInfo_Config, GetInfo().c_str());
   }
 
 bool canlog::CheckFilter(canbus* bus, CAN_LogEntry_t type, const CAN_frame_t* frame)
   {
-  if (!bus || m_filtercnt == 0)
+  const canlogfilter* filter = m_filter;
+  if (!bus || !filter)
     return true;
-  char buskey = bus->GetName()[3];
-  for (int i=0; i<m_filtercnt; i++)
-    {
-    if (m_filter[i].bus && m_filter[i].bus != buskey)
-      continue;
-    if (!frame)
-      return true;
-    if (m_filter[i].id_from <= frame->MsgID && frame->MsgID <= m_filter[i].id_to)
-      return true;
-    }
-  return false;
+  return frame ? filter->CheckFrame(bus, frame) : filter->CheckBus(bus);
+  }
+
+/**
+ * MergeInterest: add the frame IDs logged for a bus to a filter plan
+ *    - returns false if all frames of the bus are logged
+ */
+bool canlog::MergeInterest(canbus* bus, canfilter* interest)
+  {
+  const canlogfilter* filter = m_filter;
+  if (!filter)
+    return false;
+  return filter->MergeInterest(bus, interest);
   }
 
-void canlog::LogFrame(canbus* bus, CAN_LogEntry_t type, const CAN_frame_t* frame)
+/**
+ * LogFrame: queue a frame for logging
+ *    - shared: frame pool reference shared by all loggers (see can::LogFrame),
+ *      created by the first logger taking the frame, released by the caller
+ */
+void canlog::LogFrame(canbus* bus, CAN_LogEntry_t type, const CAN_frame_t* frame, CAN_frame_t*& shared)
   {
   if (!IsOpen() || !bus || !frame)
     return;
   if (CheckFilter(bus, type, frame))
     {
+    if (uxQueueMessagesWaiting(m_queue) >= m_framequota)
+      {
+      // frame pool share used up, don't starve the other consumers:
+      m_msgcount++;
+      m_dropcount++;
+      return;
+      }
+    if (!shared)
+      shared = MyCan.RefFrame(frame);
     CAN_LogMsg_t msg;
-    msg.timestamp = esp_log_timestamp();
+    msg.time = (type == CAN_LogFrame_RX && frame->time) ? frame->time : esp_timer_get_time();
+    msg.timestamp = msg.time / 1000;
     msg.bus = bus;
     msg.type = type;
-    msg.frame = *frame;
+    msg.frame = shared ? MyCan.RefFrame(shared) : NULL;
     m_msgcount++;
-    if (xQueueSend(m_queue, &msg, 0) != pdTRUE)
+    if (!msg.frame)
       m_dropcount++;
+    else if (xQueueSend(m_queue, &msg, 0) != pdTRUE)
+      {
+      MyCan.ReleaseLogFrame(msg.frame);
+      m_dropcount++;
+      }
     }
   }
 
@@ -273,7 +901,8 @@ void canlog::LogStatus(canbus* bus, CAN_LogEntry_t type, const CAN_status_t* sta
   if (CheckFilter(bus, type))
     {
     CAN_LogMsg_t msg;
-    msg.timestamp = esp_log_timestamp();
+    msg.time = esp_timer_get_time();
+    msg.timestamp = msg.time / 1000;
     msg.bus = bus;
     msg.type = type;
     msg.status = *status;
@@ -290,7 +919,8 @@ void canlog::LogInfo(canbus* bus, CAN_LogEntry_t type, const char* text)
   if (CheckFilter(bus, type))
     {
     CAN_LogMsg_t msg;
-    msg.timestamp = esp_log_timestamp();
+    msg.time = esp_timer_get_time();
+    msg.timestamp = msg.time / 1000;
     msg.bus = bus;
     msg.type = type;
     msg.text = strdup(text);
@@ -302,6 +932,273 @@ void canlog::LogInfo(canbus* bus, CAN_LogEntry_t type, const char* text)
 
 
 
+/***************************************************************************************************
+ * canlogfilter: compiled log filter
+ */
+
+canlogfilter::canlogfilter(const canlog_filter_list_t& rules)
+  : m_rules(rules)
+  {
+  m_includeall = true;
+  for (const canlog_filter_t& rule : m_rules)
+    {
+    if (!rule.exclude)
+      {
+      m_includeall = false;
+      break;
+      }
+    }
+
+  for (int b = 0; b <= CANLOG_FILTER_BUSES; b++)
+    {
+    canlogfilter_bus_t& bf = m_bus[b];
+    // empty ID filters shall match nothing:
+    bf.include.m_idfilter = bf.exclude.m_idfilter = bf.payload.m_idfilter = true;
+    bf.haspayload = bf.hasinclude = bf.skip = false;
+
+    for (const canlog_filter_t& rule : m_rules)
+      {
+      if (!MatchBus(rule, b))
+        continue;
+      if (!rule.exclude)
+        bf.hasinclude = true;
+      if (rule.byte >= 0)
+        {
+        AddRange(bf.payload, rule);
+        bf.haspayload = true;
+        }
+      else if (rule.exclude)
+        {
+        AddRange(bf.exclude, rule);
+        if (rule.id_from == 0 && rule.id_to >= 0x1fffffff)
+          bf.skip = true;
+        }
+      else
+        {
+        AddRange(bf.include, rule);
+        }
+      }
+
+    // collect all rules that may apply to frames covered by payload rules:
+    if (bf.haspayload)
+      {
+      for (const canlog_filter_t& rule : m_rules)
+        {
+        if (!MatchBus(rule, b))
+          continue;
+        for (const canlog_filter_t& prule : m_rules)
+          {
+          if (prule.byte >= 0 && MatchBus(prule, b) &&
+              rule.id_from <= prule.id_to && prule.id_from <= rule.id_to)
+            {
+            bf.rules.push_back(rule);
+            break;
+            }
+          }
+        }
+      }
+    }
+  }
+
+bool canlogfilter::MatchBus(const canlog_filter_t& rule, int busindex)
+  {
+  return (rule.bus == 0 || (busindex != 0 && rule.bus - '0' == busindex));
+  }
+
+bool canlogfilter::MatchFrame(const canlog_filter_t& rule, const CAN_frame_t* frame)
+  {
+  if (frame->MsgID < rule.id_from || frame->MsgID > rule.id_to)
+    return false;
+  if (rule.byte < 0)
+    return true;
+  return (rule.byte < frame->FIR.B.DLC && (frame->data.u8[rule.byte] & rule.mask) == rule.value);
+  }
+
+void canlogfilter::AddRange(canfilter& filter, const canlog_filter_t& rule)
+  {
+  if (rule.id_from <= 0x7ff)
+    filter.AddStandard(rule.id_from, MIN(rule.id_to, 0x7ff));
+  filter.AddExtended(rule.id_from, MIN(rule.id_to, 0x1fffffff));
+  }
+
+/**
+ * CheckRules: slow path for frames with an ID covered by a payload rule
+ */
+bool canlogfilter::CheckRules(const canlogfilter_bus_t& bf, const CAN_frame_t* frame) const
+  {
+  bool pass = m_includeall;
+  for (const canlog_filter_t& rule : bf.rules)
+    {
+    if (!MatchFrame(rule, frame))
+      continue;
+    if (rule.exclude)
+      return false;
+    pass = true;
+    }
+  return pass;
+  }
+
+/**
+ * CheckBus: check if status & info messages of a bus shall be logged
+ */
+bool canlogfilter::CheckBus(const canbus* bus) const
+  {
+  const canlogfilter_bus_t& bf = m_bus[BusIndex(bus)];
+  if (bf.skip)
+    return false;
+  return (m_includeall || bf.hasinclude);
+  }
+
+/**
+ * MergeInterest: add the frame IDs logged for a bus to a filter plan
+ *    - returns false if all frames of the bus may be logged
+ */
+bool canlogfilter::MergeInterest(const canbus* bus, canfilter* interest) const
+  {
+  if (m_includeall)
+    return false;
+  int b = BusIndex(bus);
+  for (const canlog_filter_t& rule : m_rules)
+    {
+    if (!rule.exclude && MatchBus(rule, b))
+      AddRange(*interest, rule);
+    }
+  return true;
+  }
+
+/**
+ * Parse: parse a filter rule
+ *    [!][<bus>:]<id>[-<id>][@<byte>=<value>[/<mask>]] or [!]<bus>
+ *    (IDs, value & mask hexadecimal, byte index decimal)
+ */
+bool canlogfilter::Parse(const char* spec, canlog_filter_t& rule)
+  {
+  const char* s = spec;
+  char* e;
+  unsigned long val;
+
+  memset(&rule, 0, sizeof(rule));
+  rule.byte = -1;
+  rule.mask = 0xff;
+  rule.id_to = UINT32_MAX;
+
+  if (*s == '!')
+    {
+    rule.exclude = true;
+    s++;
+    }
+  bool isbus = (s[0] >= '1' && s[0] <= '0' + CANLOG_FILTER_BUSES);
+  if (s[0] && ((isbus && s[1] == 0) || s[1] == ':'))
+    {
+    if (!isbus)
+      return false;
+    rule.bus = s[0];
+    if (s[1] == 0)
+      return true;
+    s += 2;
+    }
+
+  if (!isxdigit(*s))
+    return false;
+  rule.id_from = strtoul(s, &e, 16);
+  rule.id_to = rule.id_from;
+  if (*e == '-')
+    {
+    s = e+1;
+    if (!isxdigit(*s))
+      return false;
+    rule.id_to = strtoul(s, &e, 16);
+    if (rule.id_to < rule.id_from)
+      {
+      uint32_t tmp = rule.id_to;
+      rule.id_to = rule.id_from;
+      rule.id_from = tmp;
+      }
+    }
+
+  if (*e == '@')
+    {
+    s = e+1;
+    val = strtoul(s, &e, 10);
+    if (e == s || val > 7 || *e != '=')
+      return false;
+    rule.byte = val;
+    s = e+1;
+    val = strtoul(s, &e, 16);
+    if (e == s || val > 0xff)
+      return false;
+    rule.value = val;
+    if (*e == '/')
+      {
+      s = e+1;
+      val = strtoul(s, &e, 16);
+      if (e == s || val > 0xff)
+        return false;
+      rule.mask = val;
+      }
+    rule.value &= rule.mask;
+    }
+
+  return (*e == 0);
+  }
+
+/**
+ * ParseList: parse a comma separated list of filter rules, add to rules
+ */
+bool canlogfilter::ParseList(const char* specs, canlog_filter_list_t& rules)
+  {
+  std::istringstream input(specs);
+  std::string spec;
+  canlog_filter_t rule;
+  while (std::getline(input, spec, ','))
+    {
+    if (spec.empty())
+      continue;
+    if (!Parse(spec.c_str(), rule))
+      return false;
+    rules.push_back(rule);
+    }
+  return true;
+  }
+
+std::string canlogfilter::Format(const canlog_filter_t& rule)
+  {
+  std::ostringstream buf;
+  buf << std::hex;
+  if (rule.exclude)
+    buf << '!';
+  if (rule.bus)
+    {
+    buf << rule.bus;
+    if (rule.id_from == 0 && rule.id_to == UINT32_MAX)
+      return buf.str();
+    buf << ':';
+    }
+  buf << rule.id_from;
+  if (rule.id_to != rule.id_from)
+    buf << '-' << rule.id_to;
+  if (rule.byte >= 0)
+    {
+    buf << '@' << std::dec << (int)rule.byte << '=' << std::hex << (int)rule.value;
+    if (rule.mask != 0xff)
+      buf << '/' << (int)rule.mask;
+    }
+  return buf.str();
+  }
+
+std::string canlogfilter::GetInfo() const
+  {
+  std::string info;
+  for (const canlog_filter_t& rule : m_rules)
+    {
+    if (!info.empty())
+      info.append(",");
+    info.append(Format(rule));
+    }
+  return info;
+  }
+
+
 /***************************************************************************************************
  * canlog_trace: log to syslog
  */
@@ -318,8 +1215,8 @@ void canlog_trace::OutputMsg(CAN_LogMsg_t& msg)
       char buffer[100];
       char *hexdump = buffer + snprintf(buffer, sizeof(buffer), "%s %s id %0*x len %d: ",
         GetLogEntryTypeName(msg.type), msg.bus->GetName(),
-        (msg.frame.FIR.B.FF == CAN_frame_std) ? 3 : 8, msg.frame.MsgID, msg.frame.FIR.B.DLC);
-      FormatHexDump(&hexdump, (const char*)msg.frame.data.u8, msg.frame.FIR.B.DLC, 8);
+        (msg.frame->FIR.B.FF == CAN_frame_std) ? 3 : 8, msg.frame->MsgID, msg.frame->FIR.B.DLC);
+      FormatHexDump(&hexdump, (const char*)msg.frame->data.u8, msg.frame->FIR.B.DLC, 8);
       esp_log_write(ESP_LOG_VERBOSE, TAG, LOG_FORMAT(V, "%s"), msg.timestamp, TAG, buffer);
       }
       break;
@@ -369,12 +1266,12 @@ canlog_crtd::canlog_crtd()
   {
   using std::placeholders::_1;
   using std::placeholders::_2;
-  MyEvents.RegisterEvent(TAG, "*", std::bind(&canlog_crtd::EventListener, this, _1, _2));
+  MyEvents.RegisterEvent(m_evcaller, "*", std::bind(&canlog_crtd::EventListener, this, _1, _2));
   }
 
 canlog_crtd::~canlog_crtd()
   {
-  MyEvents.DeregisterEvent(TAG);
+  MyEvents.DeregisterEvent(m_evcaller);
   }
 
 void canlog_crtd::EventListener(std::string event, void* data)
@@ -389,31 +1286,31 @@ void canlog_crtd::OutputMsg(CAN_LogMsg_t& msg)
     {
     case CAN_LogFrame_RX:
     case CAN_LogFrame_TX:
-      fprintf(m_file, "%d.%03d %s%c%s %0*X",
-        msg.timestamp / 1000, msg.timestamp % 1000, msg.bus->GetName()+3,
-        (msg.type == CAN_LogFrame_RX) ? 'R' : 'T', (msg.frame.FIR.B.FF == CAN_frame_std) ? "11" : "29",
-        (msg.frame.FIR.B.FF == CAN_frame_std) ? 3 : 8, msg.frame.MsgID);
-      for (int i=0; i<msg.frame.FIR.B.DLC; i++)
-        fprintf(m_file, " %02X", msg.frame.data.u8[i]);
-      fputc('\n', m_file);
+      Printf("%u.%06u %s%c%s %0*X",
+        (uint32_t)(msg.time / 1000000), (uint32_t)(msg.time % 1000000), msg.bus->GetName()+3,
+        (msg.type == CAN_LogFrame_RX) ? 'R' : 'T', (msg.frame->FIR.B.FF == CAN_frame_std) ? "11" : "29",
+        (msg.frame->FIR.B.FF == CAN_frame_std) ? 3 : 8, msg.frame->MsgID);
+      for (int i=0; i<msg.frame->FIR.B.DLC; i++)
+        Printf(" %02X", msg.frame->data.u8[i]);
+      Write("\n", 1);
       break;
     
     case CAN_LogFrame_TX_Queue:
     case CAN_LogFrame_TX_Fail:
-      fprintf(m_file, "%d.%03d %sCEV %s %c%s %0*X",
-        msg.timestamp / 1000, msg.timestamp % 1000, msg.bus->GetName()+3,
+      Printf("%u.%06u %sCEV %s %c%s %0*X",
+        (uint32_t)(msg.time / 1000000), (uint32_t)(msg.time % 1000000), msg.bus->GetName()+3,
         GetLogEntryTypeName(msg.type),
-        (msg.type == CAN_LogFrame_RX) ? 'R' : 'T', (msg.frame.FIR.B.FF == CAN_frame_std) ? "11" : "29",
-        (msg.frame.FIR.B.FF == CAN_frame_std) ? 3 : 8, msg.frame.MsgID);
-      for (int i=0; i<msg.frame.FIR.B.DLC; i++)
-        fprintf(m_file, " %02X", msg.frame.data.u8[i]);
-      fputc('\n', m_file);
+        (msg.type == CAN_LogFrame_RX) ? 'R' : 'T', (msg.frame->FIR.B.FF == CAN_frame_std) ? "11" : "29",
+        (msg.frame->FIR.B.FF == CAN_frame_std) ? 3 : 8, msg.frame->MsgID);
+      for (int i=0; i<msg.frame->FIR.B.DLC; i++)
+        Printf(" %02X", msg.frame->data.u8[i]);
+      Write("\n", 1);
       break;
     
     case CAN_LogStatus_Error:
     case CAN_LogStatus_Statistics:
-      fprintf(m_file, "%d.%03d %s%s %s rxpkt=%d txpkt=%d errflags=%#x rxerr=%d txerr=%d rxovr=%d txovr=%d txdelay=%d\n",
-        msg.timestamp / 1000, msg.timestamp % 1000, msg.bus->GetName()+3,
+      Printf("%u.%06u %s%s %s rxpkt=%d txpkt=%d errflags=%#x rxerr=%d txerr=%d rxovr=%d txovr=%d txdelay=%d\n",
+        (uint32_t)(msg.time / 1000000), (uint32_t)(msg.time % 1000000), msg.bus->GetName()+3,
         (msg.type == CAN_LogStatus_Error) ? "CEV" : "CXX",
         GetLogEntryTypeName(msg.type), msg.status.packets_rx, msg.status.packets_tx, msg.status.error_flags,
         msg.status.errors_rx, msg.status.errors_tx, msg.status.rxbuf_overflow, msg.status.txbuf_overflow,
@@ -424,8 +1321,8 @@ void canlog_crtd::OutputMsg(CAN_LogMsg_t& msg)
     case CAN_LogInfo_Comment:
     case CAN_LogInfo_Config:
     case CAN_LogInfo_Event:
-      fprintf(m_file, "%d.%03d %s%s %s %s\n",
-        msg.timestamp / 1000, msg.timestamp % 1000, msg.bus ? msg.bus->GetName()+3 : "",
+      Printf("%u.%06u %s%s %s %s\n",
+        (uint32_t)(msg.time / 1000000), (uint32_t)(msg.time % 1000000), msg.bus ? msg.bus->GetName()+3 : "",
         (msg.type == CAN_LogInfo_Event) ? "CEV" : "CXX",
         GetLogEntryTypeName(msg.type), msg.text);
       break;
@@ -434,3 +1331,230 @@ void canlog_crtd::OutputMsg(CAN_LogMsg_t& msg)
       break;
     }
   }
+
+
+/***************************************************************************************************
+ * canlog_bin: log to file; compact binary format, see canlog.h
+ *    Frame records are 16 bytes vs. ~45 bytes per 8 byte frame in CRTD,
+ *    and are written without any formatting.
+ */
+
+canlog_bin::canlog_bin()
+  {
+  m_header = false;
+  m_lasttime = 0;
+  using std::placeholders::_1;
+  using std::placeholders::_2;
+  MyEvents.RegisterEvent(m_evcaller, "*", std::bind(&canlog_bin::EventListener, this, _1, _2));
+  }
+
+canlog_bin::~canlog_bin()
+  {
+  MyEvents.DeregisterEvent(m_evcaller);
+  }
+
+void canlog_bin::EventListener(std::string event, void* data)
+  {
+  if (startsWith(event, "vehicle"))
+    LogInfo(NULL, CAN_LogInfo_Event, event.c_str());
+  }
+
+bool canlog_bin::Open(std::string path)
+  {
+  // header is written by the logger task with the first record:
+  m_header = false;
+  return canlog::Open(path);
+  }
+
+void canlog_bin::StartSegment()
+  {
+  // each segment starts with a file header:
+  m_header = false;
+  canlog::StartSegment();
+  }
+
+void canlog_bin::WriteHeader(int64_t basetime)
+  {
+  std::string info = GetInfo();
+  canlog_bin_header_t hdr = {};
+  memcpy(hdr.magic, CANLOG_BIN_MAGIC, sizeof(hdr.magic));
+  hdr.version = CANLOG_BIN_VERSION;
+  hdr.infolen = info.size();
+  hdr.basetime = basetime;
+  hdr.unixtime = time(NULL);
+  Write(&hdr, sizeof(hdr));
+  Write(info.data(), info.size());
+  m_lasttime = basetime;
+  m_header = true;
+  }
+
+void canlog_bin::OutputMsg(CAN_LogMsg_t& msg)
+  {
+  if (!m_header)
+    WriteHeader(msg.time);
+
+  canlog_bin_record_t rec = {};
+  int64_t delta = msg.time - m_lasttime;
+  if (delta < 0 || delta > CANLOG_BIN_MAXDELTA)
+    {
+    // out of order / delta overflow: write absolute time
+    rec.time = (uint32_t)CANLOG_BIN_TIMESYNC << 28;
+    memcpy(rec.data, &msg.time, sizeof(msg.time));
+    Write(&rec, sizeof(rec));
+    memset(&rec, 0, sizeof(rec));
+    delta = 0;
+    }
+  m_lasttime = msg.time;
+  uint32_t busno = msg.bus ? (msg.bus->GetName()[3] - '0') & 0x0f : 0;
+  rec.time = (uint32_t)delta | (busno << 24) | ((uint32_t)msg.type << 28);
+
+  switch (msg.type)
+    {
+    case CAN_LogFrame_RX:
+    case CAN_LogFrame_TX:
+    case CAN_LogFrame_TX_Queue:
+    case CAN_LogFrame_TX_Fail:
+      rec.time |= (uint32_t)(msg.frame->FIR.B.DLC & 0x0f) << 20;
+      rec.id = msg.frame->MsgID
+        | ((msg.frame->FIR.B.FF == CAN_frame_std) ? 0 : CANLOG_BIN_ID_EXT)
+        | (msg.frame->FIR.B.RTR ? CANLOG_BIN_ID_RTR : 0);
+      memcpy(rec.data, msg.frame->data.u8, sizeof(rec.data));
+      Write(&rec, sizeof(rec));
+      break;
+
+    case CAN_LogStatus_Error:
+    case CAN_LogStatus_Statistics:
+      {
+      char text[128];
+      rec.id = snprintf(text, sizeof(text), "rxpkt=%d txpkt=%d errflags=%#x rxerr=%d txerr=%d rxovr=%d txovr=%d txdelay=%d",
+        msg.status.packets_rx, msg.status.packets_tx, msg.status.error_flags,
+        msg.status.errors_rx, msg.status.errors_tx, msg.status.rxbuf_overflow, msg.status.txbuf_overflow,
+        msg.status.txbuf_delay);
+      rec.id = MIN(rec.id, sizeof(text)-1);
+      Write(&rec, sizeof(rec));
+      Write(text, rec.id);
+      }
+      break;
+
+    case CAN_LogInfo_Comment:
+    case CAN_LogInfo_Config:
+    case CAN_LogInfo_Event:
+      rec.id = strlen(msg.text);
+      Write(&rec, sizeof(rec));
+      Write(msg.text, rec.id);
+      break;
+
+    default:
+      break;
+    }
+  }
+
+/**
+ * ConvertToCRTD: convert a binary log file to CRTD
+ *    - returns false on error (file access / invalid file)
+ *    - records: number of records converted
+ */
+bool canlog_bin::ConvertToCRTD(const char* binpath, const char* crtdpath, std::string& error, uint32_t* records)
+  {
+  FILE* in = fopen(binpath, "r");
+  if (!in)
+    {
+    error = "cannot open input file";
+    return false;
+    }
+  canlog_bin_header_t hdr;
+  if (fread(&hdr, sizeof(hdr), 1, in) != 1 || memcmp(hdr.magic, CANLOG_BIN_MAGIC, sizeof(hdr.magic)) != 0)
+    {
+    fclose(in);
+    error = "not a binary CAN log";
+    return false;
+    }
+  if (hdr.version != CANLOG_BIN_VERSION)
+    {
+    fclose(in);
+    error = "unsupported version " + std::to_string(hdr.version);
+    return false;
+    }
+  FILE* out = fopen(crtdpath, "w");
+  if (!out)
+    {
+    fclose(in);
+    error = "cannot open output file";
+    return false;
+    }
+
+  char text[256];
+  size_t len = fread(text, 1, MIN(hdr.infolen, sizeof(text)-1), in);
+  text[len] = 0;
+  if (hdr.infolen > len)
+    fseek(in, hdr.infolen - len, SEEK_CUR);
+  int64_t time = hdr.basetime;
+  fprintf(out, "%u.%06u CXX Info %s\n", (uint32_t)(time / 1000000), (uint32_t)(time % 1000000), text);
+
+  canlog_bin_record_t rec;
+  uint32_t count = 0;
+  while (fread(&rec, sizeof(rec), 1, in) == 1)
+    {
+    uint32_t type = rec.time >> 28;
+    if (type == CANLOG_BIN_TIMESYNC)
+      {
+      memcpy(&time, rec.data, sizeof(time));
+      continue;
+      }
+    time += rec.time & CANLOG_BIN_MAXDELTA;
+    int busno = (rec.time >> 24) & 0x0f;
+    char bus[4] = "";
+    if (busno) snprintf(bus, sizeof(bus), "%d", busno);
+    uint32_t sec = time / 1000000, usec = time % 1000000;
+    count++;
+
+    switch (type)
+      {
+      case CAN_LogFrame_RX:
+      case CAN_LogFrame_TX:
+      case CAN_LogFrame_TX_Queue:
+      case CAN_LogFrame_TX_Fail:
+        {
+        bool ext = (rec.id & CANLOG_BIN_ID_EXT);
+        int dlc = MIN((rec.time >> 20) & 0x0f, 8);
+        if (type == CAN_LogFrame_RX || type == CAN_LogFrame_TX)
+          fprintf(out, "%u.%06u %s%c%s %0*X", sec, usec, bus,
+            (type == CAN_LogFrame_RX) ? 'R' : 'T', ext ? "29" : "11", ext ? 8 : 3, rec.id & 0x1fffffff);
+        else
+          fprintf(out, "%u.%06u %sCEV %s T%s %0*X", sec, usec, bus,
+            CAN_LogEntryTypeName[type], ext ? "29" : "11", ext ? 8 : 3, rec.id & 0x1fffffff);
+        for (int i=0; i<dlc; i++)
+          fprintf(out, " %02X", rec.data[i]);
+        fputc('\n', out);
+        }
+        break;
+
+      case CAN_LogStatus_Error:
+      case CAN_LogStatus_Statistics:
+      case CAN_LogInfo_Comment:
+      case CAN_LogInfo_Config:
+      case CAN_LogInfo_Event:
+        len = fread(text, 1, MIN(rec.id, sizeof(text)-1), in);
+        text[len] = 0;
+        if (rec.id > len)
+          fseek(in, rec.id - len, SEEK_CUR);
+        fprintf(out, "%u.%06u %s%s %s %s\n", sec, usec, bus,
+          (type == CAN_LogStatus_Error || type == CAN_LogInfo_Event) ? "CEV" : "CXX",
+          CAN_LogEntryTypeName[type], text);
+        break;
+
+      default:
+        // unknown record type: no length info, can't continue
+        fclose(in);
+        fclose(out);
+        error = "invalid record type " + std::to_string(type);
+        if (records) *records = count;
+        return false;
+      }
+    }
+
+  fclose(in);
+  fclose(out);
+  if (records) *records = count;
+  return true;
+  }
@@ -28,24 +28,116 @@
 #define __CANLOG_H__
 
 #include "freertos/semphr.h"
+#include <string>
+#include <vector>
 
-#define CANLOG_MAX_FILTERS        3
+#define CANLOG_FILTER_BUSES       4         // compiled filter: per bus tables for can1..can4
 
+#define CANLOG_DEFAULT_QUEUESIZE  100       // messages
+#define CANLOG_DEFAULT_BLOCKSIZE  8         // [kB] file write block size
+#define CANLOG_DEFAULT_FLUSH      1000      // [ms] max delay of a partial block
+#define CANLOG_DEFAULT_KEEP       10        // rotation: segments retained
+#define CANLOG_DEFAULT_RINGPOST   10        // [s] ring capture: post trigger window
+#define CANLOG_DEFAULT_TRIGGER    "vehicle.alarm.on"
+
+// Writer queue markers (canlog_block_t.index):
+#define CANLOG_BLOCK_CLOSE        -1        // close file of a previous segment
+#define CANLOG_BLOCK_SYNC         -2        // all blocks done: give m_sync
+#define CANLOG_BLOCK_STOP         -3        // all blocks done: give m_sync & terminate
+
+// Logger queue marker (CAN_LogMsg_t.type, internal):
+#define CANLOG_MSG_STOP           ((CAN_LogEntry_t)0x7f)  // give m_sync & terminate
+
+/**
+ * canlog_filter_t: log filter rule
+ *  Syntax: [!][<bus>:]<id>[-<id>][@<byte>=<value>[/<mask>]] or [!]<bus>
+ *  A frame is logged if it matches any include rule (or there are no
+ *  include rules) and no exclude ("!") rule. A payload condition limits
+ *  the rule to frames with (data[byte] & mask) == value.
+ */
 typedef struct
   {
-  char bus;
+  char bus;                           // '1'..'4', 0 = all buses
+  bool exclude;                       // drop matching frames
   uint32_t id_from;
   uint32_t id_to;
+  int8_t byte;                        // payload condition: data byte index, -1 = none
+  uint8_t value;
+  uint8_t mask;
   } canlog_filter_t;
 
+typedef std::vector<canlog_filter_t> canlog_filter_list_t;
+
+#define CANLOG_FILTER_HELP \
+  "Filter: [!]<bus> / [!][<bus>:]<id>[-<id>][@<byte>=<value>[/<mask>]]\n" \
+  "  multiple filters may be given comma separated, '!' = exclude\n" \
+  "Example: 2:2a0-37f,!2:300 1:7e8@2=62"
+
+/**
+ * canlogfilter: compiled log filter
+ *  The rules are compiled into per bus ID tables (canfilter: 2048 bit
+ *  bitmap for standard IDs, sorted ranges with binary search for extended
+ *  IDs), so the per frame cost does not depend on the number of rules.
+ *  Only frames with an ID covered by a payload rule are checked against
+ *  the (pre-selected) rules for that bus & ID range.
+ *  Compiled filters are immutable, canlog::SetFilter() replaces them.
+ */
+class canlogfilter
+  {
+  public:
+    canlogfilter(const canlog_filter_list_t& rules);
+
+  public:
+    static bool Parse(const char* spec, canlog_filter_t& rule);
+    static bool ParseList(const char* specs, canlog_filter_list_t& rules);
+    static std::string Format(const canlog_filter_t& rule);
+    std::string GetInfo() const;
+
+  public:
+    static inline int BusIndex(const canbus* bus)
+      {
+      return (bus->m_busnumber >= 1 && bus->m_busnumber <= CANLOG_FILTER_BUSES) ? bus->m_busnumber : 0;
+      }
+    bool CheckBus(const canbus* bus) const;
+    inline bool CheckFrame(const canbus* bus, const CAN_frame_t* frame) const
+      {
+      const canlogfilter_bus_t& bf = m_bus[BusIndex(bus)];
+      if (bf.haspayload && bf.payload.Match(frame))
+        return CheckRules(bf, frame);
+      return (m_includeall || bf.include.Match(frame)) && !bf.exclude.Match(frame);
+      }
+    bool MergeInterest(const canbus* bus, canfilter* interest) const;
+
+  protected:
+    typedef struct
+      {
+      canfilter include;                  // IDs of include rules
+      canfilter exclude;                  // IDs of exclude rules
+      canfilter payload;                  // IDs covered by payload rules
+      bool haspayload;
+      bool hasinclude;
+      bool skip;                          // bus excluded completely
+      canlog_filter_list_t rules;         // rules to check for payload IDs
+      } canlogfilter_bus_t;
+    static bool MatchBus(const canlog_filter_t& rule, int busindex);
+    static bool MatchFrame(const canlog_filter_t& rule, const CAN_frame_t* frame);
+    static void AddRange(canfilter& filter, const canlog_filter_t& rule);
+    bool CheckRules(const canlogfilter_bus_t& bf, const CAN_frame_t* frame) const;
+
+  public:
+    canlog_filter_list_t  m_rules;
+    bool                  m_includeall;   // no include rules: all frames included
+    canlogfilter_bus_t    m_bus[CANLOG_FILTER_BUSES+1];   // [0] = unnumbered buses
+  };
+
 /**
  * canlog is the general interface and base implementation for all can loggers.
  *  It provides standard methods to open files and configure message filters
  *  to the CAN framework command "can log".
  * 
  * Specific log formats are implemented as sub classes of canlog. Add them
- *  to the type list & method Instantiate(). See canlog_trace & canlog_crtd
- *  for examples & reference.
+ *  to the type list & method Instantiate(). See canlog_trace, canlog_crtd
+ *  & canlog_bin for examples & reference.
  * 
  * Log messages are sent to a canlog through a queue handled by a separate
  *  task for the logger, so logging doesn't affect CAN framework speed and
@@ -54,6 +146,37 @@ typedef struct
  * Log entries can be frames, status or info messages (see CAN_LogEntry_t).
  * The timestamp of the original event is preserved.
  * 
+ * File loggers format into a block buffer (Write() / Printf()), full blocks
+ *  are written by a separate writer task in one write, so a stalling SD card
+ *  doesn't block formatting. Block size, flush interval & fsync interval
+ *  are read from config "can" on Open():
+ *    log.blocksize       block size [kB] (default 8, two blocks are allocated)
+ *    log.flush           max time a partial block is buffered [ms] (default 1000)
+ *    log.fsync           fsync interval [s] (default 0 = off)
+ *    log.queuesize       message queue size (default 100)
+ *    log.rotate.size     start a new file after <n> kB (default 0 = off)
+ *    log.rotate.time     start a new file after <n> minutes (default 0 = off)
+ *    log.rotate.keep     number of files retained (default 10, 0 = all)
+ *  With rotation, the segment number is added to the file name
+ *  (i.e. /sd/can.crtd → /sd/can-0001.crtd, /sd/can-0002.crtd ...),
+ *  numbering continues after the highest segment already existing.
+ * 
+ * Ring capture: with log.ring.size set, frames are kept in a RAM ring
+ *  (PSRAM if available) and nothing is written until a trigger (one of the
+ *  log.ring.trigger events or "can log trigger"). On a trigger, a capture
+ *  file is created (numbered like segments, continuing after existing
+ *  files) containing the ring contents (pre trigger window) and all
+ *  messages up to log.ring.post seconds after the trigger. A trigger during the capture extends the post window.
+ *    log.ring.size       ring size [kB] (default 0 = off)
+ *    log.ring.pre        pre trigger window [s] (default 0 = whole ring)
+ *    log.ring.post       post trigger window [s] (default 10)
+ *    log.ring.trigger    trigger events, comma separated (default vehicle.alarm.on)
+ *  Info messages (comments, events) are not kept in the ring.
+ * 
+ * Multiple loggers can be attached to the CAN framework (can::AddLogger()),
+ *  each with its own filters, queue and statistics. Frames are passed on
+ *  as references to a shared frame pool copy (see can::LogFrame()).
+ * 
  * Note: loggers get messages for all interfaces, if a log format does not
  *  allow multiple buses within a file, the logger needs to manage a set
  *  of files or may return false on Open() without a bus filter.
@@ -65,18 +188,25 @@ class canlog
     static canlog* Instantiate(const char* type);
   
   public:
-    canlog(int queuesize=30);
+    canlog(int queuesize=0);
     virtual ~canlog();
     virtual const char* GetType() { return ""; }
     static void RxTask(void* context);
+    static void WriterTask(void* context);
   
   public:
     // Channel:
     virtual bool Open(std::string path);
     virtual void Close();
-    virtual bool IsOpen() { return (m_file != NULL); }
+    void StopTasks();
+    virtual bool IsOpen() { return (m_file != NULL || m_ringsize != 0); }
     virtual std::string GetPath() { return m_path; }
 
+  public:
+    // Ring capture:
+    void Trigger(const char* reason);
+    bool IsRingMode() { return (m_ringsize != 0); }
+
   public:
     // Utils:
     virtual const char* GetLogEntryTypeName(CAN_LogEntry_t type);
@@ -85,28 +215,108 @@ class canlog
 
   public:
 	// Filter:
-    virtual void SetFilter(int filtercnt, canlog_filter_t filter[]);
+    virtual void SetFilter(const canlog_filter_list_t& rules);
     virtual bool CheckFilter(canbus* bus, CAN_LogEntry_t type, const CAN_frame_t* frame=NULL);
+    virtual bool MergeInterest(canbus* bus, canfilter* interest);
 
   public:
     // Logging API:
-    virtual void LogFrame(canbus* bus, CAN_LogEntry_t type, const CAN_frame_t* p_frame);
+    virtual void LogFrame(canbus* bus, CAN_LogEntry_t type, const CAN_frame_t* p_frame, CAN_frame_t*& shared);
     virtual void LogStatus(canbus* bus, CAN_LogEntry_t type, const CAN_status_t* status);
     virtual void LogInfo(canbus* bus, CAN_LogEntry_t type, const char* text);
 
   public:
     // Formatter (implemented in sub classes):
     virtual void OutputMsg(CAN_LogMsg_t& msg) {}
+
+  protected:
+    // Block writer:
+    void Write(const void* data, size_t length);
+    void Printf(const char* fmt, ...) __attribute__ ((format (printf, 2, 3)));
+    void FlushBlock();
+    void SyncWriter();
+
+  protected:
+    // File rotation:
+    static std::string GetSegmentPath(const std::string& path, uint32_t segment);
+    static uint32_t GetLastSegment(const std::string& path);
+    void Rotate();
+    virtual void StartSegment();
+
+  protected:
+    // Ring capture:
+    typedef struct
+      {
+      int64_t time;
+      canbus* bus;
+      CAN_LogEntry_t type;
+      union
+        {
+        CAN_frame_t frame;
+        CAN_status_t status;
+        };
+      } canlog_ringentry_t;
+    void RingStore(const CAN_LogMsg_t& msg);
+    void RingCapture();
+    void RingEnd();
+    void TriggerListener(std::string event, void* data);
+
+  protected:
+    typedef struct
+      {
+      int index;                          // block index or CANLOG_BLOCK_* marker
+      size_t length;
+      FILE* file;
+      } canlog_block_t;
   
   public:
     TaskHandle_t        m_task;
     QueueHandle_t       m_queue;
     uint32_t            m_msgcount;
     uint32_t            m_dropcount;
+    uint32_t            m_framequota;     // max frames queued (frame pool share, see can::UpdateFrameQuotas())
     std::string         m_path;
     FILE*               m_file;
-    int                 m_filtercnt;
-    canlog_filter_t     m_filter[CANLOG_MAX_FILTERS];
+    canlogfilter*       m_filter;         // NULL = log all (changed under MyCan.LockLoggers())
+    std::string         m_evcaller;       // event registration name (per instance)
+
+  protected:
+    SemaphoreHandle_t   m_blockmutex;     // block buffer access
+    char*               m_block[2];       // double buffer
+    size_t              m_blocksize;
+    size_t              m_blockfill;      // bytes in current block
+    int                 m_blockcur;       // current block index
+    int64_t             m_blockstart;     // time of first byte in current block [us]
+    uint32_t            m_flush;          // max partial block delay [us]
+    uint32_t            m_fsync;          // fsync interval [us], 0 = off
+    int64_t             m_lastsync;       // [us]
+    TaskHandle_t        m_wtask;          // writer task
+    QueueHandle_t       m_wqueue;         // blocks to write
+    SemaphoreHandle_t   m_wfree;          // free block available
+    SemaphoreHandle_t   m_sync;           // task handshake (SyncWriter(), StopTasks())
+    uint32_t            m_rotatesize;     // [bytes] 0 = off
+    int64_t             m_rotatetime;     // [us] 0 = off
+    uint32_t            m_rotatekeep;     // segments retained, 0 = all
+    uint32_t            m_segment;        // current segment, 0 = no rotation
+    uint32_t            m_segbytes;       // bytes in current segment
+    int64_t             m_segstart;       // [us]
+    canlog_ringentry_t* m_ring;           // ring capture buffer
+    uint32_t            m_ringsize;       // entries, 0 = ring capture off
+    uint32_t            m_ringhead;       // next entry to write
+    uint32_t            m_ringcount;      // entries used
+    int64_t             m_ringpre;        // [us] pre trigger window, 0 = whole ring
+    int64_t             m_ringpost;       // [us] post trigger window
+    std::string         m_ringtrigger;    // ",<event>,<event>,"
+    volatile bool       m_triggered;      // trigger pending
+    int64_t             m_captureend;     // [us] end of running capture, 0 = none
+
+  public:
+    // Writer statistics:
+    uint64_t            m_wbytes;         // bytes written
+    uint32_t            m_wcount;         // block writes
+    uint64_t            m_wtime;          // total write time [us]
+    uint32_t            m_wmax;           // max write time [us]
+    int64_t             m_wstart;         // time of Open() [us]
   };
 
 
@@ -143,4 +353,64 @@ class canlog_crtd : public canlog
   };
 
 
+/**
+ * canlog_bin: compact binary format, fixed size frame records
+ *  File layout (all values little endian):
+ *    canlog_bin_header_t, followed by infolen bytes of logger info text
+ *    canlog_bin_record_t records:
+ *      - frames: ID, flags, DLC & data in the record
+ *      - status & info: text (CRTD syntax) of <id> bytes following the record
+ *      - CANLOG_BIN_TIMESYNC: absolute time in data (if the delta overflows)
+ *  Use "can log convert" or tools/canlog2crtd.py to convert to CRTD.
+ */
+#define CANLOG_BIN_MAGIC          "OVCL"
+#define CANLOG_BIN_VERSION        1
+#define CANLOG_BIN_MAXDELTA       0xfffff   // max time delta [us] in a record
+#define CANLOG_BIN_TIMESYNC       15        // record type: absolute time [us] in data
+
+typedef struct
+  {
+  char magic[4];                      // CANLOG_BIN_MAGIC
+  uint16_t version;                   // CANLOG_BIN_VERSION
+  uint16_t infolen;                   // length of info text following the header
+  int64_t basetime;                   // [us since boot] time reference of first record
+  uint32_t unixtime;                  // system time at basetime (0 = unknown)
+  uint32_t reserved;
+  } canlog_bin_header_t;
+
+typedef struct
+  {
+  uint32_t time;                      // bits 0-19: time delta to previous record [us]
+                                      // bits 20-23: DLC, bits 24-27: bus number (0 = none)
+                                      // bits 28-31: CAN_LogEntry_t / CANLOG_BIN_TIMESYNC
+  uint32_t id;                        // frames: bits 0-28: MsgID, bit 29: extended, bit 30: RTR
+                                      // status & info: text length
+  uint8_t data[8];
+  } canlog_bin_record_t;
+
+#define CANLOG_BIN_ID_EXT         (1u << 29)
+#define CANLOG_BIN_ID_RTR         (1u << 30)
+
+class canlog_bin : public canlog
+  {
+  public:
+    canlog_bin();
+    virtual ~canlog_bin();
+    virtual const char* GetType() { return "bin"; }
+  public:
+    virtual bool Open(std::string path);
+    virtual void OutputMsg(CAN_LogMsg_t& msg);
+  protected:
+    virtual void StartSegment();
+  public:
+    static bool ConvertToCRTD(const char* binpath, const char* crtdpath, std::string& error, uint32_t* records=NULL);
+  protected:
+    void EventListener(std::string event, void* data);
+    void WriteHeader(int64_t basetime);
+  protected:
+    bool                m_header;         // header written
+    int64_t             m_lasttime;       // time of last record [us]
+  };
+
+
 #endif // __CANLOG_H__
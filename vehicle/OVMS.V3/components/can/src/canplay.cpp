@@ -0,0 +1,346 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          18th October 2026
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+#include "ovms_log.h"
+static const char *TAG = "canplay";
+
+#include <algorithm>
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_timer.h"
+#include "canplay.h"
+#include "ovms_command.h"
+
+canplay* MyCanPlay = NULL;
+
+static void CANPLAY_task(void *pvParameters)
+  {
+  canplay *me = (canplay*)pvParameters;
+  me->Task();
+  }
+
+canplay::canplay()
+  {
+  m_task = NULL;
+  m_run = false;
+  m_file = NULL;
+  m_target = NULL;
+  memset(m_buses, 0, sizeof(m_buses));
+  m_speed = 1;
+  m_frames = 0;
+  m_skipped = 0;
+  m_drops = 0;
+  m_poolfails = 0;
+  m_logtime = 0;
+  m_start = 0;
+  m_stop = 0;
+  }
+
+canplay::~canplay()
+  {
+  Stop();
+  }
+
+/**
+ * canplay::Start -- open CRTD file & start replay task
+ *    - speed: time scale factor, 0 = as fast as possible
+ *    - target: bus to inject all frames into, NULL = bus of record
+ */
+bool canplay::Start(std::string path, float speed, canbus* target /*=NULL*/)
+  {
+  if (m_task)
+    return false;
+  m_file = fopen(path.c_str(), "r");
+  if (!m_file)
+    {
+    ESP_LOGE(TAG, "Cannot open '%s'", path.c_str());
+    return false;
+    }
+  m_path = path;
+  m_speed = (speed < 0) ? 0 : speed;
+  m_target = target;
+  memset(m_buses, 0, sizeof(m_buses));
+  m_frames = 0;
+  m_skipped = 0;
+  m_drops = 0;
+  m_poolfails = 0;
+  m_logtime = 0;
+  m_start = esp_timer_get_time();
+  m_stop = 0;
+  m_run = true;
+  if (xTaskCreatePinnedToCore(CANPLAY_task, "CanPlayTask", 4096, (void*)this, 5, &m_task, 1) != pdPASS)
+    {
+    m_task = NULL;
+    m_run = false;
+    fclose(m_file);
+    m_file = NULL;
+    return false;
+    }
+  return true;
+  }
+
+/**
+ * Stop: abort replay, wait up to 2 seconds for the task to finish
+ *  Returns false if the task is still running.
+ */
+bool canplay::Stop()
+  {
+  m_run = false;
+  for (int i = 0; m_task && i < 200; i++)
+    vTaskDelay(10 / portTICK_PERIOD_MS);
+  return (m_task == NULL);
+  }
+
+canbus* canplay::GetBus(int busno)
+  {
+  if (m_target)
+    return m_target;
+  if (busno == 0)
+    busno = 1; // CRTD records without bus number: can1
+  if (busno >= CANPLAY_MAX_BUSES)
+    return NULL;
+  if (!m_buses[busno])
+    {
+    char name[8];
+    snprintf(name, sizeof(name), "can%d", busno);
+    m_buses[busno] = (canbus*)MyPcpApp.FindDeviceByName(name);
+    }
+  return m_buses[busno];
+  }
+
+/**
+ * canplay::ParseLine -- parse a CRTD frame record
+ *    Format: <sec>[.<fraction>] [<bus>]<R|T><11|29> <id> [<byte>...]
+ *    - returns false if the line is not a frame record
+ *    - time: log time [us]
+ *    - busno: bus number, 0 = none given
+ */
+bool canplay::ParseLine(const char* line, int64_t& time, int& busno, bool& rx, CAN_frame_t& frame)
+  {
+  const char* p = line;
+  char* ep;
+
+  // timestamp:
+  uint32_t sec = strtoul(p, &ep, 10);
+  if (ep == p)
+    return false;
+  uint32_t usec = 0;
+  p = ep;
+  if (*p == '.')
+    {
+    int digits = 0;
+    for (p++; isdigit((unsigned char)*p); p++)
+      {
+      if (digits < 6)
+        {
+        usec = usec * 10 + (*p - '0');
+        digits++;
+        }
+      }
+    for (; digits < 6; digits++)
+      usec *= 10;
+    }
+  time = (int64_t)sec * 1000000 + usec;
+  while (*p == ' ' || *p == '\t')
+    p++;
+
+  // record type:
+  busno = 0;
+  while (isdigit((unsigned char)*p))
+    busno = busno * 10 + (*p++ - '0');
+  if (*p != 'R' && *p != 'T')
+    return false;
+  rx = (*p++ == 'R');
+  memset(&frame, 0, sizeof(frame));
+  if (p[0] == '1' && p[1] == '1')
+    frame.FIR.B.FF = CAN_frame_std;
+  else if (p[0] == '2' && p[1] == '9')
+    frame.FIR.B.FF = CAN_frame_ext;
+  else
+    return false;
+  p += 2;
+  if (*p != ' ' && *p != '\t')
+    return false;
+
+  // ID & data:
+  frame.MsgID = strtoul(p, &ep, 16);
+  if (ep == p)
+    return false;
+  p = ep;
+  int dlc = 0;
+  while (dlc < 8)
+    {
+    while (*p == ' ' || *p == '\t')
+      p++;
+    if (!isxdigit((unsigned char)*p))
+      break;
+    frame.data.u8[dlc++] = strtoul(p, &ep, 16);
+    p = ep;
+    }
+  frame.FIR.B.DLC = dlc;
+  return true;
+  }
+
+void canplay::Task()
+  {
+  char line[200];
+  CAN_frame_t frame;
+  int64_t logtime, logstart = -1;
+  int busno;
+  bool rx;
+  uint32_t drops = MyCan.m_listener_drops;
+  uint32_t poolfails = MyCan.m_framepool.m_allocfail;
+
+  ESP_LOGI(TAG, "Replay of '%s' started", m_path.c_str());
+  while (m_run && fgets(line, sizeof(line), m_file))
+    {
+    canbus* bus;
+    if (!ParseLine(line, logtime, busno, rx, frame) || !rx || (bus = GetBus(busno)) == NULL)
+      {
+      m_skipped++;
+      continue;
+      }
+
+    // pacing:
+    if (logstart < 0)
+      logstart = logtime;
+    m_logtime = logtime - logstart;
+    if (m_speed > 0)
+      {
+      // sleep in slices, so a long gap in the log does not block Stop():
+      int64_t due = m_start + (int64_t)(m_logtime / m_speed);
+      int64_t wait;
+      while (m_run && (wait = due - esp_timer_get_time()) >= 1000 * portTICK_PERIOD_MS)
+        vTaskDelay(std::min<int64_t>(wait / 1000, CANPLAY_SLICE_MS) / portTICK_PERIOD_MS);
+      if (!m_run)
+        break;
+      }
+    else if ((m_frames % 500) == 499)
+      {
+      // let lower priority tasks run:
+      vTaskDelay(1);
+      }
+
+    frame.origin = bus;
+    frame.time = 0;
+    MyCan.IncomingFrame(&frame);
+    m_frames++;
+    m_drops = MyCan.m_listener_drops - drops;
+    m_poolfails = MyCan.m_framepool.m_allocfail - poolfails;
+    }
+
+  fclose(m_file);
+  m_file = NULL;
+  m_stop = esp_timer_get_time();
+  float secs = (m_stop - m_start) / 1000000.0f;
+  ESP_LOGI(TAG, "Replay of '%s' %s: %u frames in %.3f s = %.1f fps, %u listener drops, %u pool fails",
+    m_path.c_str(), m_run ? "done" : "aborted", m_frames, secs,
+    (secs > 0) ? m_frames / secs : 0.0f, m_drops, m_poolfails);
+  m_run = false;
+  m_task = NULL;
+  vTaskDelete(NULL);
+  }
+
+
+/**
+ * Shell commands:
+ *    can play start <path> [<speed>] [<bus>]
+ *    can play stop
+ *    can play status
+ */
+
+void can_play_start(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  if (MyCanPlay && MyCanPlay->IsRunning())
+    {
+    writer->puts("Error: replay already running");
+    return;
+    }
+  float speed = (argc > 1) ? atof(argv[1]) : 1;
+  canbus* target = NULL;
+  if (argc > 2)
+    {
+    target = (canbus*)MyPcpApp.FindDeviceByName(argv[2]);
+    if (!target)
+      {
+      writer->puts("Error: Cannot find named CAN bus");
+      return;
+      }
+    }
+  if (!MyCanPlay)
+    MyCanPlay = new canplay();
+  if (!MyCanPlay->Start(argv[0], speed, target))
+    {
+    writer->printf("Error: cannot replay '%s'\n", argv[0]);
+    return;
+    }
+  if (speed > 0)
+    writer->printf("Replaying '%s' at %.2fx speed\n", argv[0], speed);
+  else
+    writer->printf("Replaying '%s' at max speed\n", argv[0]);
+  }
+
+void can_play_stop(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  if (!MyCanPlay || !MyCanPlay->IsRunning())
+    {
+    writer->puts("Error: replay not running");
+    return;
+    }
+  if (MyCanPlay->Stop())
+    writer->puts("Replay stopped");
+  else
+    writer->puts("Error: replay task did not stop in time");
+  }
+
+void can_play_status(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  if (!MyCanPlay)
+    {
+    writer->puts("No replay");
+    return;
+    }
+  int64_t end = MyCanPlay->m_stop ? MyCanPlay->m_stop : esp_timer_get_time();
+  float secs = (end - MyCanPlay->m_start) / 1000000.0f;
+  writer->printf("File:      %s\n", MyCanPlay->m_path.c_str());
+  writer->printf("State:     %s\n", MyCanPlay->IsRunning() ? "running" : "stopped");
+  if (MyCanPlay->m_speed > 0)
+    writer->printf("Speed:     %19.2fx\n", MyCanPlay->m_speed);
+  else
+    writer->printf("Speed:     %20s\n", "max");
+  writer->printf("Frames:    %20u\n", MyCanPlay->m_frames);
+  writer->printf("Skipped:   %20u\n", MyCanPlay->m_skipped);
+  writer->printf("Log time:  %20.3f\n", MyCanPlay->m_logtime / 1000000.0f);
+  writer->printf("Run time:  %20.3f\n", secs);
+  writer->printf("Rate fps:  %20.1f\n", (secs > 0) ? MyCanPlay->m_frames / secs : 0.0f);
+  writer->printf("Lst drops: %20u\n", MyCanPlay->m_drops);
+  writer->printf("Pool fail: %20u\n", MyCanPlay->m_poolfails);
+  }
@@ -0,0 +1,101 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          18th October 2026
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+#ifndef __CANPLAY_H__
+#define __CANPLAY_H__
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <stdio.h>
+#include <string>
+#include "can.h"
+
+#define CANPLAY_MAX_BUSES         10
+#define CANPLAY_SLICE_MS          100   // max pacing sleep between m_run checks
+
+/**
+ * canplay: CRTD log replay
+ *  Reads a CRTD file (as written by canlog_crtd) and injects the received
+ *  frames ("R11" / "R29" records) into the CAN framework via
+ *  can::IncomingFrame(), as if received by the bus given in the record
+ *  (or by a single target bus). Other records are skipped.
+ *  Pacing:
+ *    speed = 1     → original timing
+ *    speed = x     → original timing scaled by factor x
+ *    speed = 0     → as fast as possible
+ *  The replay runs in a separate task and reports frames/s achieved and
+ *  frames lost by listener queues & frame pool during the replay.
+ */
+class canplay
+  {
+  public:
+    canplay();
+    ~canplay();
+
+  public:
+    bool Start(std::string path, float speed, canbus* target=NULL);
+    bool Stop();
+    bool IsRunning() { return (m_task != NULL); }
+    void Task();
+
+  public:
+    static bool ParseLine(const char* line, int64_t& time, int& busno, bool& rx, CAN_frame_t& frame);
+
+  protected:
+    canbus* GetBus(int busno);
+
+  protected:
+    TaskHandle_t        m_task;
+    volatile bool       m_run;
+    FILE*               m_file;
+    canbus*             m_target;
+    canbus*             m_buses[CANPLAY_MAX_BUSES];
+
+  public:
+    std::string         m_path;
+    float               m_speed;          // 0 = max speed
+    uint32_t            m_frames;         // frames injected
+    uint32_t            m_skipped;        // records skipped (non RX / unknown bus / invalid)
+    uint32_t            m_drops;          // listener queue drops during replay
+    uint32_t            m_poolfails;      // frame pool exhaustions during replay
+    int64_t             m_logtime;        // log time span replayed [us]
+    int64_t             m_start;          // replay start [us]
+    int64_t             m_stop;           // replay end [us], 0 = running
+  };
+
+extern canplay* MyCanPlay;
+
+class OvmsWriter;
+class OvmsCommand;
+extern void can_play_start(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv);
+extern void can_play_stop(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv);
+extern void can_play_status(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv);
+
+#endif //#ifndef __CANPLAY_H__
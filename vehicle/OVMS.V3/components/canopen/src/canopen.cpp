@@ -105,7 +105,7 @@ static void CANopenRxTask(void *pvParameters)
 
 void CANopen::CanRxTask()
   {
-  CAN_frame_t frame;
+  CAN_frame_t* frame;
 
   while(1)
     {
@@ -113,12 +113,13 @@ void CANopen::CanRxTask()
       {
       for (int i=0; i < CAN_INTERFACE_CNT; i++)
         {
-        if (m_worker[i] && m_worker[i]->m_bus == frame.origin)
+        if (m_worker[i] && m_worker[i]->m_bus == frame->origin)
           {
-          m_worker[i]->IncomingFrame(&frame);
+          m_worker[i]->IncomingFrame(frame);
           break;
           }
         }
+      MyCan.ReleaseFrame(frame);
       }
     }
   }
@@ -139,9 +140,8 @@ CANopenWorker* CANopen::Start(canbus* bus)
   // start CAN rx task:
   if (m_rxtask == NULL)
     {
-    m_rxqueue = xQueueCreate(20, sizeof(CAN_frame_t));
+    m_rxqueue = xQueueCreate(20, sizeof(CAN_frame_t*));
     xTaskCreatePinnedToCore(CANopenRxTask, "COrx Task", 4096, (void*)this, 5, &m_rxtask, 1);
-    MyCan.RegisterListener(m_rxqueue);
     }
   
   // start worker:
@@ -152,6 +152,7 @@ CANopenWorker* CANopen::Start(canbus* bus)
       m_worker[i] = new CANopenWorker(bus);
       m_workercnt++;
       ESP_LOGI(TAG, "Worker started on %s", bus->GetName());
+      UpdateListener();
       MyEvents.SignalEvent("canopen.worker.start", (void*) m_worker[i]);
       return m_worker[i];
       }
@@ -161,6 +162,22 @@ CANopenWorker* CANopen::Start(canbus* bus)
   }
 
 
+/**
+ * UpdateListener: subscribe to standard frames on all worker buses
+ */
+void CANopen::UpdateListener()
+  {
+  canfilter* filter = new canfilter();
+  for (int i=0; i < CAN_INTERFACE_CNT; i++)
+    {
+    if (m_worker[i])
+      filter->AddBus(m_worker[i]->m_bus);
+    }
+  filter->AddStandard(0x000, 0x7ff);
+  MyCan.RegisterListener(m_rxqueue, filter);
+  }
+
+
 /**
  * Stop: stop CANopenWorker for a CAN bus
  *    - fails if the worker still has clients
@@ -190,6 +207,10 @@ bool CANopen::Stop(canbus* bus)
         m_rxqueue = NULL;
         m_rxtask = NULL;
         }
+      else
+        {
+        UpdateListener();
+        }
       
       return true; // stopped
       }
@@ -387,6 +387,7 @@ class CANopen
   public:
     CANopenWorker* Start(canbus* bus);
     bool Stop(canbus* bus);
+    void UpdateListener();
     CANopenWorker* GetWorker(canbus* bus);
     void StatusReport(int verbosity, OvmsWriter* writer);
 
@@ -381,7 +381,7 @@ CANopenResult_t CANopenWorker::ProcessSendNMTJob()
     {
     // send request:
     m_job.trycnt++;
-    txframe.Write();
+    m_bus->WriteClass(&txframe, CAN_TX_BULK);
     
     // immediate return?
     if (m_job.rxid == 0)
@@ -465,7 +465,7 @@ void CANopenWorker::SendSDORequest()
   memcpy(txframe.data.u8, m_request.byte, 8);
   
   // send:
-  txframe.Write();
+  m_bus->WriteClass(&txframe, CAN_TX_BULK);
   }
 
 
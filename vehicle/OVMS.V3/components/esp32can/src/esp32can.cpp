@@ -38,51 +38,79 @@
 
 #include <string.h>
 #include "esp32can.h"
+#include "esp_timer.h"
 #include "esp32can_regdef.h"
 #include "ovms_peripherals.h"
 
 esp32can* MyESP32can = NULL;
 
-static void ESP32CAN_rxframe(esp32can *me)
+static void ESP32CAN_rxframe(esp32can *me, BaseType_t* task_woken)
   {
-  CAN_msg_t msg;
+  // Fetch all frames available in the hardware RX FIFO into our ring buffer
+  // (the FIFO is drained on every RX interrupt, so normally holds just the
+  // frame that triggered it; all frames fetched get the interrupt time):
+  int64_t rxtime = esp_timer_get_time();
+  while (MODULE_ESP32CAN->SR.B.RBS)
+    {
+    CAN_frame_t* frame = me->m_rxring.PushSlot();
+    if (frame == NULL)
+      {
+      // Ring full: frame lost
+      me->m_status.rxbuf_overflow++;
+      MODULE_ESP32CAN->CMR.B.RRB=1;
+      continue;
+      }
 
-  // Record the origin
-  memset(&msg,0,sizeof(msg));
-  msg.type = CAN_frame;
-  msg.body.frame.origin = me;
+    // Record the origin
+    memset(frame,0,sizeof(*frame));
+    frame->origin = me;
+    frame->time = rxtime;
+
+    //get FIR
+    frame->FIR.U = MODULE_ESP32CAN->MBX_CTRL.FCTRL.FIR.U;
+
+    //check if this is a standard or extended CAN frame
+    if (frame->FIR.B.FF==CAN_frame_std)
+      { // Standard frame
+      //Get Message ID
+      frame->MsgID = ESP32CAN_GET_STD_ID;
+      //deep copy data bytes
+      for (int k=0 ; k<frame->FIR.B.DLC ; k++)
+        frame->data.u8[k] = MODULE_ESP32CAN->MBX_CTRL.FCTRL.TX_RX.STD.data[k];
+      }
+    else
+      { // Extended frame
+      //Get Message ID
+      frame->MsgID = ESP32CAN_GET_EXT_ID;
+      //deep copy data bytes
+      for (int k=0 ; k<frame->FIR.B.DLC ; k++)
+        frame->data.u8[k] = MODULE_ESP32CAN->MBX_CTRL.FCTRL.TX_RX.EXT.data[k];
+      }
 
-  //get FIR
-  msg.body.frame.FIR.U = MODULE_ESP32CAN->MBX_CTRL.FCTRL.FIR.U;
+    me->m_rxring.Push();
 
-  //check if this is a standard or extended CAN frame
-  if (msg.body.frame.FIR.B.FF==CAN_frame_std)
-    { // Standard frame
-    //Get Message ID
-    msg.body.frame.MsgID = ESP32CAN_GET_STD_ID;
-    //deep copy data bytes
-    for (int k=0 ; k<msg.body.frame.FIR.B.DLC ; k++)
-    	msg.body.frame.data.u8[k] = MODULE_ESP32CAN->MBX_CTRL.FCTRL.TX_RX.STD.data[k];
-    }
-  else
-    { // Extended frame
-    //Get Message ID
-    msg.body.frame.MsgID = ESP32CAN_GET_EXT_ID;
-    //deep copy data bytes
-    for (int k=0 ; k<msg.body.frame.FIR.B.DLC ; k++)
-    	msg.body.frame.data.u8[k] = MODULE_ESP32CAN->MBX_CTRL.FCTRL.TX_RX.EXT.data[k];
+    //Let the hardware know the frame has been read.
+    MODULE_ESP32CAN->CMR.B.RRB=1;
     }
 
-  //send frame to main CAN processor task
-  xQueueSendFromISR(MyCan.m_rxqueue,&msg,0);
-
-  //Let the hardware know the frame has been read.
-  MODULE_ESP32CAN->CMR.B.RRB=1;
+  // Wake up main CAN processor task if not already done:
+  // (the flag is set before sending, so a drain running concurrently
+  //  on the other core cannot leave it set without a wakeup pending)
+  if (!me->m_rxring.m_signalled)
+    {
+    CAN_msg_t msg;
+    msg.type = CAN_rxring;
+    msg.body.bus = me;
+    me->m_rxring.m_signalled = true;
+    if (xQueueSendFromISR(MyCan.m_rxqueue, &msg, task_woken) != pdTRUE)
+      me->m_rxring.m_signalled = false;
+    }
   }
 
 static void ESP32CAN_isr(void *pvParameters)
   {
   esp32can *me = (esp32can*)pvParameters;
+  BaseType_t task_woken = pdFALSE;
 
   // Read interrupt status and clear flags
   ESP32CAN_IRQ_t interrupt = (ESP32CAN_IRQ_t)MODULE_ESP32CAN->IR.U;
@@ -94,12 +122,12 @@ static void ESP32CAN_isr(void *pvParameters)
     CAN_msg_t msg;
     msg.type = CAN_txcallback;
     msg.body.bus = me;
-    xQueueSendFromISR(MyCan.m_rxqueue, &msg, 0);
+    xQueueSendFromISR(MyCan.m_rxqueue, &msg, &task_woken);
     }
 
   // Handle RX frame available interrupt
   if ((interrupt & __CAN_IRQ_RX) != 0)
-    ESP32CAN_rxframe(me);
+    ESP32CAN_rxframe(me, &task_woken);
 
   // Handle error interrupts.
   uint8_t error_irqs = interrupt &
@@ -123,7 +151,7 @@ static void ESP32CAN_isr(void *pvParameters)
     CAN_msg_t msg;
     msg.type = CAN_logerror;
     msg.body.bus = me;
-    xQueueSendFromISR(MyCan.m_rxqueue, &msg, 0);
+    xQueueSendFromISR(MyCan.m_rxqueue, &msg, &task_woken);
     }
   
   // Handle wakeup interrupt:
@@ -131,6 +159,10 @@ static void ESP32CAN_isr(void *pvParameters)
     {
     /*handler*/
     }
+
+  // Yield to CanRxTask if it has been woken:
+  if (task_woken == pdTRUE)
+    portYIELD_FROM_ISR();
   }
 
 esp32can::esp32can(const char* name, int txpin, int rxpin)
@@ -138,8 +170,14 @@ esp32can::esp32can(const char* name, int txpin, int rxpin)
   {
   m_txpin = (gpio_num_t)txpin;
   m_rxpin = (gpio_num_t)rxpin;
+  m_acceptcode = 0;
+  m_acceptcare = 0;
+  m_acceptdual = false;
   MyESP32can = this;
 
+  // Allocate ISR RX ring buffer:
+  m_rxring.Init(CAN_RXRING_SIZE);
+
   // Install CAN ISR
   esp_intr_alloc(ETS_CAN_INTR_SOURCE,0,ESP32CAN_isr,this,NULL);
 
@@ -210,15 +248,8 @@ esp_err_t esp32can::Start(CAN_mode_t mode, CAN_speed_t speed)
   // Enable all interrupts
   MODULE_ESP32CAN->IER.U = 0xff;
 
-  // No acceptance filtering, as we want to fetch all messages
-  MODULE_ESP32CAN->MBX_CTRL.ACC.CODE[0] = 0;
-  MODULE_ESP32CAN->MBX_CTRL.ACC.CODE[1] = 0;
-  MODULE_ESP32CAN->MBX_CTRL.ACC.CODE[2] = 0;
-  MODULE_ESP32CAN->MBX_CTRL.ACC.CODE[3] = 0;
-  MODULE_ESP32CAN->MBX_CTRL.ACC.MASK[0] = 0xff;
-  MODULE_ESP32CAN->MBX_CTRL.ACC.MASK[1] = 0xff;
-  MODULE_ESP32CAN->MBX_CTRL.ACC.MASK[2] = 0xff;
-  MODULE_ESP32CAN->MBX_CTRL.ACC.MASK[3] = 0xff;
+  // Acceptance filtering as needed by the CAN consumers
+  SetAcceptanceRegisters();
 
   // Set to normal mode
   MODULE_ESP32CAN->OCR.B.OCMODE=__CAN_OC_NOM;
@@ -245,6 +276,97 @@ esp_err_t esp32can::Start(CAN_mode_t mode, CAN_speed_t speed)
   return ESP_OK;
   }
 
+/**
+ * PlanAcceptanceRegisters: compute acceptance code & mask from m_acceptfilter
+ *  code = ACR0..3 as big endian word, care = inverted AMR0..3 (1 = bit
+ *  must match). Filter modes used:
+ *    - accept all: single filter, all bits don't care
+ *    - std IDs only: dual filter, one std code/mask per filter
+ *    - ext IDs only: single filter, one ext code/mask
+ *    - std & ext: dual filter, std code/mask in filter 1,
+ *      ext ID bits 28-17 in filter 2
+ *  The hardware passes a superset of the IDs needed, CAN listeners
+ *  do the exact filtering.
+ */
+void esp32can::PlanAcceptanceRegisters(uint32_t& code, uint32_t& care, bool& dual)
+  {
+  std::vector<CAN_idmask_t> stdids, extids;
+
+  code = 0;
+  care = 0;
+  dual = false;
+
+  xSemaphoreTakeRecursive(m_acceptmutex, portMAX_DELAY);
+  if (m_acceptfilter
+    && m_acceptfilter->PlanAcceptance(false, m_acceptfilter->HasExtended() ? 1 : 2, stdids)
+    && m_acceptfilter->PlanAcceptance(true, 1, extids))
+    {
+    if (extids.empty() && !stdids.empty())
+      {
+      // dual filter, std: ACR0 = ID10..3, ACR1 7..5 = ID2..0, same in ACR2/ACR3
+      if (stdids.size() == 1)
+        stdids.push_back(stdids[0]);
+      dual = true;
+      code = (stdids[0].code << 21) | (stdids[1].code << 5);
+      care = (stdids[0].mask << 21) | (stdids[1].mask << 5);
+      }
+    else if (stdids.empty() && !extids.empty())
+      {
+      // single filter, ext: ACR0..ACR3 7..3 = ID28..0
+      code = extids[0].code << 3;
+      care = extids[0].mask << 3;
+      }
+    else if (!stdids.empty() && !extids.empty())
+      {
+      // dual filter, std in ACR0/ACR1, ext ID28..13 in ACR2/ACR3,
+      // but ACR3 3..0 is shared with the filter 1 data nibble
+      dual = true;
+      code = (stdids[0].code << 21) | ((extids[0].code >> 13) & 0xfff0);
+      care = (stdids[0].mask << 21) | ((extids[0].mask >> 13) & 0xfff0);
+      }
+    }
+  xSemaphoreGiveRecursive(m_acceptmutex);
+  }
+
+/**
+ * SetAcceptanceRegisters: program acceptance filter (in reset mode)
+ */
+void esp32can::SetAcceptanceRegisters()
+  {
+  PlanAcceptanceRegisters(m_acceptcode, m_acceptcare, m_acceptdual);
+
+  MODULE_ESP32CAN->MOD.B.AFM = m_acceptdual ? 0 : 1;
+  for (int i=0; i<4; i++)
+    {
+    MODULE_ESP32CAN->MBX_CTRL.ACC.CODE[i] = (m_acceptcode >> (24-8*i)) & 0xff;
+    MODULE_ESP32CAN->MBX_CTRL.ACC.MASK[i] = (~m_acceptcare >> (24-8*i)) & 0xff;
+    }
+  }
+
+/**
+ * ApplyAcceptanceFilter: reprogram acceptance filter if changed
+ *  (called by CanRxTask; interrupts are masked while in reset mode)
+ */
+esp_err_t esp32can::ApplyAcceptanceFilter()
+  {
+  if (m_powermode != On)
+    return ESP_OK; // will be applied by Start()
+
+  uint32_t code, care;
+  bool dual;
+  PlanAcceptanceRegisters(code, care, dual);
+  if (code == m_acceptcode && care == m_acceptcare && dual == m_acceptdual)
+    return ESP_OK; // no change
+
+  uint32_t ier = MODULE_ESP32CAN->IER.U;
+  MODULE_ESP32CAN->IER.U = 0;
+  MODULE_ESP32CAN->MOD.B.RM = 1;
+  SetAcceptanceRegisters();
+  MODULE_ESP32CAN->MOD.B.RM = 0;
+  MODULE_ESP32CAN->IER.U = ier;
+  return ESP_OK;
+  }
+
 esp_err_t esp32can::Stop()
   {
 #ifdef CONFIG_OVMS_COMP_MAX7317
@@ -261,13 +383,13 @@ esp_err_t esp32can::Stop()
   return ESP_OK;
   }
 
-esp_err_t esp32can::Write(const CAN_frame_t* p_frame, TickType_t maxqueuewait /*=0*/)
+esp_err_t esp32can::TxFrame(const CAN_frame_t* p_frame)
   {
   uint8_t __byte_i; // Byte iterator
   
   // check if TX buffer is available:
   if(MODULE_ESP32CAN->SR.B.TBS == 0)
-    return QueueWrite(p_frame, maxqueuewait);
+    return ESP_FAIL;
 
   // copy frame information record
   MODULE_ESP32CAN->MBX_CTRL.FCTRL.FIR.U=p_frame->FIR.U;
@@ -292,20 +414,9 @@ esp_err_t esp32can::Write(const CAN_frame_t* p_frame, TickType_t maxqueuewait /*
   // Transmit frame
   MODULE_ESP32CAN->CMR.B.TR=1;
 
-  // stats & logging:
-  canbus::Write(p_frame, maxqueuewait);
-  
   return ESP_OK;
   }
 
-void esp32can::TxCallback()
-  {
-  // TX buffer has become available; send next queued frame (if any):
-  CAN_frame_t frame;
-  if (xQueueReceive(m_txqueue, (void*)&frame, 0) == pdTRUE)
-    Write(&frame, 0);
-  }
-
 void esp32can::SetPowerMode(PowerMode powermode)
   {
   pcp::SetPowerMode(powermode);
@@ -56,10 +56,10 @@ class esp32can : public canbus
   public:
     esp_err_t Start(CAN_mode_t mode, CAN_speed_t speed);
     esp_err_t Stop();
+    esp_err_t ApplyAcceptanceFilter();
 
-  public:
-    esp_err_t Write(const CAN_frame_t* p_frame, TickType_t maxqueuewait=0);
-    void TxCallback();
+  protected:
+    esp_err_t TxFrame(const CAN_frame_t* p_frame);
 
   public:
     void SetPowerMode(PowerMode powermode);
@@ -67,6 +67,13 @@ class esp32can : public canbus
   public:
     gpio_num_t m_txpin;               // TX pin
     gpio_num_t m_rxpin;               // RX pin
+
+  protected:
+    void PlanAcceptanceRegisters(uint32_t& code, uint32_t& care, bool& dual);
+    void SetAcceptanceRegisters();
+    uint32_t m_acceptcode;            // ACR0..3 as programmed (big endian word)
+    uint32_t m_acceptcare;            // inverted AMR0..3 as programmed
+    bool m_acceptdual;                // dual filter mode
   };
 
 #endif //#ifndef __ESP32CAN_H__
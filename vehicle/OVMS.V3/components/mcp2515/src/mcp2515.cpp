@@ -36,6 +36,7 @@ static const char *TAG = "mcp2515";
 #include "soc/gpio_struct.h"
 #include "driver/gpio.h"
 #include "esp_intr.h"
+#include "esp_timer.h"
 #include "soc/dport_reg.h"
 
 static void MCP2515_isr(void *pvParameters)
@@ -48,6 +49,7 @@ static void MCP2515_isr(void *pvParameters)
   CAN_msg_t msg;
   msg.type = CAN_rxcallback;
   msg.body.bus = me;
+  msg.time = esp_timer_get_time();
 
   //send callback request to main CAN processor task
   xQueueSendFromISR(MyCan.m_rxqueue,&msg,0);
@@ -61,6 +63,8 @@ mcp2515::mcp2515(const char* name, spi* spibus, spi_nodma_host_device_t host, in
   m_clockspeed = clockspeed;
   m_cspin = cspin;
   m_intpin = intpin;
+  memset(m_acceptregs, 0, sizeof(m_acceptregs));
+  m_acceptfiltered = false;
 
   memset(&m_devcfg, 0, sizeof(spi_nodma_device_interface_config_t));
   m_devcfg.clock_speed_hz=m_clockspeed;     // Clock speed (in hz)
@@ -103,8 +107,8 @@ esp_err_t mcp2515::Start(CAN_mode_t mode, CAN_speed_t speed)
   m_spibus->spi_cmd(m_spi, buf, 0, 3, CMD_WRITE, 0x0f, 0b10011000);
   vTaskDelay(50 / portTICK_PERIOD_MS);
 
-  // Rx Buffer 0 control (receive all and enable buffer 1 rollover)
-  m_spibus->spi_cmd(m_spi, buf, 0, 3, CMD_WRITE, 0x60, 0b01100100);
+  // Rx Buffer 0/1 control & acceptance filters
+  SetAcceptanceRegisters();
 
   // CANINTE (interrupt enable), all interrupts
   m_spibus->spi_cmd(m_spi, buf, 0, 3, CMD_WRITE, 0x2b, 0b11111111);
@@ -145,6 +149,149 @@ esp_err_t mcp2515::Start(CAN_mode_t mode, CAN_speed_t speed)
   return ESP_OK;
   }
 
+// Encode ID or mask into SIDH, SIDL, EID8, EID0 register layout:
+static void MCP2515_encodeid(uint8_t* reg, uint32_t id, bool extended, bool filter)
+  {
+  if (!extended)
+    {
+    reg[0] = id >> 3;
+    reg[1] = (id << 5) & 0xe0;
+    reg[2] = 0;                       // mask 0: don't compare data bytes
+    reg[3] = 0;
+    }
+  else
+    {
+    reg[0] = (id >> 21) & 0xff;
+    reg[1] = ((id >> 13) & 0xe0) + ((id >> 16) & 0x03) + (filter ? 0x08 : 0);
+    reg[2] = (id >> 8) & 0xff;
+    reg[3] = id & 0xff;
+    }
+  }
+
+// Encode a filter group sharing one mask:
+static void MCP2515_encodegroup(uint8_t regs[8][4], int maskreg, const int* filterreg, int filtercnt,
+  std::vector<CAN_idmask_t>& list, bool extended)
+  {
+  uint32_t mask = 0xffffffff;
+  for (auto& m : list)
+    mask &= m.mask;
+  MCP2515_encodeid(regs[maskreg], mask, extended, false);
+  for (int i = 0; i < filtercnt; i++)
+    MCP2515_encodeid(regs[filterreg[i]], list[i % list.size()].code & mask, extended, true);
+  }
+
+/**
+ * PlanAcceptanceRegisters: compute filter & mask registers from m_acceptfilter
+ *  RXB0 has mask RXM0 for filters RXF0-1, RXB1 has RXM1 for RXF2-5, all
+ *  filters of a buffer share the mask. Standard IDs are assigned to RXB0,
+ *  extended IDs to RXB1; if only one format is needed, both buffers get it.
+ *  The hardware passes a superset of the IDs needed, CAN listeners
+ *  do the exact filtering.
+ */
+void mcp2515::PlanAcceptanceRegisters(uint8_t regs[8][4], bool& filtered)
+  {
+  // register index: RXF0..5 = 0..5, RXM0..1 = 6..7
+  static const int rxb0_filters[2] = { 0, 1 };
+  static const int rxb1_filters[4] = { 2, 3, 4, 5 };
+  std::vector<CAN_idmask_t> stdids, extids;
+
+  memset(regs, 0, 8*4);
+  xSemaphoreTakeRecursive(m_acceptmutex, portMAX_DELAY);
+  filtered = (m_acceptfilter
+    && m_acceptfilter->PlanAcceptance(false, 2, stdids)
+    && m_acceptfilter->PlanAcceptance(true, 4, extids)
+    && !(stdids.empty() && extids.empty()));
+  xSemaphoreGiveRecursive(m_acceptmutex);
+  if (!filtered)
+    return;
+
+  if (!stdids.empty())
+    MCP2515_encodegroup(regs, 6, rxb0_filters, 2, stdids, false);
+  else
+    MCP2515_encodegroup(regs, 6, rxb0_filters, 2, extids, true);
+
+  if (!extids.empty())
+    MCP2515_encodegroup(regs, 7, rxb1_filters, 4, extids, true);
+  else
+    MCP2515_encodegroup(regs, 7, rxb1_filters, 4, stdids, false);
+  }
+
+/**
+ * SetAcceptanceRegisters: program acceptance filters (in CONFIG mode)
+ */
+void mcp2515::SetAcceptanceRegisters()
+  {
+  static const uint8_t regaddr[8] = { 0x00, 0x04, 0x08, 0x10, 0x14, 0x18, 0x20, 0x24 };
+  uint8_t buf[16];
+
+  PlanAcceptanceRegisters(m_acceptregs, m_acceptfiltered);
+
+  for (int i = 0; i < 8; i++)
+    {
+    uint8_t* r = m_acceptregs[i];
+    m_spibus->spi_cmd(m_spi, buf, 0, 6, CMD_WRITE, regaddr[i], r[0], r[1], r[2], r[3]);
+    }
+
+  // Rx Buffer 0 control (receive all or filtered, enable buffer 1 rollover)
+  m_spibus->spi_cmd(m_spi, buf, 0, 3, CMD_WRITE, 0x60, m_acceptfiltered ? 0b00000100 : 0b01100100);
+  // Rx Buffer 1 control (receive all or filtered)
+  m_spibus->spi_cmd(m_spi, buf, 0, 3, CMD_WRITE, 0x70, m_acceptfiltered ? 0b00000000 : 0b01100000);
+  }
+
+/**
+ * SetOpMode: request operation mode (CANCTRL) & wait for CANSTAT.OPMOD
+ *  The mode change is done after the frame currently on the bus,
+ *  returns false if the controller did not switch in time.
+ */
+bool mcp2515::SetOpMode(uint8_t canctrl)
+  {
+  uint8_t buf[16];
+  m_spibus->spi_cmd(m_spi, buf, 0, 3, CMD_WRITE, 0x0f, canctrl);
+  for (int i = 0; i < 10; i++)
+    {
+    uint8_t *p = m_spibus->spi_cmd(m_spi, buf, 1, 2, CMD_READ, 0x0e);
+    if ((p[0] & 0xe0) == (canctrl & 0xe0))
+      return true;
+    vTaskDelay(1);
+    }
+  return false;
+  }
+
+/**
+ * ApplyAcceptanceFilter: reprogram acceptance filters if changed
+ *  (called by CanRxTask, so SPI access is serialized with RX handling)
+ */
+esp_err_t mcp2515::ApplyAcceptanceFilter()
+  {
+  if (m_powermode != On)
+    return ESP_OK; // will be applied by Start()
+
+  uint8_t regs[8][4];
+  bool filtered;
+  PlanAcceptanceRegisters(regs, filtered);
+  if (filtered == m_acceptfiltered && memcmp(regs, m_acceptregs, sizeof(regs)) == 0)
+    return ESP_OK; // no change
+
+  // Set CONFIG mode, filter registers can only be written in CONFIG mode:
+  if (!SetOpMode(0b10000000))
+    {
+    ESP_LOGE(TAG, "%s: CONFIG mode not entered, acceptance filters unchanged", GetName());
+    SetOpMode(0x00);
+    return ESP_FAIL;
+    }
+
+  SetAcceptanceRegisters();
+
+  // Set NORMAL mode
+  if (!SetOpMode(0x00))
+    {
+    ESP_LOGE(TAG, "%s: NORMAL mode not entered after filter change", GetName());
+    return ESP_FAIL;
+    }
+
+  return ESP_OK;
+  }
+
 esp_err_t mcp2515::Stop()
   {
   uint8_t buf[16];
@@ -165,7 +312,7 @@ esp_err_t mcp2515::Stop()
   return ESP_OK;
   }
 
-esp_err_t mcp2515::Write(const CAN_frame_t* p_frame, TickType_t maxqueuewait /*=0*/)
+esp_err_t mcp2515::TxFrame(const CAN_frame_t* p_frame)
   {
   uint8_t buf[16];
   uint8_t id[4];
@@ -177,7 +324,7 @@ esp_err_t mcp2515::Write(const CAN_frame_t* p_frame, TickType_t maxqueuewait /*=
   if((p[0] & 0b01010100) == 0)  // any buffers busy?
     txbuf = 0b000;  // all clear - use TxB0
   else
-    return QueueWrite(p_frame, maxqueuewait);  // otherwise, queue the frame and wait.  Single frame at a time!
+    return ESP_FAIL;  // otherwise, let the scheduler queue the frame.  Single frame at a time!
 
   if (p_frame->FIR.B.FF == CAN_frame_std)
     {
@@ -213,9 +360,6 @@ esp_err_t mcp2515::Write(const CAN_frame_t* p_frame, TickType_t maxqueuewait /*=
   // MCP2515 request to send:
   m_spibus->spi_cmd(m_spi, buf, 0, 1, CMD_RTS | (txbuf ? txbuf : 0b001));
 
-  // stats & logging:
-  canbus::Write(p_frame, maxqueuewait);
-  
   return ESP_OK;
   }
 
@@ -257,6 +401,7 @@ bool mcp2515::RxCallback(CAN_frame_t* frame)
     // The indicated RX buffer has a message to be read
     memset(frame,0,sizeof(*frame));
     frame->origin = this;
+    frame->time = esp_timer_get_time();
     
     // read RX buffer and clear interrupt flag:
     uint8_t *p = m_spibus->spi_cmd(m_spi, buf, 13, 1, CMD_READ_RXBUF + ((intflag==1) ? 0 : 4));
@@ -288,8 +433,7 @@ bool mcp2515::RxCallback(CAN_frame_t* frame)
     // some TX buffers have become available; clear IRQs and fill up:
     m_spibus->spi_cmd(m_spi, buf, 0, 4, CMD_BITMODIFY, 0x2c, intstat & 0b00011100, 0x00);
   
-    if(xQueueReceive(m_txqueue, (void*)frame, 0) == pdTRUE)  // if any queued for later?
-      Write(frame, 0);  // if so, send one
+    TxSchedule();  // send queued frames (if any)
     }
   
   if (intstat & 0b10100000)
@@ -56,11 +56,14 @@ class mcp2515 : public canbus
   public:
     esp_err_t Start(CAN_mode_t mode, CAN_speed_t speed);
     esp_err_t Stop();
+    esp_err_t ApplyAcceptanceFilter();
 
   public:
-    esp_err_t Write(const CAN_frame_t* p_frame, TickType_t maxqueuewait=0);
     virtual bool RxCallback(CAN_frame_t* frame);
 
+  protected:
+    esp_err_t TxFrame(const CAN_frame_t* p_frame);
+
   public:
     virtual void SetPowerMode(PowerMode powermode);
 
@@ -74,6 +77,13 @@ class mcp2515 : public canbus
     int m_clockspeed;
     int m_cspin;
     int m_intpin;
+
+  protected:
+    bool SetOpMode(uint8_t canctrl);
+    void PlanAcceptanceRegisters(uint8_t regs[8][4], bool& filtered);
+    void SetAcceptanceRegisters();
+    uint8_t m_acceptregs[8][4];       // RXF0..5, RXM0..1 as programmed
+    bool m_acceptfiltered;            // filters enabled
   };
 
 #endif //#ifndef __MCP2515_H__
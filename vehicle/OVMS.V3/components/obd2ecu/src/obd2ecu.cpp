@@ -34,6 +34,7 @@ static const char *TAG = "obd2ecu";
 
 #include <string.h>
 #include <dirent.h>
+#include "esp_timer.h"
 #include "obd2ecu.h"
 #include "ovms_script.h"
 #include "ovms_config.h"
@@ -149,13 +150,27 @@ static void OBD2ECU_task(void *pvParameters)
   {
   obd2ecu *me = (obd2ecu*)pvParameters;
 
-  CAN_frame_t frame;
+  CAN_frame_t* frame;
   while(1)
     {
-    if (xQueueReceive(me->m_rxqueue, &frame, (portTickType)portMAX_DELAY)==pdTRUE)
+    // ISO-TP timeouts & consecutive frames are handled by this task:
+    TickType_t wait = portMAX_DELAY;
+    int64_t due = me->m_isotp.GetNextTimeout();
+    if (due && esp_timer_get_time() >= due)
+      {
+      me->m_isotp.CheckTimeouts();
+      due = me->m_isotp.GetNextTimeout();
+      }
+    if (due)
+      {
+      int64_t dt = due - esp_timer_get_time();
+      wait = (dt > 0) ? (dt + portTICK_PERIOD_MS * 1000 - 1) / (portTICK_PERIOD_MS * 1000) : 0;
+      }
+    if (xQueueReceive(me->m_rxqueue, &frame, wait)==pdTRUE)
       {
       // Only handle incoming frames on our CAN bus
-      if (frame.origin == me->m_can) me->IncomingFrame(&frame);
+      if (frame->origin == me->m_can) me->IncomingFrame(frame);
+      MyCan.ReleaseFrame(frame);
       }
     }
   }
@@ -166,7 +181,7 @@ obd2ecu::obd2ecu(const char* name, canbus* can)
   m_can = can;
   xTaskCreatePinnedToCore(OBD2ECU_task, "OBDII ECU Task", 6144, (void*)this, 5, &m_task, 1);
  
-  m_rxqueue = xQueueCreate(20,sizeof(CAN_frame_t));
+  m_rxqueue = xQueueCreate(20,sizeof(CAN_frame_t*));
 
   m_can->Start(CAN_MODE_ACTIVE,CAN_SPEED_500KBPS);
   m_can->SetPowerMode(On);
@@ -175,7 +190,18 @@ obd2ecu::obd2ecu(const char* name, canbus* can)
 
   LoadMap();
 
-  MyCan.RegisterListener(m_rxqueue);
+  // ISO-TP sessions for multi frame responses, flow control is received on the response ID - 8:
+  m_isotp.Open(m_can, RESPONSE_PID, FLOWCONTROL_PID)->m_txclass = CAN_TX_RESPONSE;
+  m_isotp.Open(m_can, RESPONSE_EXT_PID, FLOWCONTROL_EXT_PID)->m_txclass = CAN_TX_RESPONSE;
+
+  // Subscribe to requests & flow control frames on our bus:
+  canfilter* filter = new canfilter();
+  filter->AddBus(m_can);
+  filter->AddStandard(REQUEST_PID);
+  filter->AddStandard(FLOWCONTROL_PID);
+  filter->AddExtended(REQUEST_EXT_PID);
+  filter->AddExtended(FLOWCONTROL_EXT_PID);
+  MyCan.RegisterListener(m_rxqueue, filter);
   }
 
 obd2ecu::~obd2ecu()
@@ -473,6 +499,7 @@ void obd2ecu::IncomingFrame(CAN_frame_t* p_frame)
   uint8_t mapped_pid;
   float metric;
   char rtn_string[21];
+  uint8_t msg[24];  /* multi frame response message */
 
   uint8_t *p_d = p_frame->data.u8;  /* Incoming frame data from HUD / Dongle */
   uint8_t *r_d = r_frame.data.u8;  /* Response frame data being sent back to HUD / Dongle */
@@ -487,9 +514,9 @@ void obd2ecu::IncomingFrame(CAN_frame_t* p_frame)
   else if (p_frame->MsgID == REQUEST_EXT_PID) reply = RESPONSE_EXT_PID;
        else
        { /* check for flow control frames - they're received on the response MsgID minus 8 */
-         if ((p_frame->MsgID == FLOWCONTROL_PID || p_frame->MsgID == FLOWCONTROL_EXT_PID) && p_frame->data.u8[0] == 0x30)
-         {  ESP_LOGD(TAG, "flow control frame - ignored");
-           return;  /* ignore it.  We just sleep for a bit instead */
+         if (m_isotp.IncomingFrame(p_frame))
+         {  ESP_LOGD(TAG, "flow control frame");
+           return;  /* ISO-TP engine sends the consecutive frames */
          }
          /* if none of the above, no idea what it is.  Ignore */
          ESP_LOGD(TAG, "unknown MsgID %x",p_frame->MsgID);
@@ -530,7 +557,7 @@ void obd2ecu::IncomingFrame(CAN_frame_t* p_frame)
           r_d[5] = (m_supported_01_20 >> 8) & 0xff;
           r_d[6] =  m_supported_01_20 & 0xff;
           r_d[7] = 0x55;  /* pad 0x55 */
-          m_can->Write(&r_frame);
+          m_can->WriteClass(&r_frame, CAN_TX_RESPONSE);
           break;
           
         case 1: /* request status since DTC Cleared */
@@ -548,7 +575,7 @@ void obd2ecu::IncomingFrame(CAN_frame_t* p_frame)
           r_d[5] = 0x00; 
           r_d[6] = 0x00;  
           r_d[7] = 0xff;  /* nothing ready yet (or ever) */
-          m_can->Write(&r_frame);
+          m_can->WriteClass(&r_frame, CAN_TX_RESPONSE);
           break;
           
         case 0x0c:	/* Engine RPM */
@@ -562,7 +589,7 @@ void obd2ecu::IncomingFrame(CAN_frame_t* p_frame)
           }
           
           FillFrame(&r_frame,reply,mapped_pid,metric,pid_format[mapped_pid]);
-          m_can->Write(&r_frame);
+          m_can->WriteClass(&r_frame, CAN_TX_RESPONSE);
           break;
 
         case 0x10:	/* MAF (Mass Air flow) rate - Map to SoC */
@@ -573,7 +600,7 @@ void obd2ecu::IncomingFrame(CAN_frame_t* p_frame)
           
           if(m_pidmap[mapped_pid]->GetType() != obd2pid::Script) metric = metric*3.0;
           FillFrame(&r_frame,reply,mapped_pid,metric,pid_format[mapped_pid]);
-          m_can->Write(&r_frame);
+          m_can->WriteClass(&r_frame, CAN_TX_RESPONSE);
           break;
 			
         case 0x20:  /* request more capabilities, PIDs 0x21 - 0x40 */
@@ -590,7 +617,7 @@ void obd2ecu::IncomingFrame(CAN_frame_t* p_frame)
           r_d[5] = (m_supported_21_40 >> 8) & 0xff;
           r_d[6] =  m_supported_21_40 & 0xff;
           r_d[7] = 0x55;  /* pad 0x55 */
-          m_can->Write(&r_frame);
+          m_can->WriteClass(&r_frame, CAN_TX_RESPONSE);
           break;
           
         case 0x40:  /* request more capabilities: none 
@@ -608,7 +635,7 @@ void obd2ecu::IncomingFrame(CAN_frame_t* p_frame)
           r_d[5] = 0x00;
           r_d[6] = 0x00;	
           r_d[7] = 0x55;  /* pad 0x55 */
-          m_can->Write(&r_frame);
+          m_can->WriteClass(&r_frame, CAN_TX_RESPONSE);
           break;
           
         default:  /* most PIDs get processed here */
@@ -618,7 +645,7 @@ void obd2ecu::IncomingFrame(CAN_frame_t* p_frame)
           }
           
           FillFrame(&r_frame,reply,mapped_pid,metric,pid_format[mapped_pid]);
-          m_can->Write(&r_frame);
+          m_can->WriteClass(&r_frame, CAN_TX_RESPONSE);
           
 	}
       break;
@@ -637,31 +664,11 @@ void obd2ecu::IncomingFrame(CAN_frame_t* p_frame)
           memcpy(rtn_string,StandardMetrics.ms_v_vin->AsString().c_str(),17);
           rtn_string[17] = '\0';  /* force null termination, just because */
             
-          r_frame.origin = NULL;
-          r_frame.FIR.U = 0;
-          r_frame.FIR.B.DLC = 8;
-          r_frame.FIR.B.FF = CAN_frame_format_t (reply != RESPONSE_PID);
-          r_frame.MsgID = reply;
-          r_d[0] = 0x10;  /* not sure what this is for */
-          r_d[1] = 0x14;  /* overall length, starting with next byte, not including pad */
-          r_d[2] = 0x49;  /* Mode 9 reply */
-          r_d[3] = 0x02;  /* PID */
-          r_d[4] = 0x01;  /* not sure what this is for */
-          memcpy(&r_d[5],rtn_string,3);  /* grab the first 3 bytes of VIN */
-
-          m_can->Write(&r_frame);
-
-          vTaskDelay(10 / portTICK_PERIOD_MS);  /* let the flow control frame pass */
-          
-          r_d[0] = 0x21;
-          memcpy(&r_d[1],rtn_string+3,7);  /* grab the next 7 bytes of VIN */
-          
-          m_can->Write(&r_frame);
-
-          r_d[0] = 0x22;
-          memcpy(&r_d[1],rtn_string+10,7);  /* grab the last 7 bytes of VIN */
-
-          m_can->Write(&r_frame);
+          msg[0] = 0x49;  /* Mode 9 reply */
+          msg[1] = 0x02;  /* PID */
+          msg[2] = 0x01;  /* number of data items */
+          memcpy(msg+3,rtn_string,17);
+          m_isotp.Send(m_isotp.Find(m_can,reply,(reply == RESPONSE_PID) ? FLOWCONTROL_PID : FLOWCONTROL_EXT_PID),msg,20);
           
           break;
                        
@@ -674,41 +681,11 @@ void obd2ecu::IncomingFrame(CAN_frame_t* p_frame)
 
           for(int i=strlen(rtn_string);i<20;i++) rtn_string[i] = '\0';  // zero pad string, per spec
           
-          r_frame.origin = NULL;
-          r_frame.FIR.U = 0;
-          r_frame.FIR.B.DLC = 8;
-          r_frame.FIR.B.FF = CAN_frame_format_t (reply != RESPONSE_PID);
-          r_frame.MsgID = reply;					
-          r_d[0] = 0x10;  /* not sure what this is for */
-          r_d[1] = 0x17;  /* overall length, starting with next byte, not including pad */
-          r_d[2] = 0x49;  /* Mode 9 reply */
-          r_d[3] = 0x0a;  /* PID */
-          r_d[4] = 0x01;  /* not sure what this is for */
-          memcpy(&r_d[5],rtn_string,3);  /* grab the first 3 bytes of Vehicle ID */
-
-          m_can->Write(&r_frame);
-
-          vTaskDelay(10 / portTICK_PERIOD_MS);  /* let the flow control frame pass */
-          
-          r_d[0] = 0x21;
-          memcpy(&r_d[1],rtn_string+3,7);  /* grab the next 7 bytes of Vehicle ID */
-
-          m_can->Write(&r_frame);
-          
-          r_d[0] = 0x22;
-          memcpy(&r_d[1],rtn_string+10,7);  /* grab next 7 bytes of Vehicle ID */
-
-          m_can->Write(&r_frame);
-
-          r_d[0] = 0x23;
-          memcpy(&r_d[1],rtn_string+17,3);  /* grab last 3 bytes of Vehicle ID */
-
-          r_d[4] = 0x00;  /* Spec says 0 Pad... */
-          r_d[5] = 0x00;
-          r_d[6] = 0x00;
-          r_d[7] = 0x00;
-          
-          m_can->Write(&r_frame);
+          msg[0] = 0x49;  /* Mode 9 reply */
+          msg[1] = 0x0a;  /* PID */
+          msg[2] = 0x01;  /* number of data items */
+          memcpy(msg+3,rtn_string,20);
+          m_isotp.Send(m_isotp.Find(m_can,reply,(reply == RESPONSE_PID) ? FLOWCONTROL_PID : FLOWCONTROL_EXT_PID),msg,23);
           
           break;
 
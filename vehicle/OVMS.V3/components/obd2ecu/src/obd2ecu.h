@@ -36,6 +36,7 @@
 #include "freertos/task.h"
 #include "pcp.h"
 #include "can.h"
+#include "canisotp.h"
 #include "ovms_metrics.h"
 
 class obd2pid
@@ -92,6 +93,7 @@ class obd2ecu : public pcp
     PidMap m_pidmap;
     uint32_t m_supported_01_20;  // bitmap of PIDs configured 0x01 through 0x20
     uint32_t m_supported_21_40;  // bitmap of PIDs configured 0x21 through 0x40
+    canisotp m_isotp;            // multi frame responses (mode 9)
 
   public:
     void IncomingFrame(CAN_frame_t* p_frame);
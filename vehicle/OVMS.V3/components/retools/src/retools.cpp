@@ -46,14 +46,14 @@ static void RE_task(void *pvParameters)
 
 void re::Task()
   {
-  CAN_frame_t frame;
+  CAN_frame_t* frame;
 
   while(1)
     {
     if (xQueueReceive(m_rxqueue, &frame, (portTickType)portMAX_DELAY)==pdTRUE)
       {
       xSemaphoreTake(m_mutex, portMAX_DELAY);
-      std::string key = GetKey(&frame);
+      std::string key = GetKey(frame);
       auto k = m_rmap.find(key);
       re_record_t* r;
       if (m_rmap.size() == 0) m_started = monotonictime;
@@ -62,17 +62,19 @@ void re::Task()
         r = k->second;
         r = new re_record_t;
         memset(r,0,sizeof(re_record_t));
+        r->first = frame->time;
         m_rmap[key] = r;
         }
       else
         {
         r = k->second;
         }
-      memcpy(&r->last,&frame,sizeof(frame));
+      memcpy(&r->last,frame,sizeof(*frame));
       r->rxcount++;
       m_finished = monotonictime;
       // ESP_LOGI(TAG,"rx Key=%s Count=%d",key.c_str(),r->rxcount);
       xSemaphoreGive(m_mutex);
+      MyCan.ReleaseFrame(frame);
       }
     }
   }
@@ -156,7 +158,7 @@ re::re(const char* name)
   m_finished = monotonictime;
   xTaskCreatePinnedToCore(RE_task, "RE Task", 4096, (void*)this, 5, &m_task, 1);
   m_mutex = xSemaphoreCreateMutex();
-  m_rxqueue = xQueueCreate(20,sizeof(CAN_frame_t));
+  m_rxqueue = xQueueCreate(20,sizeof(CAN_frame_t*));
   MyCan.RegisterListener(m_rxqueue);
   }
 
@@ -261,8 +263,13 @@ void re_list(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, cons
       s += sprintf(s, "%02x ", it->second->last.data.u8[k]);
     if ((argc==0)||(strstr(it->first.c_str(),argv[0])))
       {
+      // average interval from frame reception times if available:
+      re_record_t* r = it->second;
+      uint32_t interval = (tdiff/r->rxcount);
+      if (r->rxcount > 1 && r->first && r->last.time > r->first)
+        interval = (r->last.time - r->first) / (r->rxcount-1) / 1000;
       writer->printf("%-20s %10d %6d %s\n",
-        it->first.c_str(),it->second->rxcount,(tdiff/it->second->rxcount),vbuf);
+        it->first.c_str(),r->rxcount,interval,vbuf);
       }
     }  
   MyRE->Unlock();
@@ -43,6 +43,7 @@ typedef struct
   {
   CAN_frame_t last;
   uint32_t rxcount;
+  int64_t first;          // reception time of first frame [us]
   } re_record_t;
 
 typedef std::map<uint32_t, uint8_t> re_id_map_t;
@@ -0,0 +1,350 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          18th October 2026
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+#include "ovms_log.h"
+static const char *TAG = "vcan";
+
+#include <string.h>
+#include <stdlib.h>
+#include "esp_timer.h"
+#include "vcan.h"
+#include "ovms_command.h"
+
+vcan* MyVcan = NULL;
+
+static void VCAN_gentask(void *pvParameters)
+  {
+  vcan *me = (vcan*)pvParameters;
+  me->GenTask();
+  }
+
+vcan::vcan(const char* name)
+  : canbus(name)
+  {
+  MyVcan = this;
+  m_rxmux = portMUX_INITIALIZER_UNLOCKED;
+  m_rxring.Init(CAN_RXRING_SIZE);
+  m_gen_task = NULL;
+  m_gen_run = false;
+  m_gen_fps = 0;
+  m_gen_count = 0;
+  m_gen_idfrom = 0;
+  m_gen_idto = 0;
+  m_gen_dlc = 8;
+  m_gen_sent = 0;
+  m_gen_lost = 0;
+  m_gen_start = 0;
+  m_gen_stop = 0;
+  m_powermode = Off;
+  }
+
+vcan::~vcan()
+  {
+  GenStop();
+  MyVcan = NULL;
+  }
+
+esp_err_t vcan::Start(CAN_mode_t mode, CAN_speed_t speed)
+  {
+  canbus::Start(mode, speed);
+  m_mode = mode;
+  m_speed = speed;
+  pcp::SetPowerMode(On);
+  return ESP_OK;
+  }
+
+esp_err_t vcan::Stop()
+  {
+  GenStop();
+  pcp::SetPowerMode(Off);
+  return ESP_OK;
+  }
+
+void vcan::SetPowerMode(PowerMode powermode)
+  {
+  pcp::SetPowerMode(powermode);
+  switch (powermode)
+    {
+    case On:
+      if (m_mode != CAN_MODE_OFF) Start(m_mode,m_speed);
+      break;
+    case Sleep:
+    case DeepSleep:
+    case Off:
+      Stop();
+      break;
+    default:
+      break;
+    };
+  }
+
+/**
+ * vcan::Inject -- feed a frame into the RX path
+ *    - may be called from any task (not from ISRs)
+ *    - returns false if the RX ring is full (frame lost)
+ */
+bool vcan::Inject(const CAN_frame_t* p_frame)
+  {
+  int64_t now = esp_timer_get_time();
+
+  portENTER_CRITICAL(&m_rxmux);
+  CAN_frame_t* frame = m_rxring.PushSlot();
+  bool wakeup = false;
+  if (frame)
+    {
+    *frame = *p_frame;
+    frame->origin = this;
+    frame->time = now;
+    m_rxring.Push();
+    // Claim the wakeup before sending it, so a drain running between the
+    // send and the flag update cannot leave the flag set:
+    wakeup = !m_rxring.m_signalled;
+    m_rxring.m_signalled = true;
+    }
+  else
+    {
+    m_status.rxbuf_overflow++;
+    }
+  portEXIT_CRITICAL(&m_rxmux);
+  if (!frame)
+    return false;
+
+  // Wake up main CAN processor task if not already done:
+  if (wakeup)
+    {
+    CAN_msg_t msg;
+    msg.type = CAN_rxring;
+    msg.body.bus = this;
+    if (xQueueSend(MyCan.m_rxqueue, &msg, 0) != pdTRUE)
+      m_rxring.m_signalled = false;
+    }
+  return true;
+  }
+
+/**
+ * vcan::TxFrame -- "transmit" a frame: loop back into RX path
+ */
+esp_err_t vcan::TxFrame(const CAN_frame_t* p_frame)
+  {
+  if (m_powermode != On || m_mode == CAN_MODE_OFF)
+    return ESP_FAIL;
+  Inject(p_frame);
+  return ESP_OK;
+  }
+
+/**
+ * vcan::GenStart -- start traffic generator
+ *    - fps: frames per second, 0 = max speed (limited by RX ring drain rate)
+ *    - count: number of frames, 0 = unlimited
+ *    - idfrom..idto: IDs are cycled through this range, > 0x7ff = extended
+ *    - payload: frame sequence number (little endian), padded with zeros
+ */
+bool vcan::GenStart(uint32_t fps, uint32_t count, uint32_t idfrom, uint32_t idto, uint8_t dlc)
+  {
+  if (m_gen_task || m_powermode != On || m_mode == CAN_MODE_OFF)
+    return false;
+  m_gen_fps = fps;
+  m_gen_count = count;
+  m_gen_idfrom = idfrom;
+  m_gen_idto = (idto < idfrom) ? idfrom : idto;
+  m_gen_dlc = (dlc > 8) ? 8 : dlc;
+  m_gen_sent = 0;
+  m_gen_lost = 0;
+  m_gen_start = esp_timer_get_time();
+  m_gen_stop = 0;
+  m_gen_run = true;
+  // run on the core not used by CanRxTask, below its priority:
+  if (xTaskCreatePinnedToCore(VCAN_gentask, "VCanGenTask", 2048, (void*)this, 5, &m_gen_task, 1) != pdPASS)
+    {
+    m_gen_task = NULL;
+    m_gen_run = false;
+    return false;
+    }
+  return true;
+  }
+
+void vcan::GenStop()
+  {
+  m_gen_run = false;
+  for (int i = 0; m_gen_task && i < 100; i++)
+    vTaskDelay(10 / portTICK_PERIOD_MS);
+  }
+
+void vcan::GenTask()
+  {
+  CAN_frame_t frame;
+  memset(&frame, 0, sizeof(frame));
+  frame.origin = this;
+  frame.FIR.B.DLC = m_gen_dlc;
+  frame.FIR.B.FF = (m_gen_idto > 0x7ff) ? CAN_frame_ext : CAN_frame_std;
+
+  uint32_t id = m_gen_idfrom;
+  uint32_t seq = 0;
+  while (m_gen_run && (m_gen_count == 0 || m_gen_sent + m_gen_lost < m_gen_count))
+    {
+    // number of frames due now:
+    uint32_t burst;
+    if (m_gen_fps)
+      {
+      uint64_t due = (uint64_t)m_gen_fps * (esp_timer_get_time() - m_gen_start) / 1000000;
+      burst = (due > seq) ? due - seq : 0;
+      }
+    else
+      {
+      burst = m_rxring.GetSize() - m_rxring.GetUsed();
+      }
+    if (m_gen_count && burst > m_gen_count - (m_gen_sent + m_gen_lost))
+      burst = m_gen_count - (m_gen_sent + m_gen_lost);
+
+    for (; burst > 0; burst--)
+      {
+      frame.MsgID = id;
+      frame.data.u32[0] = seq++;
+      if (Inject(&frame))
+        m_gen_sent++;
+      else
+        m_gen_lost++;
+      if (++id > m_gen_idto)
+        id = m_gen_idfrom;
+      }
+
+    vTaskDelay(1);
+    }
+
+  m_gen_stop = esp_timer_get_time();
+  m_gen_run = false;
+  m_gen_task = NULL;
+  vTaskDelete(NULL);
+  }
+
+
+/**
+ * Shell commands:
+ *    vcan gen <fps> [<count>] [<id>[-<id>]] [<dlc>]
+ *    vcan stop
+ *    vcan status
+ */
+
+void vcan_gen(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  if (!MyVcan)
+    {
+    writer->puts("Error: no virtual CAN bus");
+    return;
+    }
+  if (MyVcan->GetPowerMode() != On || MyVcan->m_mode == CAN_MODE_OFF)
+    {
+    writer->printf("Error: %s is not started, use 'can %s start active <baud>'\n",
+      MyVcan->GetName(), MyVcan->GetName());
+    return;
+    }
+  if (MyVcan->GenRunning())
+    {
+    writer->puts("Error: generator already running");
+    return;
+    }
+
+  uint32_t fps = atoi(argv[0]);
+  uint32_t count = (argc > 1) ? atoi(argv[1]) : 0;
+  uint32_t idfrom = 0x100, idto = 0x1ff;
+  if (argc > 2)
+    {
+    char* ep;
+    idfrom = idto = strtoul(argv[2], &ep, 16);
+    if (*ep == '-')
+      idto = strtoul(ep+1, NULL, 16);
+    }
+  uint8_t dlc = (argc > 3) ? atoi(argv[3]) : 8;
+  if (idfrom > 0x1fffffff || idto > 0x1fffffff || idto < idfrom || dlc > 8)
+    {
+    writer->puts("Error: invalid ID range or DLC");
+    return;
+    }
+
+  if (!MyVcan->GenStart(fps, count, idfrom, idto, dlc))
+    {
+    writer->puts("Error: cannot start generator");
+    return;
+    }
+  writer->printf("Generator started: %s, %u frames, IDs %x-%x, DLC %u\n",
+    fps ? "paced" : "max speed", count, idfrom, idto, dlc);
+  }
+
+void vcan_stop(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  if (!MyVcan || !MyVcan->GenRunning())
+    {
+    writer->puts("Error: generator not running");
+    return;
+    }
+  MyVcan->GenStop();
+  writer->puts("Generator stopped");
+  }
+
+void vcan_status(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  if (!MyVcan)
+    {
+    writer->puts("Error: no virtual CAN bus");
+    return;
+    }
+  int64_t end = MyVcan->m_gen_stop ? MyVcan->m_gen_stop : esp_timer_get_time();
+  float secs = MyVcan->m_gen_start ? (end - MyVcan->m_gen_start) / 1000000.0f : 0;
+  writer->printf("Bus:       %s\n", MyVcan->GetName());
+  writer->printf("Generator: %s\n", MyVcan->GenRunning() ? "running" : "stopped");
+  writer->printf("Gen fps:   %20u\n", MyVcan->m_gen_fps);
+  writer->printf("Gen sent:  %20u\n", MyVcan->m_gen_sent);
+  writer->printf("Gen lost:  %20u\n", MyVcan->m_gen_lost);
+  writer->printf("Gen time:  %20.3f\n", secs);
+  writer->printf("Gen rate:  %20.1f\n", (secs > 0) ? MyVcan->m_gen_sent / secs : 0.0f);
+  writer->printf("Rx pkt:    %20u\n", MyVcan->m_status.packets_rx);
+  writer->printf("Rx ovrflw: %20u\n", MyVcan->m_status.rxbuf_overflow);
+  writer->printf("Pool fail: %20u\n", MyCan.m_framepool.m_allocfail);
+  }
+
+class VcanInit
+  {
+  public: VcanInit();
+} VcanInit  __attribute__ ((init_priority (4510)));
+
+VcanInit::VcanInit()
+  {
+  ESP_LOGI(TAG, "Initialising virtual CAN (4510)");
+
+  OvmsCommand* cmd_vcan = MyCommandApp.RegisterCommand("vcan","Virtual CAN framework",NULL, "", 0, 0, true);
+  cmd_vcan->RegisterCommand("gen","Start traffic generator",vcan_gen,
+    "<fps> [<count>] [<id>[-<id>]] [<dlc>]\n"
+    "fps: frames per second, 0 = max speed\n"
+    "count: number of frames, 0 = unlimited (default)\n"
+    "id: hex ID range to cycle through (default 100-1ff, > 7ff = extended)\n"
+    "dlc: frame length (default 8)", 1, 4, true);
+  cmd_vcan->RegisterCommand("stop","Stop traffic generator",vcan_stop, "", 0, 0, true);
+  cmd_vcan->RegisterCommand("status","Show generator status",vcan_status, "", 0, 0, true);
+  }
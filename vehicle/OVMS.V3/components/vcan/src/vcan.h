@@ -0,0 +1,90 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          18th October 2026
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+#ifndef __VCAN_H__
+#define __VCAN_H__
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "can.h"
+
+/**
+ * vcan: virtual CAN bus
+ *  In-memory CAN bus without hardware. Transmitted frames are looped back
+ *  as received frames, a generator task can feed synthetic traffic. Frames
+ *  take the same path as ISR based drivers (RX ring → CanRxTask →
+ *  can::IncomingFrame), so listeners, loggers & vehicle modules can be
+ *  load tested at arbitrary rates.
+ */
+class vcan : public canbus
+  {
+  public:
+    vcan(const char* name);
+    ~vcan();
+
+  public:
+    esp_err_t Start(CAN_mode_t mode, CAN_speed_t speed);
+    esp_err_t Stop();
+
+  public:
+    virtual void SetPowerMode(PowerMode powermode);
+
+  public:
+    bool Inject(const CAN_frame_t* p_frame);
+
+  protected:
+    esp_err_t TxFrame(const CAN_frame_t* p_frame);
+
+  public:
+    bool GenStart(uint32_t fps, uint32_t count, uint32_t idfrom, uint32_t idto, uint8_t dlc);
+    void GenStop();
+    void GenTask();
+    bool GenRunning() { return (m_gen_task != NULL); }
+
+  protected:
+    portMUX_TYPE m_rxmux;             // serializes RX ring producers (TX loopback, generator)
+
+  public:
+    TaskHandle_t m_gen_task;
+    volatile bool m_gen_run;
+    uint32_t m_gen_fps;               // frames per second, 0 = max speed
+    uint32_t m_gen_count;             // frames to generate, 0 = unlimited
+    uint32_t m_gen_idfrom;            // ID range (> 0x7ff = extended)
+    uint32_t m_gen_idto;
+    uint8_t m_gen_dlc;
+    uint32_t m_gen_sent;              // frames generated
+    uint32_t m_gen_lost;              // frames lost due to RX ring full (paced mode)
+    int64_t m_gen_start;              // generator start time [us]
+    int64_t m_gen_stop;               // generator stop time [us], 0 = running
+  };
+
+extern vcan* MyVcan;
+
+#endif //#ifndef __VCAN_H__
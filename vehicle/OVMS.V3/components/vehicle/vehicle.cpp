@@ -32,9 +32,13 @@
 static const char *TAG = "vehicle";
 
 #include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <algorithm>
 #include <ovms_command.h>
 #include <ovms_metrics.h>
 #include <metrics_standard.h>
+#include "esp_timer.h"
 #include "vehicle.h"
 
 OvmsVehicleFactory MyVehicleFactory __attribute__ ((init_priority (2000)));
@@ -341,6 +345,117 @@ void vehicle_stat(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc,
     }
   }
 
+static int vehicle_dbc_bus(OvmsWriter* writer, const char* arg)
+  {
+  int bus = 0;
+  if (strncmp(arg, "can", 3) == 0) arg += 3;
+  bus = atoi(arg);
+  if (bus < 1 || bus > 3)
+    {
+    writer->puts("Error: bus must be can1..can3");
+    return 0;
+    }
+  return bus;
+  }
+
+void vehicle_poll_status(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  if (MyVehicleFactory.m_currentvehicle==NULL)
+    {
+    writer->puts("Error: No vehicle module selected");
+    return;
+    }
+  MyVehicleFactory.m_currentvehicle->PollerStatus(writer, (argc > 0 && strcmp(argv[0], "hist") == 0));
+  }
+
+void vehicle_poll_list(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  if (MyVehicleFactory.m_currentvehicle==NULL)
+    {
+    writer->puts("Error: No vehicle module selected");
+    return;
+    }
+  MyVehicleFactory.m_currentvehicle->PollerListStatus(writer);
+  }
+
+void vehicle_poll_reload(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  if (MyVehicleFactory.m_currentvehicle==NULL)
+    {
+    writer->puts("Error: No vehicle module selected");
+    return;
+    }
+  std::string error;
+  if (!MyVehicleFactory.m_currentvehicle->PollerLoadList(error))
+    writer->printf("Error: %s\n", error.c_str());
+  MyVehicleFactory.m_currentvehicle->PollerListStatus(writer);
+  }
+
+void vehicle_poll_reset(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  if (MyVehicleFactory.m_currentvehicle==NULL)
+    {
+    writer->puts("Error: No vehicle module selected");
+    return;
+    }
+  MyVehicleFactory.m_currentvehicle->PollerResetStats();
+  writer->puts("Poll statistics cleared");
+  }
+
+void vehicle_dbc_load(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  if (MyVehicleFactory.m_currentvehicle==NULL)
+    {
+    writer->puts("Error: No vehicle module selected");
+    return;
+    }
+  int bus = vehicle_dbc_bus(writer, argv[0]);
+  if (!bus) return;
+
+  std::string error;
+  if (!MyVehicleFactory.m_currentvehicle->LoadDBC(bus, argv[1], error))
+    {
+    writer->printf("Error: %s: %s\n", argv[1], error.c_str());
+    return;
+    }
+  OvmsVehicle::dbc_info_t info;
+  if (MyVehicleFactory.m_currentvehicle->GetDBCInfo(bus, info))
+    writer->printf("DBC loaded for can%d: %u messages, %u signals, %u skipped\n",
+      bus, info.messages, info.signals, info.skipped);
+  }
+
+void vehicle_dbc_unload(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  if (MyVehicleFactory.m_currentvehicle==NULL)
+    {
+    writer->puts("Error: No vehicle module selected");
+    return;
+    }
+  int bus = vehicle_dbc_bus(writer, argv[0]);
+  if (!bus) return;
+
+  MyVehicleFactory.m_currentvehicle->UnloadDBC(bus);
+  writer->printf("DBC unloaded for can%d\n", bus);
+  }
+
+void vehicle_dbc_status(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  if (MyVehicleFactory.m_currentvehicle==NULL)
+    {
+    writer->puts("Error: No vehicle module selected");
+    return;
+    }
+  for (int bus = 1; bus <= 3; bus++)
+    {
+    OvmsVehicle::dbc_info_t info;
+    if (MyVehicleFactory.m_currentvehicle->GetDBCInfo(bus, info))
+      writer->printf("can%d: %s (%u messages, %u signals, %u skipped)\n", bus,
+        info.path.c_str(), info.messages, info.signals, info.skipped);
+    else
+      writer->printf("can%d: -\n", bus);
+    }
+  }
+
 OvmsVehicleFactory::OvmsVehicleFactory()
   {
   ESP_LOGI(TAG, "Initialising VEHICLE Factory (2000)");
@@ -350,6 +465,16 @@ OvmsVehicleFactory::OvmsVehicleFactory()
   OvmsCommand* cmd_vehicle = MyCommandApp.RegisterCommand("vehicle","Vehicle framework",NULL,"",0,0);
   cmd_vehicle->RegisterCommand("module","Set (or clear) vehicle module",vehicle_module,"<type>",0,1);
   cmd_vehicle->RegisterCommand("list","Show list of available vehicle modules",vehicle_list,"",0,0);
+  OvmsCommand* cmd_dbc = cmd_vehicle->RegisterCommand("dbc","DBC signal decoding",vehicle_dbc_status,"",0,0);
+  cmd_dbc->RegisterCommand("load","Load DBC file for bus",vehicle_dbc_load,"<bus> <path>",2,2);
+  cmd_dbc->RegisterCommand("unload","Unload DBC file for bus",vehicle_dbc_unload,"<bus>",1,1);
+  cmd_dbc->RegisterCommand("status","Show loaded DBC files",vehicle_dbc_status,"",0,0);
+  OvmsCommand* cmd_poll = cmd_vehicle->RegisterCommand("poll","Poller framework",NULL,"",0,0);
+  cmd_poll->RegisterCommand("status","Show poll list statistics",vehicle_poll_status,"[hist]",0,1);
+  cmd_poll->RegisterCommand("reset","Clear poll statistics",vehicle_poll_reset,"",0,0);
+  cmd_poll->RegisterCommand("list","Show runtime poll entries",vehicle_poll_list,"",0,0);
+  cmd_poll->RegisterCommand("reload","Reload runtime poll entries (config 'poll' & vehicle/poll.file)",vehicle_poll_reload,"",0,0);
+  MyConfig.RegisterParam("poll", "Vehicle poll list", true, true);
 
   MyCommandApp.RegisterCommand("wakeup","Wake up vehicle",vehicle_wakeup,"",0,0,true);
   MyCommandApp.RegisterCommand("homelink","Activate specified homelink button",vehicle_homelink,"<homelink>",1,1,true);
@@ -436,24 +561,50 @@ OvmsVehicle::OvmsVehicle()
   m_can3 = NULL;
   m_ticker = 0;
   m_registeredlistener = false;
+  m_dbc[0] = m_dbc[1] = m_dbc[2] = NULL;
+  m_dbc_mutex = xSemaphoreCreateMutex();
 
   m_poll_state = 0;
   m_poll_bus = NULL;
   m_poll_plist = NULL;
+  m_poll_modlist = NULL;
+  m_poll_rtbase = 0;
+  m_poll_rtfirst.assign(1, 0);
   m_poll_plcur = NULL;
-  m_poll_ticker = 0;
+  m_poll_index = 0;
+  m_poll_timebase = VEHICLE_POLL_DEFAULT_TIMEBASE;
+  m_poll_next = 0;
+  m_poll_lastsend = 0;
+  m_poll_gap = VEHICLE_POLL_DEFAULT_GAP * 1000;
+  m_poll_timeout = VEHICLE_POLL_DEFAULT_TIMEOUT * 1000;
+  m_poll_fcbs = ISOTP_DEFAULT_BS;
+  m_poll_fcstmin = ISOTP_DEFAULT_STMIN;
+  m_poll_adaptmax = 1;
+  m_poll_mutex = xSemaphoreCreateRecursiveMutex();
+  m_poll_metric_requests = NULL;
+  m_poll_metric_responses = NULL;
+  m_poll_metric_timeouts = NULL;
+  m_poll_metric_nrcs = NULL;
+  m_poll_metric_latency = NULL;
+  m_poll_sent = 0;
+  m_poll_latency = 0;
   m_poll_moduleid_sent = 0;
   m_poll_moduleid_low = 0;
   m_poll_moduleid_high = 0;
+  m_poll_moduleid_rec = 0;
   m_poll_type = 0;
   m_poll_pid = 0;
   m_poll_ml_remain = 0;
   m_poll_ml_offset = 0;
   m_poll_ml_frame = 0;
 
-  m_rxqueue = xQueueCreate(20,sizeof(CAN_frame_t));
+  m_rxqueue = xQueueCreate(20,sizeof(CAN_frame_t*));
   xTaskCreatePinnedToCore(OvmsVehicleRxTask, "Vrx Task", 4096, (void*)this, 10, &m_rxtask, 1);
 
+  std::string error;
+  if (!PollerLoadList(error))
+    ESP_LOGE(TAG, "Poll list: %s", error.c_str());
+
   using std::placeholders::_1;
   using std::placeholders::_2;
   MyEvents.RegisterEvent(TAG, "ticker.1", std::bind(&OvmsVehicle::VehicleTicker1, this, _1, _2));
@@ -478,30 +629,61 @@ OvmsVehicle::~OvmsVehicle()
   vQueueDelete(m_rxqueue);
   vTaskDelete(m_rxtask);
 
+  for (int i = 0; i < 3; i++)
+    {
+    if (m_dbc[i]) delete m_dbc[i];
+    }
+  vSemaphoreDelete(m_dbc_mutex);
+  vSemaphoreDelete(m_poll_mutex);
+
   MyEvents.DeregisterEvent(TAG);
   MyMetrics.DeregisterListener(TAG);
   }
 
 void OvmsVehicle::RxTask()
   {
-  CAN_frame_t frame;
+  CAN_frame_t* frame;
 
   while(1)
     {
-    if (xQueueReceive(m_rxqueue, &frame, (portTickType)portMAX_DELAY)==pdTRUE)
+    // Check ISO-TP timeouts (in this task, as the session callbacks
+    // take the poller lock), run poll scheduler, wait for frames until
+    // the next timeout or poll is due:
+    TickType_t wait = portMAX_DELAY;
+    int64_t now = esp_timer_get_time();
+    int64_t due = m_isotp.GetNextTimeout();
+    if (due && now >= due)
+      {
+      m_isotp.CheckTimeouts();
+      due = m_isotp.GetNextTimeout();
+      }
+    if (m_poll_plist)
+      {
+      if (now >= m_poll_next)
+        PollerRun(now);
+      if (due == 0 || m_poll_next < due)
+        due = m_poll_next;
+      }
+    if (due)
+      {
+      int64_t dt = due - esp_timer_get_time();
+      wait = (dt > 0) ? (dt + portTICK_PERIOD_MS * 1000 - 1) / (portTICK_PERIOD_MS * 1000) : 0;
+      }
+    if (xQueueReceive(m_rxqueue, &frame, wait)==pdTRUE && frame)
       {
-      if ((frame.origin == m_poll_bus)&&(m_poll_plist))
+      // ISO-TP sessions (poller responses, vehicle module transfers):
+      m_isotp.IncomingFrame(frame);
+      int bus = (m_can1 == frame->origin) ? 0 : (m_can2 == frame->origin) ? 1 : (m_can3 == frame->origin) ? 2 : -1;
+      if (bus >= 0 && m_dbc[bus])
         {
-        // This is intended for our poller
-        // ESP_LOGI(TAG, "Poller Rx candidate ID=%03x (expecting %03x-%03x)",frame.MsgID,m_poll_moduleid_low,m_poll_moduleid_high);
-        if ((frame.MsgID >= m_poll_moduleid_low)&&(frame.MsgID <= m_poll_moduleid_high))
-          {
-          PollerReceive(&frame);
-          }
+        xSemaphoreTake(m_dbc_mutex, portMAX_DELAY);
+        if (m_dbc[bus]) m_dbc[bus]->Decode(frame);
+        xSemaphoreGive(m_dbc_mutex);
         }
-      if (m_can1 == frame.origin) IncomingFrameCan1(&frame);
-      else if (m_can2 == frame.origin) IncomingFrameCan2(&frame);
-      else if (m_can3 == frame.origin) IncomingFrameCan3(&frame);
+      if (m_can1 == frame->origin) IncomingFrameCan1(frame);
+      else if (m_can2 == frame->origin) IncomingFrameCan2(frame);
+      else if (m_can3 == frame->origin) IncomingFrameCan3(frame);
+      MyCan.ReleaseFrame(frame);
       }
     }
   }
@@ -545,21 +727,96 @@ void OvmsVehicle::RegisterCanBus(int bus, CAN_mode_t mode, CAN_speed_t speed)
       break;
     }
 
-  if (!m_registeredlistener)
+  // Subscribe to all frames on our buses (replaces previous subscription):
+  canfilter* filter = new canfilter();
+  filter->AddBus(m_can1);
+  filter->AddBus(m_can2);
+  filter->AddBus(m_can3);
+  m_registeredlistener = true;
+  MyCan.RegisterListener(m_rxqueue, filter);
+
+  // Load DBC decoding table if configured:
+  if (bus >= 1 && bus <= 3)
     {
-    m_registeredlistener = true;
-    MyCan.RegisterListener(m_rxqueue);
+    char param[16];
+    snprintf(param, sizeof(param), "dbc.can%d", bus);
+    std::string path = MyConfig.GetParamValue("vehicle", param);
+    std::string error;
+    if (!path.empty() && !LoadDBC(bus, path.c_str(), error))
+      ESP_LOGE(TAG, "DBC %s: %s", path.c_str(), error.c_str());
     }
+
+  // Runtime poll entries for modules without a poller:
+  if (!m_poll_bus && !m_poll_rtlist.empty())
+    PollerBuildList();
   }
 
-void OvmsVehicle::VehicleTicker1(std::string event, void* data)
+/**
+ * LoadDBC: load & compile a DBC file as the decoding table for a bus
+ *  Frames received on the bus are decoded into the mapped metrics
+ *  before being passed to IncomingFrameCanN().
+ */
+bool OvmsVehicle::LoadDBC(int bus, const char* path, std::string& error)
   {
-  m_ticker++;
+  if (bus < 1 || bus > 3)
+    {
+    error = "invalid bus";
+    return false;
+    }
+  dbctable* table = new dbctable();
+  if (!table->Load(path, error))
+    {
+    delete table;
+    return false;
+    }
+  xSemaphoreTake(m_dbc_mutex, portMAX_DELAY);
+  dbctable* old = m_dbc[bus-1];
+  m_dbc[bus-1] = table;
+  xSemaphoreGive(m_dbc_mutex);
+  if (old) delete old;
+  return true;
+  }
+
+void OvmsVehicle::UnloadDBC(int bus)
+  {
+  if (bus < 1 || bus > 3)
+    return;
+  xSemaphoreTake(m_dbc_mutex, portMAX_DELAY);
+  dbctable* old = m_dbc[bus-1];
+  m_dbc[bus-1] = NULL;
+  xSemaphoreGive(m_dbc_mutex);
+  if (old) delete old;
+  }
 
-  if (m_poll_plist)
+/**
+ * GetDBCInfo: get a snapshot of the DBC table state of a bus
+ *  (the table may be replaced by LoadDBC / UnloadDBC any time)
+ */
+bool OvmsVehicle::GetDBCInfo(int bus, dbc_info_t& info)
+  {
+  if (bus < 1 || bus > 3)
+    return false;
+  xSemaphoreTake(m_dbc_mutex, portMAX_DELAY);
+  dbctable* dbc = m_dbc[bus-1];
+  if (dbc)
     {
-    PollerSend();
+    info.path = dbc->GetPath();
+    info.messages = dbc->GetMessageCount();
+    info.signals = dbc->GetSignalCount();
+    info.skipped = dbc->GetSkippedCount();
     }
+  xSemaphoreGive(m_dbc_mutex);
+  return (dbc != NULL);
+  }
+
+void OvmsVehicle::VehicleTicker1(std::string event, void* data)
+  {
+  m_ticker++;
+
+  // ISO-TP timeouts are checked by the RxTask, make sure it's not waiting
+  // for a deadline set by another task:
+  if (m_isotp.GetNextTimeout()) PollerWakeup();
+  if ((m_ticker % 10) == 0) PollerUpdateMetrics();
 
   Ticker1(m_ticker);
   if ((m_ticker % 10) == 0) Ticker10(m_ticker);
@@ -763,6 +1020,15 @@ OvmsVehicle::vehicle_command_t OvmsVehicle::CommandStat(int verbosity, OvmsWrite
 
 void OvmsVehicle::VehicleConfigChanged(std::string event, void* param)
   {
+  PollerConfig();
+  OvmsConfigParam* p = (OvmsConfigParam*) param;
+  if ((p && p->GetName() == "poll") || (event == "config.mounted")
+    || MyConfig.GetParamValue("vehicle", "poll.file") != m_poll_rtfile)
+    {
+    std::string error;
+    if (!PollerLoadList(error))
+      ESP_LOGE(TAG, "Poll list: %s", error.c_str());
+    }
   ConfigChanged((OvmsConfigParam*) param);
   }
 
@@ -772,6 +1038,10 @@ void OvmsVehicle::ConfigChanged(OvmsConfigParam* param)
 
 void OvmsVehicle::MetricModified(OvmsMetric* metric)
   {
+  if (metric == StandardMetrics.ms_v_env_on || metric == StandardMetrics.ms_v_env_awake
+    || metric == StandardMetrics.ms_v_charge_inprogress)
+    PollerAdaptReset();
+
   if (metric == StandardMetrics.ms_v_env_on)
     {
     if (StandardMetrics.ms_v_env_on->AsBool())
@@ -847,180 +1117,883 @@ void OvmsVehicle::MetricModified(OvmsMetric* metric)
 
 void OvmsVehicle::PollSetPidList(canbus* bus, const poll_pid_t* plist)
   {
+  xSemaphoreTakeRecursive(m_poll_mutex, portMAX_DELAY);
   m_poll_bus = bus;
-  m_poll_plist = plist;
+  m_poll_modlist = plist;
+  PollerBuildList();
+  xSemaphoreGiveRecursive(m_poll_mutex);
   }
 
-void OvmsVehicle::PollSetState(uint8_t state)
+/**
+ * PollerBuildList: combine module poll list & runtime entries into the active list
+ *  and build the channels (one per request ID & response ID range). Runtime entries
+ *  are polled on the module's poll bus, or on can1 if the module does not poll.
+ *  Channels with overlapping response ranges address the same ECU(s), only one
+ *  of them may have a request in flight (see PollerChannelBusy()).
+ */
+void OvmsVehicle::PollerBuildList()
   {
-  if ((state < VEHICLE_POLL_NSTATES)&&(state != m_poll_state))
+  xSemaphoreTakeRecursive(m_poll_mutex, portMAX_DELAY);
+  m_poll_list.clear();
+  if (m_poll_modlist)
     {
-    m_poll_state = state;
-    m_poll_ticker = 0;
-    m_poll_plcur = NULL;
+    for (const poll_pid_t* entry = m_poll_modlist; entry->txmoduleid != 0; entry++)
+      m_poll_list.push_back(*entry);
+    }
+  m_poll_rtbase = m_poll_list.size();
+  if (!m_poll_rtlist.empty())
+    {
+    if (!m_poll_bus)
+      m_poll_bus = m_can1;
+    if (m_poll_bus)
+      m_poll_list.insert(m_poll_list.end(), m_poll_rtlist.begin(), m_poll_rtlist.end());
     }
-  }
-
-void OvmsVehicle::PollerSend()
-  {
-  if (m_poll_plcur == NULL) m_poll_plcur = m_poll_plist;
 
-  while (m_poll_plcur->txmoduleid != 0)
+  m_poll_plist = NULL;
+  m_poll_plcur = NULL;
+  m_poll_index = 0;
+  m_poll_next = 0;
+  m_poll_due.clear();
+  m_poll_entrychan.clear();
+  m_poll_channels.clear();
+  m_poll_stats.clear();
+  m_poll_adapt.clear();
+  if (!m_poll_list.empty())
     {
-    if ((m_poll_plcur->polltime[m_poll_state] > 0)&&
-        ((m_poll_ticker % m_poll_plcur->polltime[m_poll_state] ) == 0))
+    poll_pid_t end = {};
+    m_poll_list.push_back(end);
+    m_poll_plist = m_poll_list.data();
+    // Build channels, one per request ID & response ID range:
+    for (const poll_pid_t* entry = m_poll_plist; entry->txmoduleid != 0; entry++)
       {
-      // We need to poll this one...
-      m_poll_type = m_poll_plcur->type;
-      m_poll_pid = m_poll_plcur->pid;
-      if (m_poll_plcur->rxmoduleid != 0)
+      poll_channel_t ch = {};
+      if (entry->rxmoduleid != 0)
         {
-        // send to <moduleid>, listen to response from <rmoduleid>:
-        m_poll_moduleid_sent = m_poll_plcur->txmoduleid;
-        m_poll_moduleid_low = m_poll_plcur->rxmoduleid;
-        m_poll_moduleid_high = m_poll_plcur->rxmoduleid;
+        ch.txid = entry->txmoduleid;
+        ch.rxlow = ch.rxhigh = entry->rxmoduleid;
         }
       else
         {
-        // broadcast: send to 0x7df, listen to all responses:
-        m_poll_moduleid_sent = 0x7df;
-        m_poll_moduleid_low = 0x7e8;
-        m_poll_moduleid_high = 0x7ef;
+        ch.txid = 0x7df;
+        ch.rxlow = 0x7e8;
+        ch.rxhigh = 0x7ef;
         }
-
-      // ESP_LOGI(TAG, "Polling for %d/%02x (expecting %03x/%03x-%03x)",
-      //   m_poll_type,m_poll_pid,m_poll_moduleid_sent,m_poll_moduleid_low,m_poll_moduleid_high);
-      CAN_frame_t txframe;
-      memset(&txframe,0,sizeof(txframe));
-      txframe.origin = m_poll_bus;
-      txframe.MsgID = m_poll_moduleid_sent;
-      txframe.FIR.B.FF = CAN_frame_std;
-      txframe.FIR.B.DLC = 8;
-      switch (m_poll_plcur->type)
+      size_t c;
+      for (c = 0; c < m_poll_channels.size(); c++)
         {
-        case VEHICLE_POLL_TYPE_OBDIICURRENT:
-        case VEHICLE_POLL_TYPE_OBDIIFREEZE:
-        case VEHICLE_POLL_TYPE_OBDIISESSION:
-          // 8 bit PID request for single frame response:
-          txframe.data.u8[0] = 0x02;
-          txframe.data.u8[1] = m_poll_type;
-          txframe.data.u8[2] = m_poll_pid;
-          break;
-        case VEHICLE_POLL_TYPE_OBDIIVEHICLE:
-        case VEHICLE_POLL_TYPE_OBDIIGROUP:
-          // 8 bit PID request for multi frame response:
-          m_poll_ml_remain = 0;
-          txframe.data.u8[0] = 0x02;
-          txframe.data.u8[1] = m_poll_type;
-          txframe.data.u8[2] = m_poll_pid;
-          break;
-        case VEHICLE_POLL_TYPE_OBDIIEXTENDED:
-          // 16 bit PID request:
-          txframe.data.u8[0] = 0x03;
-          txframe.data.u8[1] = VEHICLE_POLL_TYPE_OBDIIEXTENDED;    // Get extended PID
-          txframe.data.u8[2] = m_poll_pid >> 8;
-          txframe.data.u8[3] = m_poll_pid & 0xff;
+        if (m_poll_channels[c].txid == ch.txid && m_poll_channels[c].rxlow == ch.rxlow
+          && m_poll_channels[c].rxhigh == ch.rxhigh)
           break;
         }
-      m_poll_bus->Write(&txframe);
-      m_poll_plcur++;
-      return;
+      if (c == m_poll_channels.size())
+        {
+        ch.rx.resize(ch.rxhigh - ch.rxlow + 1);
+        m_poll_channels.push_back(ch);
+        }
+      m_poll_entrychan.push_back(c);
+      m_poll_due.push_back(0);
+      }
+    m_poll_stats.resize(m_poll_due.size());
+    poll_adapt_t adapt = { 0, 1 };
+    m_poll_adapt.assign(m_poll_due.size(), adapt);
+    }
+  PollerConfig();
+  xSemaphoreGiveRecursive(m_poll_mutex);
+  PollerWakeup();
+  }
+
+/**
+ * PollerParseEntry: parse & add a runtime poll entry
+ *  Syntax: <txid> <rxid> <type> <pid> <time>[,<time>...] [<decode>...]
+ *    - txid, rxid, type, pid: hexadecimal, rxid 0 = OBD-II broadcast response range
+ *    - time: poll interval per state in timebase units (default seconds), 0 = off
+ *    - decode: <offset>:<length>[s] <scale> <add> <metric>
+ *        offset/length: bytes in the response payload (MSB first, length 1..4)
+ *        s: signed value, metric = value * scale + add
+ *  Entries without decode specs are passed on to the vehicle module.
+ */
+bool OvmsVehicle::PollerParseEntry(const std::string& line, std::string& error)
+  {
+  const char* p = line.c_str();
+  unsigned int txid, rxid, type, pid, t;
+  int n = 0;
+  if (sscanf(p, "%x %x %x %x%n", &txid, &rxid, &type, &pid, &n) != 4 || txid == 0 || type == 0)
+    {
+    error = "invalid request (expected <txid> <rxid> <type> <pid>)";
+    return false;
+    }
+  p += n;
+
+  poll_pid_t entry = {};
+  entry.txmoduleid = txid;
+  entry.rxmoduleid = rxid;
+  entry.type = type;
+  entry.pid = pid;
+  for (int state = 0; state < VEHICLE_POLL_NSTATES; state++)
+    {
+    if (sscanf(p, "%u%n", &t, &n) != 1)
+      {
+      error = "invalid poll time";
+      return false;
+      }
+    entry.polltime[state] = t;
+    p += n;
+    if (*p != ',') break;
+    p++;
+    }
+
+  std::vector<poll_decode_t> decode;
+  std::vector<std::string> names;
+  unsigned int offset, length;
+  float scale, add;
+  char mname[64];
+  while (*p)
+    {
+    while (isspace((unsigned char)*p)) p++;
+    if (!*p) break;
+    poll_decode_t d = {};
+    if (sscanf(p, "%u:%u%n", &offset, &length, &n) != 2 || length < 1 || length > 4)
+      {
+      error = "invalid decode spec (expected <offset>:<length>[s] <scale> <add> <metric>)";
+      return false;
+      }
+    p += n;
+    d.is_signed = (*p == 's');
+    if (d.is_signed) p++;
+    if (sscanf(p, "%f %f %63s%n", &scale, &add, mname, &n) != 3)
+      {
+      error = "invalid decode spec (expected <offset>:<length>[s] <scale> <add> <metric>)";
+      return false;
       }
-    m_poll_plcur++;
+    p += n;
+    d.offset = offset;
+    d.length = length;
+    d.scale = scale;
+    d.add = add;
+    decode.push_back(d);
+    names.push_back(mname);
     }
 
-  m_poll_plcur = m_poll_plist;
-  m_poll_ticker++;
-  if (m_poll_ticker > 3600) m_poll_ticker -= 3600;
+  for (size_t k = 0; k < decode.size(); k++)
+    {
+    decode[k].metric = MyMetrics.Find(names[k].c_str());
+    if (!decode[k].metric)
+      decode[k].metric = new OvmsMetricFloat(strdup(names[k].c_str()), SM_STALE_MID);
+    m_poll_rtdecode.push_back(decode[k]);
+    }
+  m_poll_rtlist.push_back(entry);
+  m_poll_rtfirst.push_back(m_poll_rtdecode.size());
+  return true;
   }
 
-void OvmsVehicle::PollerReceive(CAN_frame_t* frame)
+/**
+ * PollerLoadList: (re)load the runtime poll entries
+ *  - config param "poll": one entry per instance (instance name free)
+ *  - file configured in vehicle/poll.file: one entry per line, '#' starts a comment
+ *  Invalid entries are skipped & logged, the others are polled.
+ */
+bool OvmsVehicle::PollerLoadList(std::string& error)
   {
-  // ESP_LOGI(TAG, "Receive Poll Response for %d/%02x",m_poll_type,m_poll_pid);
-  switch (m_poll_type)
+  std::string err;
+  int invalid = 0;
+
+  xSemaphoreTakeRecursive(m_poll_mutex, portMAX_DELAY);
+  m_poll_rtlist.clear();
+  m_poll_rtdecode.clear();
+  m_poll_rtfirst.assign(1, 0);
+
+  OvmsConfigParam* param = MyConfig.CachedParam("poll");
+  if (param)
     {
-    case VEHICLE_POLL_TYPE_OBDIICURRENT:
-    case VEHICLE_POLL_TYPE_OBDIIFREEZE:
-    case VEHICLE_POLL_TYPE_OBDIISESSION:
-      // 8 bit PID single frame response:
-      if ((frame->data.u8[1] == 0x40+m_poll_type)&&
-          (frame->data.u8[2] == m_poll_pid))
+    for (auto& it : param->m_map)
+      {
+      if (!PollerParseEntry(it.second, err))
         {
-        IncomingPollReply(m_poll_bus, m_poll_type, m_poll_pid, &frame->data.u8[3], 5, 0);
-        return;
+        ESP_LOGW(TAG, "Poll entry '%s': %s", it.first.c_str(), err.c_str());
+        invalid++;
         }
-      break;
-    case VEHICLE_POLL_TYPE_OBDIIVEHICLE:
-    case VEHICLE_POLL_TYPE_OBDIIGROUP:
-      // 8 bit PID multiple frame response:
-      if (((frame->data.u8[0]>>4) == 0x1)&&
-          (frame->data.u8[2] == 0x40+m_poll_type)&&
-          (frame->data.u8[3] == m_poll_pid))
+      }
+    }
+
+  m_poll_rtfile = MyConfig.GetParamValue("vehicle", "poll.file");
+  if (!m_poll_rtfile.empty())
+    {
+    FILE* f = fopen(m_poll_rtfile.c_str(), "r");
+    if (!f)
+      {
+      ESP_LOGW(TAG, "Poll list %s: cannot open file", m_poll_rtfile.c_str());
+      error = m_poll_rtfile + ": cannot open file";
+      }
+    else
+      {
+      char line[256];
+      int lineno = 0;
+      while (fgets(line, sizeof(line), f))
         {
-        // First frame; send flow control frame:
-        CAN_frame_t txframe;
-        memset(&txframe,0,sizeof(txframe));
-        txframe.origin = m_poll_bus;
-        txframe.FIR.B.FF = CAN_frame_std;
-        txframe.FIR.B.DLC = 8;
-
-        if (m_poll_moduleid_sent == 0x7df)
+        lineno++;
+        char* c = strchr(line, '#');
+        if (c) *c = 0;
+        c = line;
+        while (isspace((unsigned char)*c)) c++;
+        if (!*c) continue;
+        if (!PollerParseEntry(c, err))
           {
-          // broadcast request: derive module ID from response ID:
-          // (Note: this only works for the SAE standard ID scheme)
-          txframe.MsgID = frame->MsgID - 8;
+          ESP_LOGW(TAG, "Poll list %s line %d: %s", m_poll_rtfile.c_str(), lineno, err.c_str());
+          invalid++;
           }
-        else
+        }
+      fclose(f);
+      }
+    }
+
+  // Rebuild active list if runtime entries are added or removed:
+  if (!m_poll_rtlist.empty() || m_poll_rtbase + 1 < m_poll_list.size())
+    PollerBuildList();
+  xSemaphoreGiveRecursive(m_poll_mutex);
+
+  if (invalid)
+    {
+    if (!error.empty()) error += ", ";
+    error += std::to_string(invalid) + " invalid entries skipped (see log)";
+    }
+  return error.empty();
+  }
+
+/**
+ * PollerDecode: decode a complete runtime entry response into the mapped metrics
+ */
+void OvmsVehicle::PollerDecode(const poll_channel_t& ch, const poll_rxstate_t& rx)
+  {
+  size_t r = (ch.entry - m_poll_plist) - m_poll_rtbase;
+  for (uint16_t k = m_poll_rtfirst[r]; k < m_poll_rtfirst[r+1]; k++)
+    {
+    const poll_decode_t& d = m_poll_rtdecode[k];
+    if (d.offset + d.length > rx.buf.size())
+      continue;
+    uint32_t raw = 0;
+    for (int b = 0; b < d.length; b++)
+      raw = (raw << 8) | rx.buf[d.offset + b];
+    float value;
+    if (d.is_signed)
+      value = (float)((int32_t)(raw << (32 - 8*d.length)) >> (32 - 8*d.length));
+    else
+      value = (float)raw;
+    d.metric->SetFloat(value * d.scale + d.add);
+    }
+  }
+
+void OvmsVehicle::PollerListStatus(OvmsWriter* writer)
+  {
+  xSemaphoreTakeRecursive(m_poll_mutex, portMAX_DELAY);
+  writer->printf("Runtime poll entries: %d (file: %s)\n", m_poll_rtlist.size(),
+    m_poll_rtfile.empty() ? "-" : m_poll_rtfile.c_str());
+  for (size_t r = 0; r < m_poll_rtlist.size(); r++)
+    {
+    const poll_pid_t& e = m_poll_rtlist[r];
+    writer->printf("%x %x %02x %x %d,%d,%d,%d", e.txmoduleid, e.rxmoduleid, e.type, e.pid,
+      e.polltime[0], e.polltime[1], e.polltime[2], e.polltime[3]);
+    for (uint16_t k = m_poll_rtfirst[r]; k < m_poll_rtfirst[r+1]; k++)
+      {
+      const poll_decode_t& d = m_poll_rtdecode[k];
+      writer->printf(" %d:%d%s %g %g %s", d.offset, d.length, d.is_signed ? "s" : "",
+        d.scale, d.add, d.metric->m_name);
+      }
+    writer->puts("");
+    }
+  xSemaphoreGiveRecursive(m_poll_mutex);
+  }
+
+void OvmsVehicle::PollSetState(uint8_t state)
+  {
+  if ((state < VEHICLE_POLL_NSTATES)&&(state != m_poll_state))
+    {
+    xSemaphoreTakeRecursive(m_poll_mutex, portMAX_DELAY);
+    m_poll_state = state;
+    // all entries of the new state are due now, at their base rate:
+    std::fill(m_poll_due.begin(), m_poll_due.end(), 0);
+    for (poll_adapt_t& adapt : m_poll_adapt)
+      adapt.scale = 1;
+    m_poll_index = 0;
+    m_poll_next = 0;
+    xSemaphoreGiveRecursive(m_poll_mutex);
+    PollerWakeup();
+    }
+  }
+
+/**
+ * PollerAdaptReset: return all entries to their base poll rate
+ *  (adaptive polling; called on vehicle state changes)
+ */
+void OvmsVehicle::PollerAdaptReset()
+  {
+  xSemaphoreTakeRecursive(m_poll_mutex, portMAX_DELAY);
+  for (size_t idx = 0; idx < m_poll_adapt.size(); idx++)
+    {
+    if (m_poll_adapt[idx].scale > 1)
+      {
+      m_poll_adapt[idx].scale = 1;
+      m_poll_due[idx] = 0;
+      }
+    }
+  m_poll_next = 0;
+  xSemaphoreGiveRecursive(m_poll_mutex);
+  PollerWakeup();
+  }
+
+/**
+ * PollerAdapt: adaptive polling, called on each answered request
+ *  (the hash covers the responses of all ECUs). An unchanged response doubles the poll interval (up to poll.adaptive.max
+ *  times the configured interval), a changed response returns the entry
+ *  to the configured interval.
+ */
+void OvmsVehicle::PollerAdapt(size_t idx, const poll_channel_t& ch)
+  {
+  poll_adapt_t& adapt = m_poll_adapt[idx];
+  if (ch.hash == adapt.hash)
+    {
+    if (adapt.scale < m_poll_adaptmax)
+      adapt.scale = std::min<uint16_t>(adapt.scale * 2, m_poll_adaptmax);
+    }
+  else
+    {
+    adapt.hash = ch.hash;
+    if (adapt.scale > 1)
+      {
+      // pull in the next poll, it has been scheduled at the stretched interval:
+      adapt.scale = 1;
+      int64_t due = ch.sent + (int64_t)ch.entry->polltime[m_poll_state] * m_poll_timebase * 1000;
+      if (due < m_poll_due[idx])
+        m_poll_due[idx] = due;
+      }
+    }
+  }
+
+/**
+ * PollSetTimeBase: set the unit of the poll list polltime values
+ *  Default is 1000 ms (polltime = seconds), use e.g. 100 for 1/10 seconds.
+ */
+void OvmsVehicle::PollSetTimeBase(uint16_t ms)
+  {
+  if (ms > 0)
+    m_poll_timebase = ms;
+  }
+
+void OvmsVehicle::PollerConfig()
+  {
+  std::string bus = m_poll_bus ? m_poll_bus->GetName() : "";
+  m_poll_gap = MyConfig.GetParamValueInt("vehicle", "poll.gap." + bus, VEHICLE_POLL_DEFAULT_GAP) * 1000;
+  m_poll_timeout = MyConfig.GetParamValueInt("vehicle", "poll.timeout", VEHICLE_POLL_DEFAULT_TIMEOUT) * 1000;
+  // ISO-TP flow control sent by the poller, applied to a session by the
+  // next request (no response in progress then):
+  m_poll_fcbs = MyConfig.GetParamValueInt("vehicle", "poll.bs", ISOTP_DEFAULT_BS);
+  m_poll_fcstmin = MyConfig.GetParamValueInt("vehicle", "poll.stmin", ISOTP_DEFAULT_STMIN);
+  m_isotp.SetFlowControl(m_poll_fcbs, m_poll_fcstmin);
+  m_poll_adaptmax = 1;
+  if (MyConfig.GetParamValueBool("vehicle", "poll.adaptive", false))
+    m_poll_adaptmax = std::max(1, MyConfig.GetParamValueInt("vehicle", "poll.adaptive.max", VEHICLE_POLL_DEFAULT_ADAPTMAX));
+  }
+
+/**
+ * PollerWakeup: let the RxTask reschedule (i.e. after a list or state change)
+ */
+void OvmsVehicle::PollerWakeup()
+  {
+  CAN_frame_t* wakeup = NULL;
+  xQueueSend(m_rxqueue, &wakeup, 0);
+  }
+
+/**
+ * PollerRun: poll scheduler, called by the RxTask when m_poll_next is reached
+ *  Every ECU has at most one request in flight. The next due request of
+ *  an idle ECU is sent as soon as the minimum bus gap has passed, so ECUs
+ *  are polled in parallel and the cycle time depends on the slowest ECU
+ *  instead of the sum of all response times.
+ *  A broadcast request accepts responses until the timeout, or until
+ *  VEHICLE_POLL_BROADCAST_WAIT after the first complete response.
+ */
+void OvmsVehicle::PollerRun(int64_t now)
+  {
+  xSemaphoreTakeRecursive(m_poll_mutex, portMAX_DELAY);
+  int64_t next = now + 1000000;
+
+  // Check response timeouts:
+  //  (once a multi frame response has started, ISO-TP supervises the
+  //  CFs by N_Cr and reports a stall via PollerError())
+  for (poll_channel_t& ch : m_poll_channels)
+    {
+    if (!ch.wait)
+      continue;
+    bool receiving = false;
+    for (const poll_rxstate_t& rx : ch.rx)
+      receiving = receiving || (rx.ml_remain > 0);
+    if (receiving)
+      continue;
+    if (now >= ch.deadline)
+      {
+      if (!ch.answered)
+        {
+        ESP_LOGD(TAG, "Poll %d/%02x: timeout on %03x", ch.entry->type, ch.entry->pid, ch.txid);
+        m_poll_stats[ch.entry - m_poll_plist].timeouts++;
+        }
+      PollerDone(ch);
+      }
+    else if (ch.deadline < next)
+      next = ch.deadline;
+    }
+
+  // Send next request:
+  if (now < m_poll_lastsend + m_poll_gap)
+    {
+    if (m_poll_lastsend + m_poll_gap < next)
+      next = m_poll_lastsend + m_poll_gap;
+    }
+  else
+    PollerSend(now, next);
+
+  m_poll_next = next;
+  xSemaphoreGiveRecursive(m_poll_mutex);
+  }
+
+/**
+ * PollerDone: request complete (or failed), reschedule
+ */
+void OvmsVehicle::PollerDone(poll_channel_t& ch)
+  {
+  ch.wait = false;
+  for (poll_rxstate_t& rx : ch.rx)
+    rx.ml_remain = 0;
+  if (ch.responses && m_poll_adaptmax > 1)
+    PollerAdapt(ch.entry - m_poll_plist, ch);
+  m_poll_next = 0;
+  }
+
+/**
+ * PollerChannelBusy: check for a request in flight to the ECU(s) of a channel
+ *  (i.e. a physical request to 0x7e0 and a broadcast to 0x7df both address
+ *  the ECU responding on 0x7e8)
+ */
+bool OvmsVehicle::PollerChannelBusy(size_t c)
+  {
+  const poll_channel_t& ch = m_poll_channels[c];
+  for (const poll_channel_t& other : m_poll_channels)
+    {
+    if (other.wait && other.rxlow <= ch.rxhigh && ch.rxlow <= other.rxhigh)
+      return true;
+    }
+  return false;
+  }
+
+void OvmsVehicle::PollerSend(int64_t now, int64_t& next)
+  {
+  int n = m_poll_due.size();
+
+  for (int k = 0; k < n; k++)
+    {
+    int idx = (m_poll_index + k) % n;
+    const poll_pid_t* entry = &m_poll_plist[idx];
+    int c = m_poll_entrychan[idx];
+    poll_channel_t& ch = m_poll_channels[c];
+    if (entry->polltime[m_poll_state] == 0)
+      continue;
+    if (m_poll_due[idx] > now)
+      {
+      if (m_poll_due[idx] < next) next = m_poll_due[idx];
+      continue;
+      }
+    if (PollerChannelBusy(c))
+      continue; // ECU busy, rescheduled by response / timeout
+
+    // We need to poll this one...
+    int64_t interval = (int64_t)entry->polltime[m_poll_state] * m_poll_timebase * 1000
+      * std::min(m_poll_adapt[idx].scale, m_poll_adaptmax);
+    m_poll_due[idx] = (m_poll_due[idx] && m_poll_due[idx] + interval > now)
+      ? m_poll_due[idx] + interval : now + interval;
+    m_poll_index = idx + 1;
+
+    using std::placeholders::_1;
+    using std::placeholders::_2;
+    using std::placeholders::_3;
+    using std::placeholders::_4;
+    using std::placeholders::_5;
+    canisotp_rxcb_t rxcb = std::bind(&OvmsVehicle::PollerReceive, this, _1, _2, _3, _4, _5);
+    canisotp_errcb_t errcb = std::bind(&OvmsVehicle::PollerError, this, _1, _2);
+    canisotp_session* session;
+    if (ch.rxlow == ch.rxhigh)
+      {
+      // send to <moduleid>, listen to response from <rmoduleid>:
+      session = m_isotp.Open(m_poll_bus, ch.txid, ch.rxlow, rxcb, errcb);
+      m_isotp.SetFlowControl(session, m_poll_fcbs, m_poll_fcstmin);
+      }
+    else
+      {
+      // broadcast: send to 0x7df, listen to all responses:
+      // (Note: flow control addressing only works for the SAE standard ID scheme)
+      for (uint32_t id = ch.rxlow; id <= ch.rxhigh; id++)
+        m_isotp.SetFlowControl(m_isotp.Open(m_poll_bus, id - 8, id, rxcb, errcb),
+          m_poll_fcbs, m_poll_fcstmin);
+      session = m_isotp.Open(m_poll_bus, ch.txid, 0);
+      }
+    session->m_txclass = CAN_TX_NORMAL;
+
+    // ESP_LOGI(TAG, "Polling for %d/%02x (expecting %03x/%03x-%03x)",
+    //   entry->type,entry->pid,ch.txid,ch.rxlow,ch.rxhigh);
+    uint8_t request[1+VEHICLE_POLL_MULTIPID];
+    uint8_t length;
+    switch (entry->type)
+      {
+      case VEHICLE_POLL_TYPE_OBDIIEXTENDED:
+        // 16 bit PID request:
+        request[0] = VEHICLE_POLL_TYPE_OBDIIEXTENDED;    // Get extended PID
+        request[1] = entry->pid >> 8;
+        request[2] = entry->pid & 0xff;
+        length = 3;
+        break;
+      case VEHICLE_POLL_TYPE_OBDIICURRENT:
+        // 8 bit PID request, up to 6 PIDs per request:
+        request[0] = entry->type;
+        request[1] = entry->pid;
+        length = 2;
+        while (length <= VEHICLE_POLL_MULTIPID && entry->morepids[length-2])
           {
-          // use known module ID:
-          txframe.MsgID = m_poll_moduleid_sent;
+          request[length] = entry->morepids[length-2];
+          length++;
           }
+        break;
+      default:
+        // 8 bit PID request:
+        request[0] = entry->type;
+        request[1] = entry->pid;
+        length = 2;
+        break;
+      }
+    ch.entry = entry;
+    ch.sent = now;
+    ch.deadline = now + m_poll_timeout;
+    ch.responses = 0;
+    ch.answered = false;
+    ch.hash = 0;
+    for (poll_rxstate_t& rx : ch.rx)
+      rx.ml_remain = 0;
+    ch.wait = (m_isotp.Send(session, request, length) == ISOTP_OK);
+    if (ch.wait) m_poll_stats[idx].requests++;
+    m_poll_lastsend = now;
+    if (ch.wait && ch.deadline < next)
+      next = ch.deadline;
+    if (now + m_poll_gap < next)
+      next = now + m_poll_gap;
+    return;
+    }
+  }
 
-        txframe.data.u8[0] = 0x30; // flow control frame type
-        txframe.data.u8[1] = 0x00; // request all frames available
-        txframe.data.u8[2] = 0x19; // with 25ms send interval
-        m_poll_bus->Write(&txframe);
-
-        // prepare frame processing, first frame contains first 3 bytes:
-        m_poll_ml_remain = (((uint16_t)(frame->data.u8[0]&0x0f))<<8) + frame->data.u8[1] - 3;
-        m_poll_ml_offset = 3;
-        m_poll_ml_frame = 0;
-        // ESP_LOGI(TAG, "Poll ML first frame (frame=%d, remain=%d)",m_poll_ml_frame,m_poll_ml_remain);
-        IncomingPollReply(m_poll_bus, m_poll_type, m_poll_pid, &frame->data.u8[5], 3, m_poll_ml_remain);
-        return;
-        }
-      else if (((frame->data.u8[0]>>4)==0x2)&&(m_poll_ml_remain>0))
+/**
+ * PollerFindChannel: find the channel waiting for a response session
+ *  (only one channel per response ID can have a request in flight)
+ */
+int OvmsVehicle::PollerFindChannel(canisotp_session* session)
+  {
+  if (!m_poll_plist || session->GetBus() != m_poll_bus)
+    return -1;
+  uint32_t rxid = session->GetRxId();
+  for (size_t c = 0; c < m_poll_channels.size(); c++)
+    {
+    const poll_channel_t& ch = m_poll_channels[c];
+    if (ch.wait && ch.entry && rxid >= ch.rxlow && rxid <= ch.rxhigh)
+      return c;
+    }
+  return -1;
+  }
+
+/**
+ * PollerSetContext: set the legacy poll state members for IncomingPollReply()
+ */
+void OvmsVehicle::PollerSetContext(const poll_channel_t& ch, const poll_rxstate_t& rx, uint32_t rxid)
+  {
+  m_poll_plcur = ch.entry;
+  m_poll_type = ch.entry->type;
+  m_poll_pid = ch.entry->pid;
+  m_poll_moduleid_sent = ch.txid;
+  m_poll_moduleid_low = ch.rxlow;
+  m_poll_moduleid_high = ch.rxhigh;
+  m_poll_moduleid_rec = rxid;
+  m_poll_ml_remain = rx.ml_remain;
+  m_poll_ml_offset = rx.ml_offset;
+  m_poll_ml_frame = rx.ml_frame;
+  m_poll_sent = ch.sent;
+  }
+
+/**
+ * PollerLatency: record request to response latency
+ *  (based on the reception time of the first response frame)
+ */
+void OvmsVehicle::PollerLatency(int64_t rxtime)
+  {
+  if (m_poll_sent && rxtime > m_poll_sent)
+    m_poll_latency = rxtime - m_poll_sent;
+  else
+    m_poll_latency = 0;
+  ESP_LOGV(TAG, "Poll response %d/%02x latency %u us", m_poll_type, m_poll_pid, m_poll_latency);
+  }
+
+/**
+ * PollerReceive: ISO-TP data callback for poll responses
+ *  The response header (mode, PID) is checked & stripped from the first
+ *  frame (single or first frame of a multi frame response), all following
+ *  frames are passed on to IncomingPollReply() with m_poll_ml_frame and
+ *  m_poll_ml_offset set accordingly. The m_poll_* members reflect the
+ *  request of the responding ECU, m_poll_moduleid_rec identifies the ECU
+ *  (responses of multiple ECUs to a broadcast request may interleave).
+ */
+void OvmsVehicle::PollerReceive(canisotp_session* session, uint16_t frame, uint8_t* data, uint16_t length, uint16_t remain)
+  {
+  xSemaphoreTakeRecursive(m_poll_mutex, portMAX_DELAY);
+  int c = PollerFindChannel(session);
+  if (c < 0)
+    {
+    xSemaphoreGiveRecursive(m_poll_mutex);
+    return;
+    }
+  poll_channel_t& ch = m_poll_channels[c];
+  uint32_t rxid = session->GetRxId();
+  poll_rxstate_t& rx = ch.rx[rxid - ch.rxlow];
+  bool broadcast = (ch.rxlow != ch.rxhigh);
+  PollerSetContext(ch, rx, rxid);
+
+  uint8_t* payload = NULL;
+  uint16_t payloadlen = 0;
+  if (frame == 0)
+    {
+    // ESP_LOGI(TAG, "Receive Poll Response for %d/%02x",m_poll_type,m_poll_pid);
+    uint8_t hdrlen;
+    bool match;
+    switch (m_poll_type)
+      {
+      case VEHICLE_POLL_TYPE_OBDIIEXTENDED:
+        // 16 bit PID response:
+        hdrlen = 3;
+        match = (length >= hdrlen) && (data[0] == 0x62) &&
+          ((data[2]+(((uint16_t) data[1]) << 8)) == m_poll_pid);
+        break;
+      case VEHICLE_POLL_TYPE_OBDIIVEHICLE:
+      case VEHICLE_POLL_TYPE_OBDIIGROUP:
+        // 8 bit PID response, third byte skipped (mode 09: number of data items):
+        hdrlen = 3;
+        match = (length >= hdrlen) && (data[0] == 0x40+m_poll_type) && (data[1] == m_poll_pid);
+        break;
+      case VEHICLE_POLL_TYPE_OBDIICURRENT:
+        if (ch.entry->morepids[0])
+          {
+          // Multi PID response: payload = <pid><data> records for the PIDs supported
+          //  (the ECU may skip PIDs, so any requested PID may come first)
+          hdrlen = 1;
+          match = (length >= 2) && (data[0] == 0x41) && (data[1] == m_poll_pid ||
+            memchr(ch.entry->morepids, data[1], VEHICLE_POLL_MULTIPID-1) != NULL);
+          break;
+          }
+        // fall through
+      default:
+        // 8 bit PID response:
+        hdrlen = 2;
+        match = (length >= hdrlen) && (data[0] == 0x40+m_poll_type) && (data[1] == m_poll_pid);
+        break;
+      }
+    if (!match)
+      {
+      rx.ml_remain = 0;
+      if (length >= 3 && data[0] == 0x7f && data[1] == ((m_poll_type == VEHICLE_POLL_TYPE_OBDIIEXTENDED) ? 0x22 : m_poll_type))
         {
-        // Consecutive frame (1 control + 7 data bytes)
-        uint16_t len;
-        if (m_poll_ml_remain>7)
+        // negative response; 0x78 = response pending:
+        poll_stats_t& stats = m_poll_stats[ch.entry - m_poll_plist];
+        if (data[2] == 0x78)
           {
-          m_poll_ml_remain -= 7;
-          m_poll_ml_offset += 7;
-          len = 7;
+          stats.pending++;
+          ch.deadline = session->GetRxTime() + m_poll_timeout;
           }
         else
           {
-          len = m_poll_ml_remain;
-          m_poll_ml_offset += m_poll_ml_remain;
-          m_poll_ml_remain = 0;
+          ESP_LOGD(TAG, "Poll %d/%02x: negative response code %02x from %03x", m_poll_type, m_poll_pid, data[2], rxid);
+          stats.nrcs++;
+          stats.lastnrc = data[2];
+          ch.answered = true;
+          if (!broadcast) PollerDone(ch);
           }
-        m_poll_ml_frame++;
-        // ESP_LOGI(TAG, "Poll ML subsequent frame (frame=%d, remain=%d)",m_poll_ml_frame,m_poll_ml_remain);
-        IncomingPollReply(m_poll_bus, m_poll_type, m_poll_pid, &frame->data.u8[1], len, m_poll_ml_remain);
-        return;
         }
-      break;
-    case VEHICLE_POLL_TYPE_OBDIIEXTENDED:
-      // 16 bit PID response:
-      if ((frame->data.u8[1] == 0x62)&&
-          ((frame->data.u8[3]+(((uint16_t) frame->data.u8[2]) << 8)) == m_poll_pid))
+      xSemaphoreGiveRecursive(m_poll_mutex);
+      return;
+      }
+    m_poll_ml_remain = remain;
+    m_poll_ml_offset = length - hdrlen;
+    m_poll_ml_frame = 0;
+    // ESP_LOGI(TAG, "Poll ML first frame (frame=%d, remain=%d)",m_poll_ml_frame,m_poll_ml_remain);
+    PollerLatency(session->GetRxTime());
+    poll_stats_t& stats = m_poll_stats[ch.entry - m_poll_plist];
+    stats.responses++;
+    stats.latency.Add(m_poll_latency);
+    payload = data + hdrlen;
+    payloadlen = length - hdrlen;
+    }
+  else if (m_poll_ml_remain > 0)
+    {
+    // Consecutive frame:
+    m_poll_ml_remain = remain;
+    m_poll_ml_offset += length;
+    m_poll_ml_frame = frame;
+    // ESP_LOGI(TAG, "Poll ML subsequent frame (frame=%d, remain=%d)",m_poll_ml_frame,m_poll_ml_remain);
+    payload = data;
+    payloadlen = length;
+    }
+
+  if (payload)
+    {
+    rx.ml_remain = m_poll_ml_remain;
+    rx.ml_offset = m_poll_ml_offset;
+    rx.ml_frame = m_poll_ml_frame;
+    size_t idx = ch.entry - m_poll_plist;
+    if (m_poll_adaptmax > 1)
+      {
+      // FNV-1a hash of the payload to detect value changes:
+      if (frame == 0) rx.hash = 2166136261u;
+      for (uint16_t i = 0; i < payloadlen; i++)
+        rx.hash = (rx.hash ^ payload[i]) * 16777619u;
+      }
+    if (idx >= m_poll_rtbase && m_poll_rtfirst[idx-m_poll_rtbase] != m_poll_rtfirst[idx-m_poll_rtbase+1])
+      {
+      // Runtime entry with decode specs: decode from the complete payload
+      if (frame == 0)
+        rx.buf.assign(payload, payload + payloadlen);
+      else
+        rx.buf.insert(rx.buf.end(), payload, payload + payloadlen);
+      if (remain == 0) PollerDecode(ch, rx);
+      }
+    else
+      IncomingPollReply(m_poll_bus, m_poll_type, m_poll_pid, payload, payloadlen, m_poll_ml_remain);
+    if (remain == 0)
+      {
+      ch.responses++;
+      ch.answered = true;
+      ch.hash += rx.hash;
+      if (!broadcast)
+        PollerDone(ch);
+      else if (ch.responses == 1)
         {
-        IncomingPollReply(m_poll_bus, m_poll_type, m_poll_pid, &frame->data.u8[4], 4, 0);
-        return;
+        // collect responses of other ECUs:
+        ch.deadline = std::min(ch.deadline, session->GetRxTime() + VEHICLE_POLL_BROADCAST_WAIT * 1000);
+        m_poll_next = 0;
         }
-      break;
+      }
+    }
+  xSemaphoreGiveRecursive(m_poll_mutex);
+  }
+
+void OvmsVehicle::PollerError(canisotp_session* session, canisotp_error_t error)
+  {
+  xSemaphoreTakeRecursive(m_poll_mutex, portMAX_DELAY);
+  int c = PollerFindChannel(session);
+  if (c >= 0)
+    {
+    poll_channel_t& ch = m_poll_channels[c];
+    uint32_t rxid = session->GetRxId();
+    ESP_LOGD(TAG, "Poll %d/%02x: ISO-TP error %d on %03x", ch.entry->type, ch.entry->pid, error, rxid);
+    m_poll_stats[ch.entry - m_poll_plist].errors++;
+    ch.rx[rxid - ch.rxlow].ml_remain = 0;
+    if (ch.rxlow == ch.rxhigh)
+      PollerDone(ch);
+    else
+      m_poll_next = 0; // broadcast: other ECUs may still respond
+    }
+  xSemaphoreGiveRecursive(m_poll_mutex);
+  }
+
+/**
+ * PollerStatus: output poll list & statistics
+ */
+void OvmsVehicle::PollerStatus(OvmsWriter* writer, bool histogram)
+  {
+  xSemaphoreTakeRecursive(m_poll_mutex, portMAX_DELAY);
+  if (!m_poll_plist)
+    {
+    writer->puts("Poller inactive");
+    xSemaphoreGiveRecursive(m_poll_mutex);
+    return;
+    }
+  writer->printf("Poller: %s, state %d, %d entries, %d ECUs, timebase %d ms, gap %d ms, timeout %d ms\n\n",
+    m_poll_bus ? m_poll_bus->GetName() : "-", m_poll_state, m_poll_stats.size(), m_poll_channels.size(),
+    m_poll_timebase, m_poll_gap / 1000, m_poll_timeout / 1000);
+  writer->puts("TX       RX       Type PID   Int Adp      Req     Resp Timeout  Err  NRC last  Pend lat.avg[ms] lat.max[ms]");
+  for (size_t i = 0; i < m_poll_stats.size(); i++)
+    {
+    const poll_pid_t* entry = &m_poll_plist[i];
+    const poll_stats_t& st = m_poll_stats[i];
+    writer->printf("%-8x %-8x %02x %5x %5d %2dx %8d %8d %7d %4d %4d  %02x %5d %11.1f %11.1f\n",
+      entry->txmoduleid, entry->rxmoduleid, entry->type, entry->pid, entry->polltime[m_poll_state],
+      std::min(m_poll_adapt[i].scale, m_poll_adaptmax),
+      st.requests, st.responses, st.timeouts, st.errors, st.nrcs, st.lastnrc, st.pending,
+      st.latency.m_n ? (float)(st.latency.m_sum / st.latency.m_n) / 1000 : 0.0f,
+      (float)st.latency.m_max / 1000);
+    }
+  if (histogram)
+    {
+    writer->printf("\nLatency[ms] ");
+    for (int i=0; i<CAN_LATENCY_BUCKETS-1; i++)
+      writer->printf(" <=%-5.1f", (float)canlatency::GetBucketLimit(i) / 1000);
+    writer->printf("  >%-5.1f\n", (float)canlatency::GetBucketLimit(CAN_LATENCY_BUCKETS-2) / 1000);
+    for (size_t i = 0; i < m_poll_stats.size(); i++)
+      {
+      const poll_pid_t* entry = &m_poll_plist[i];
+      writer->printf("%03x/%02x/%04x", entry->txmoduleid, entry->type, entry->pid);
+      for (int k=0; k<CAN_LATENCY_BUCKETS; k++)
+        writer->printf(" %7d", m_poll_stats[i].latency.m_count[k]);
+      writer->puts("");
+      }
+    }
+  xSemaphoreGiveRecursive(m_poll_mutex);
+  }
+
+void OvmsVehicle::PollerResetStats()
+  {
+  xSemaphoreTakeRecursive(m_poll_mutex, portMAX_DELAY);
+  for (poll_stats_t& st : m_poll_stats)
+    {
+    st.requests = st.responses = st.timeouts = st.errors = st.nrcs = st.pending = 0;
+    st.lastnrc = 0;
+    st.latency.Clear();
+    }
+  xSemaphoreGiveRecursive(m_poll_mutex);
+  }
+
+/**
+ * PollerUpdateMetrics: publish poller totals as metrics (if enabled
+ *  by config vehicle/poll.metrics)
+ */
+void OvmsVehicle::PollerUpdateMetrics()
+  {
+  if (!m_poll_plist || !MyConfig.GetParamValueBool("vehicle", "poll.metrics", false))
+    return;
+  if (!m_poll_metric_requests)
+    {
+    m_poll_metric_requests = MyMetrics.InitInt("m.poll.requests", SM_STALE_MID, 0);
+    m_poll_metric_responses = MyMetrics.InitInt("m.poll.responses", SM_STALE_MID, 0);
+    m_poll_metric_timeouts = MyMetrics.InitInt("m.poll.timeouts", SM_STALE_MID, 0);
+    m_poll_metric_nrcs = MyMetrics.InitInt("m.poll.nrcs", SM_STALE_MID, 0);
+    m_poll_metric_latency = MyMetrics.InitInt("m.poll.latency", SM_STALE_MID, 0);
+    }
+  uint32_t requests = 0, responses = 0, timeouts = 0, nrcs = 0, n = 0;
+  uint64_t sum = 0;
+  xSemaphoreTakeRecursive(m_poll_mutex, portMAX_DELAY);
+  for (poll_stats_t& st : m_poll_stats)
+    {
+    requests += st.requests;
+    responses += st.responses;
+    timeouts += st.timeouts;
+    nrcs += st.nrcs;
+    n += st.latency.m_n;
+    sum += st.latency.m_sum;
     }
+  xSemaphoreGiveRecursive(m_poll_mutex);
+  m_poll_metric_requests->SetValue(requests);
+  m_poll_metric_responses->SetValue(responses);
+  m_poll_metric_timeouts->SetValue(timeouts);
+  m_poll_metric_nrcs->SetValue(nrcs);
+  m_poll_metric_latency->SetValue(n ? (int)(sum / n) : 0);
   }
 
 /**
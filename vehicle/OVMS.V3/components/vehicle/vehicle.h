@@ -33,11 +33,14 @@
 
 #include <map>
 #include <string>
+#include <vector>
 #include "can.h"
 #include "ovms_events.h"
 #include "ovms_config.h"
 #include "ovms_metrics.h"
 #include "metrics_standard.h"
+#include "vehicle_dbc.h"
+#include "canisotp.h"
 
 using namespace std;
 
@@ -54,6 +57,13 @@ using namespace std;
 #define VEHICLE_POLL_TYPE_OBDIIEXTENDED 0x22 // enhanced data by 16 bit PID
 
 #define VEHICLE_POLL_NSTATES            4
+#define VEHICLE_POLL_MULTIPID           6    // max PIDs per Mode 01 request
+
+#define VEHICLE_POLL_DEFAULT_TIMEBASE   1000 // polltime unit [ms]
+#define VEHICLE_POLL_DEFAULT_TIMEOUT    1000 // response timeout [ms]
+#define VEHICLE_POLL_DEFAULT_GAP        10   // min gap between requests on a bus [ms]
+#define VEHICLE_POLL_BROADCAST_WAIT     100  // broadcast: wait for more ECUs after the first response [ms]
+#define VEHICLE_POLL_DEFAULT_ADAPTMAX   8    // max interval multiplier for adaptive polling
 
 
 // Standard MSG protocol commands:
@@ -104,8 +114,13 @@ class OvmsVehicle
   private:
     void VehicleTicker1(std::string event, void* data);
     void VehicleConfigChanged(std::string event, void* data);
-    void PollerSend();
-    void PollerReceive(CAN_frame_t* frame);
+    void PollerRun(int64_t now);
+    void PollerSend(int64_t now, int64_t& next);
+    void PollerConfig();
+    void PollerWakeup();
+    void PollerReceive(canisotp_session* session, uint16_t frame, uint8_t* data, uint16_t length, uint16_t remain);
+    void PollerError(canisotp_session* session, canisotp_error_t error);
+    void PollerLatency(int64_t rxtime);
 
   protected:
     virtual void IncomingFrameCan1(CAN_frame_t* p_frame);
@@ -129,6 +144,22 @@ class OvmsVehicle
   protected:
     void RegisterCanBus(int bus, CAN_mode_t mode, CAN_speed_t speed);
 
+  protected:
+    dbctable* m_dbc[3];                       // DBC decoding tables for can1..can3
+    SemaphoreHandle_t m_dbc_mutex;
+
+  public:
+    bool LoadDBC(int bus, const char* path, std::string& error);
+    void UnloadDBC(int bus);
+    typedef struct
+      {
+      std::string path;
+      uint32_t messages;
+      uint32_t signals;
+      uint32_t skipped;
+      } dbc_info_t;
+    bool GetDBCInfo(int bus, dbc_info_t& info);
+
   public:
     virtual void RxTask();
 
@@ -178,26 +209,131 @@ class OvmsVehicle
       uint16_t type;
       uint16_t pid;
       uint16_t polltime[VEHICLE_POLL_NSTATES];
+      uint8_t morepids[VEHICLE_POLL_MULTIPID-1];  // Mode 01: additional PIDs (0 = none)
       } poll_pid_t;
 
+    typedef struct
+      {
+      uint16_t ml_remain;                     // Multi frame response state
+      uint16_t ml_offset;
+      uint16_t ml_frame;
+      std::vector<uint8_t> buf;               // Response payload (runtime entries)
+      uint32_t hash;                          // Response payload hash (adaptive polling)
+      } poll_rxstate_t;
+
+    typedef struct
+      {
+      uint32_t txid;                          // Request ID (0x7df = broadcast)
+      uint32_t rxlow;                         // Response ID range
+      uint32_t rxhigh;
+      const poll_pid_t* entry;                // Entry in flight / last polled
+      bool wait;                              // Request in flight, accepting responses
+      int64_t sent;                           // Request time [us]
+      int64_t deadline;                       // End of response wait [us]
+      uint16_t responses;                     // Complete responses to the request
+      bool answered;                          // Any response (incl. negative)
+      uint32_t hash;                          // Sum of response hashes (adaptive polling)
+      std::vector<poll_rxstate_t> rx;         // Response state per response ID
+      } poll_channel_t;
+
+    typedef struct
+      {
+      uint32_t hash;                          // Payload hash of last response
+      uint16_t scale;                         // Current interval multiplier
+      } poll_adapt_t;
+
+    typedef struct
+      {
+      uint16_t offset;                        // Byte offset into response payload
+      uint8_t length;                         // Bytes (1..4, MSB first)
+      bool is_signed;                         // Two's complement value
+      float scale;                            // Metric value = raw * scale + add
+      float add;
+      OvmsMetric* metric;
+      } poll_decode_t;
+
+    typedef struct
+      {
+      uint32_t requests;
+      uint32_t responses;
+      uint32_t timeouts;
+      uint32_t errors;                        // ISO-TP errors
+      uint32_t nrcs;                          // Negative responses (except 0x78)
+      uint32_t pending;                       // 0x78 "response pending"
+      uint8_t lastnrc;                        // Last negative response code
+      canlatency latency;                     // Request to response latency
+      } poll_stats_t;
+
+  public:
+    void PollerStatus(OvmsWriter* writer, bool histogram);
+    void PollerResetStats();
+    bool PollerLoadList(std::string& error);
+    void PollerListStatus(OvmsWriter* writer);
+    void PollerAdaptReset();
+
+  private:
+    void PollerBuildList();
+    bool PollerParseEntry(const std::string& line, std::string& error);
+    void PollerDecode(const poll_channel_t& ch, const poll_rxstate_t& rx);
+    void PollerAdapt(size_t idx, const poll_channel_t& ch);
+    void PollerUpdateMetrics();
+    bool PollerChannelBusy(size_t c);
+    int PollerFindChannel(canisotp_session* session);
+    void PollerSetContext(const poll_channel_t& ch, const poll_rxstate_t& rx, uint32_t rxid);
+    void PollerDone(poll_channel_t& ch);
+
   protected:
     uint8_t           m_poll_state;           // Current poll state
     canbus*           m_poll_bus;             // Bus to poll on
     const poll_pid_t* m_poll_plist;           // Head of poll list
-    const poll_pid_t* m_poll_plcur;           // Current position in poll list
-    uint32_t          m_poll_ticker;          // Polling ticker
+    const poll_pid_t* m_poll_modlist;         // Poll list of the vehicle module
+    std::vector<poll_pid_t> m_poll_list;      // Active list: module + runtime entries
+    std::vector<poll_pid_t> m_poll_rtlist;    // Runtime entries (config / file)
+    std::vector<poll_decode_t> m_poll_rtdecode;   // Decode specs of runtime entries
+    std::vector<uint16_t> m_poll_rtfirst;     // First decode spec per runtime entry
+    size_t            m_poll_rtbase;          // Index of first runtime entry in active list
+    std::string       m_poll_rtfile;          // Runtime poll list file loaded
+    const poll_pid_t* m_poll_plcur;           // Entry currently polled
+    std::vector<int64_t> m_poll_due;          // Next due time per entry [us]
+    uint32_t          m_poll_index;           // Round robin position in poll list
+    uint16_t          m_poll_timebase;        // polltime unit [ms]
+    std::vector<poll_channel_t> m_poll_channels;  // One request in flight per ECU
+    std::vector<uint16_t> m_poll_entrychan;   // Channel index per entry
+    int64_t           m_poll_next;            // Next scheduler run [us]
+    int64_t           m_poll_lastsend;        // Time of last request on bus [us]
+    uint32_t          m_poll_gap;             // Min gap between requests [us]
+    uint32_t          m_poll_timeout;         // Response timeout [us]
+    uint8_t           m_poll_fcbs;            // ISO-TP block size sent in FC
+    uint8_t           m_poll_fcstmin;         // ISO-TP STmin sent in FC
+    SemaphoreHandle_t m_poll_mutex;
+    // Context of the response currently processed (see IncomingPollReply):
     uint32_t          m_poll_moduleid_sent;   // ModuleID last sent
     uint32_t          m_poll_moduleid_low;    // Expected response moduleid low mark
+    uint32_t          m_poll_moduleid_rec;    // ModuleID of the responding ECU
     uint32_t          m_poll_moduleid_high;   // Expected response moduleid high mark
     uint16_t          m_poll_type;            // Expected type
     uint16_t          m_poll_pid;             // Expected PID
     uint16_t          m_poll_ml_remain;       // Bytes remainign for ML poll
     uint16_t          m_poll_ml_offset;       // Offset of ML poll
     uint16_t          m_poll_ml_frame;        // Frame number for ML poll
+    int64_t           m_poll_sent;            // Time of last request [us]
+    uint32_t          m_poll_latency;         // Response latency of last poll [us]
+    std::vector<poll_stats_t> m_poll_stats;   // Statistics per entry
+    std::vector<poll_adapt_t> m_poll_adapt;   // Adaptive interval state per entry
+    uint16_t          m_poll_adaptmax;        // Max interval multiplier (1 = adaptive off)
+    OvmsMetricInt*    m_poll_metric_requests;
+    OvmsMetricInt*    m_poll_metric_responses;
+    OvmsMetricInt*    m_poll_metric_timeouts;
+    OvmsMetricInt*    m_poll_metric_nrcs;
+    OvmsMetricInt*    m_poll_metric_latency;
+
+  protected:
+    canisotp          m_isotp;                // ISO-TP sessions (poller & vehicle module)
 
   protected:
     void PollSetPidList(canbus* bus, const poll_pid_t* plist);
     void PollSetState(uint8_t state);
+    void PollSetTimeBase(uint16_t ms);
   };
 
 template<typename Type> OvmsVehicle* CreateVehicle()
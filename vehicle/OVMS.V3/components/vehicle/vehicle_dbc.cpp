@@ -0,0 +1,332 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          18th October 2026
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+#include "ovms_log.h"
+static const char *TAG = "vehicle-dbc";
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include "vehicle_dbc.h"
+#include "metrics_standard.h"
+
+// DBC signal as parsed, before compilation:
+typedef struct
+  {
+  uint32_t key;
+  std::string name;
+  uint32_t start;
+  uint32_t length;
+  uint8_t flags;
+  float scale;
+  float offset;
+  std::string unit;
+  } dbc_rawsignal_t;
+
+static metric_unit_t dbc_unit(const std::string& unit)
+  {
+  static const struct { const char* dbc; metric_unit_t unit; } map[] =
+    {
+    { "km", Kilometers }, { "mi", Miles }, { "m", Meters },
+    { "degC", Celcius }, { "\xb0" "C", Celcius }, { "C", Celcius }, { "degF", Fahrenheit },
+    { "kPa", kPa }, { "Pa", Pa }, { "psi", PSI },
+    { "V", Volts }, { "A", Amps }, { "Ah", AmpHours }, { "kW", kW }, { "kWh", kWh },
+    { "s", Seconds }, { "min", Minutes }, { "h", Hours },
+    { "deg", Degrees }, { "km/h", Kph }, { "kph", Kph }, { "mph", Mph },
+    { "%", Percentage },
+    { NULL, Other }
+    };
+  for (int i = 0; map[i].dbc; i++)
+    {
+    if (unit == map[i].dbc)
+      return map[i].unit;
+    }
+  return Other;
+  }
+
+static const char* dbc_skipspace(const char* p)
+  {
+  while (*p == ' ' || *p == '\t')
+    p++;
+  return p;
+  }
+
+dbctable::dbctable()
+  {
+  m_skipped = 0;
+  }
+
+dbctable::~dbctable()
+  {
+  }
+
+void dbctable::Clear()
+  {
+  m_messages.clear();
+  m_signals.clear();
+  m_skipped = 0;
+  m_path.clear();
+  }
+
+/**
+ * dbctable::Load -- read & compile DBC file
+ *    - returns false on error (file not readable / no signals mapped)
+ *    - error: error / warning text
+ */
+bool dbctable::Load(const char* path, std::string& error)
+  {
+  FILE* f = fopen(path, "r");
+  if (!f)
+    {
+    error = "cannot open file";
+    return false;
+    }
+
+  std::vector<dbc_rawsignal_t> raw;
+  std::map<std::string, std::string> mapping;   // "<key>/<signal>" → metric name
+  char line[512];
+  char name[64], mname[64], attr[32];
+  uint32_t key = 0;
+  bool inmsg = false;
+  uint32_t skipped = 0;
+
+  while (fgets(line, sizeof(line), f))
+    {
+    const char* p = dbc_skipspace(line);
+    if (strncmp(p, "BO_ ", 4) == 0)
+      {
+      unsigned long id;
+      inmsg = (sscanf(p, "BO_ %lu", &id) == 1);
+      key = (id & 0x80000000) ? ((id & 0x1fffffff) | CAN_IDKEY_EXT) : (id & 0x7ff);
+      }
+    else if (strncmp(p, "SG_ ", 4) == 0 && inmsg)
+      {
+      dbc_rawsignal_t sig;
+      int n = 0;
+      if (sscanf(p, "SG_ %63s %n", name, &n) != 1)
+        continue;
+      p += n;
+      if (*p != ':')
+        {
+        // multiplexer indicator: accept the multiplexor, skip multiplexed signals
+        if (*p == 'm')
+          {
+          skipped++;
+          continue;
+          }
+        while (*p && *p != ':')
+          p++;
+        }
+      unsigned start, length;
+      char order, sign;
+      n = 0;
+      if (sscanf(p, ": %u|%u@%c%c (%f,%f) %n", &start, &length, &order, &sign, &sig.scale, &sig.offset, &n) != 6 || n == 0)
+        {
+        skipped++;
+        continue;
+        }
+      sig.key = key;
+      sig.name = name;
+      sig.start = start;
+      sig.length = length;
+      sig.flags = ((order == '0') ? DBC_SIG_BIGENDIAN : 0) | ((sign == '-') ? DBC_SIG_SIGNED : 0);
+      const char* u = strchr(p + n, '"');
+      const char* ue = u ? strchr(u + 1, '"') : NULL;
+      if (u && ue)
+        sig.unit.assign(u + 1, ue - u - 1);
+      raw.push_back(sig);
+      }
+    else if (strncmp(p, "BA_ ", 4) == 0)
+      {
+      unsigned long id;
+      if (sscanf(p, "BA_ \"%31[^\"]\" SG_ %lu %63s \"%63[^\"]\"", attr, &id, name, mname) == 4
+        && strcmp(attr, "OvmsMetric") == 0)
+        {
+        uint32_t akey = (id & 0x80000000) ? ((id & 0x1fffffff) | CAN_IDKEY_EXT) : (id & 0x7ff);
+        char k[16];
+        snprintf(k, sizeof(k), "%x/", akey);
+        mapping[std::string(k) + name] = mname;
+        }
+      }
+    else if (*p && *p != '\n' && *p != '\r')
+      {
+      inmsg = false;
+      }
+    }
+  fclose(f);
+
+  // Compile signals mapped to metrics:
+  std::stable_sort(raw.begin(), raw.end(),
+    [](const dbc_rawsignal_t& a, const dbc_rawsignal_t& b) { return a.key < b.key; });
+  std::vector<dbc_message_t> messages;
+  std::vector<dbc_signal_t> signals;
+  for (auto& r : raw)
+    {
+    // find metric:
+    char k[16];
+    snprintf(k, sizeof(k), "%x/", r.key);
+    auto m = mapping.find(std::string(k) + r.name);
+    OvmsMetric* metric = NULL;
+    if (m != mapping.end())
+      {
+      metric = MyMetrics.Find(m->second.c_str());
+      if (!metric)
+        metric = new OvmsMetricFloat(strdup(m->second.c_str()), SM_STALE_MID, dbc_unit(r.unit));
+      }
+    else
+      {
+      std::string mn = r.name;
+      std::replace(mn.begin(), mn.end(), '_', '.');
+      metric = MyMetrics.Find(mn.c_str());
+      }
+    if (!metric)
+      {
+      skipped++;
+      continue;
+      }
+
+    // compile bit position:
+    dbc_signal_t sig;
+    if (r.length < 1 || r.length > 64)
+      {
+      skipped++;
+      continue;
+      }
+    if (r.flags & DBC_SIG_BIGENDIAN)
+      {
+      // Motorola: start = MSB, bit numbering within byte; convert to
+      //  big endian frame word bit position (0 = MSB of first byte):
+      uint32_t msb = (r.start / 8) * 8 + (7 - (r.start % 8));
+      uint32_t lsb = msb + r.length - 1;
+      if (lsb > 63)
+        {
+        skipped++;
+        continue;
+        }
+      sig.shift = 63 - lsb;
+      }
+    else
+      {
+      if (r.start + r.length > 64)
+        {
+        skipped++;
+        continue;
+        }
+      sig.shift = r.start;
+      }
+    sig.length = r.length;
+    sig.flags = r.flags;
+    sig.scale = r.scale;
+    sig.offset = r.offset;
+    sig.unit = dbc_unit(r.unit);
+    sig.metric = metric;
+
+    if (messages.empty() || messages.back().key != r.key)
+      {
+      dbc_message_t msg;
+      msg.key = r.key;
+      msg.first = signals.size();
+      msg.count = 0;
+      messages.push_back(msg);
+      }
+    messages.back().count++;
+    signals.push_back(sig);
+    }
+
+  if (signals.empty())
+    {
+    error = "no signals mapped to metrics";
+    return false;
+    }
+
+  m_messages.swap(messages);
+  m_signals.swap(signals);
+  m_skipped = skipped;
+  m_path = path;
+  ESP_LOGI(TAG, "Loaded %s: %d messages, %d signals, %d skipped",
+    path, m_messages.size(), m_signals.size(), m_skipped);
+  return true;
+  }
+
+const dbc_message_t* dbctable::Find(uint32_t key) const
+  {
+  int lo = 0, hi = (int)m_messages.size() - 1;
+  while (lo <= hi)
+    {
+    int mid = (lo + hi) >> 1;
+    if (m_messages[mid].key < key)
+      lo = mid + 1;
+    else if (m_messages[mid].key > key)
+      hi = mid - 1;
+    else
+      return &m_messages[mid];
+    }
+  return NULL;
+  }
+
+/**
+ * dbctable::Decode -- extract all signals of a frame into their metrics
+ *    - returns false if the frame ID is not in the table
+ */
+bool dbctable::Decode(const CAN_frame_t* p_frame) const
+  {
+  uint32_t key = p_frame->MsgID;
+  if (p_frame->FIR.B.FF == CAN_frame_ext)
+    key |= CAN_IDKEY_EXT;
+  const dbc_message_t* msg = Find(key);
+  if (!msg)
+    return false;
+
+  // load frame once in both byte orders:
+  uint64_t le = (uint64_t)p_frame->data.u32[0] | ((uint64_t)p_frame->data.u32[1] << 32);
+  uint64_t be = __builtin_bswap64(le);
+
+  const dbc_signal_t* sig = &m_signals[msg->first];
+  for (int i = 0; i < msg->count; i++, sig++)
+    {
+    uint64_t v = ((sig->flags & DBC_SIG_BIGENDIAN) ? be : le) >> sig->shift;
+    float value;
+    if (sig->length < 64)
+      {
+      uint64_t mask = (1ULL << sig->length) - 1;
+      v &= mask;
+      if ((sig->flags & DBC_SIG_SIGNED) && (v >> (sig->length - 1)))
+        v |= ~mask;
+      }
+    if (sig->flags & DBC_SIG_SIGNED)
+      value = (int64_t)v;
+    else
+      value = v;
+    sig->metric->SetFloat(value * sig->scale + sig->offset, sig->unit);
+    }
+  return true;
+  }
@@ -0,0 +1,100 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          18th October 2026
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+#ifndef __VEHICLE_DBC_H__
+#define __VEHICLE_DBC_H__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "can.h"
+#include "ovms_metrics.h"
+
+#define DBC_SIG_SIGNED      0x01      // two's complement value
+#define DBC_SIG_BIGENDIAN   0x02      // Motorola byte order
+
+// Compiled signal: extracted by (data >> shift) & mask
+typedef struct
+  {
+  uint8_t shift;                      // LSB position in the 64 bit frame word
+  uint8_t length;                     // bits
+  uint8_t flags;                      // DBC_SIG_*
+  float scale;
+  float offset;
+  metric_unit_t unit;
+  OvmsMetric* metric;
+  } dbc_signal_t;
+
+// Compiled message: signal index range
+typedef struct
+  {
+  uint32_t key;                       // MsgID | CAN_IDKEY_EXT (if extended)
+  uint16_t first;                     // index of first signal
+  uint16_t count;                     // number of signals
+  } dbc_message_t;
+
+/**
+ * dbctable: DBC based signal decoding table
+ *  Load() reads a DBC file and compiles all signals mapped to a metric into
+ *  an ID sorted message table with a contiguous signal array, so Decode()
+ *  costs one binary search plus one 64 bit load per frame and a shift/mask
+ *  per signal.
+ *  Metric mapping (signals without mapping are ignored):
+ *    BA_ "OvmsMetric" SG_ <id> <signal> "<metric>";
+ *    or a signal name matching a metric name with '.' replaced by '_'
+ *  Multiplexed signals are not supported (skipped).
+ *  Note: not thread safe, the table must not be changed while decoding.
+ */
+class dbctable
+  {
+  public:
+    dbctable();
+    ~dbctable();
+
+  public:
+    bool Load(const char* path, std::string& error);
+    void Clear();
+    const dbc_message_t* Find(uint32_t key) const;
+    bool Decode(const CAN_frame_t* p_frame) const;
+
+  public:
+    uint32_t GetMessageCount() const { return m_messages.size(); }
+    uint32_t GetSignalCount() const { return m_signals.size(); }
+    uint32_t GetSkippedCount() const { return m_skipped; }
+    std::string GetPath() const { return m_path; }
+
+  protected:
+    std::vector<dbc_message_t>  m_messages;   // sorted by key
+    std::vector<dbc_signal_t>   m_signals;
+    uint32_t                    m_skipped;    // DBC signals without metric / unsupported
+    std::string                 m_path;
+  };
+
+#endif //#ifndef __VEHICLE_DBC_H__
@@ -174,79 +174,63 @@ void vehicle_nissanleaf_charger_status(ChargerStatus status)
 
 ////////////////////////////////////////////////////////////////////////
 // PollStart()
-// Send the initial message to poll for data. Further data is requested
-// in vehicle_nissanleaf_poll_continue() after the recept of each page.
+// Send the poll request for LBC group 1. The multi frame response is
+// received page by page (block size 1) by the ISO-TP session.
 //
 
 void OvmsVehicleNissanLeaf::PollStart(void)
   {
+  using std::placeholders::_1;
+  using std::placeholders::_2;
+  using std::placeholders::_3;
+  using std::placeholders::_4;
+  using std::placeholders::_5;
+  canisotp_session* session = m_isotp.Open(m_can1, 0x79b, 0x7bb,
+    std::bind(&OvmsVehicleNissanLeaf::PollReceive, this, _1, _2, _3, _4, _5));
+  session->m_bs = 1;
+  session->m_stmin = 0;
+
   // Request Group 1
-  uint8_t data[] = {0x02, 0x21, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00};
-  nl_poll_state = ZERO;
-  m_can1->WriteStandard(0x79b, 8, data);
+  uint8_t data[] = {0x21, 0x01};
+  m_isotp.Send(session, data, sizeof(data));
   }
 
 ////////////////////////////////////////////////////////////////////////
-// vehicle_nissanleaf_poll_continue()
-// Process a 0x7bb polling response and request the next page
+// PollReceive()
+// Collect the 0x7bb polling response and decode it when complete
 //
 
-void OvmsVehicleNissanLeaf::PollContinue(CAN_frame_t* p_frame)
+void OvmsVehicleNissanLeaf::PollReceive(canisotp_session* session, uint16_t frame, uint8_t* data, uint16_t length, uint16_t remain)
   {
-  uint8_t *d = p_frame->data.u8;
-  uint16_t hx;
-  uint32_t ah;
-  if (nl_poll_state == IDLE)
-    {
-    // we're not expecting anything, maybe something else is polling?
+  if (frame == 0)
+    nl_poll_buffer.clear();
+  nl_poll_buffer.append((const char*)data, length);
+  if (remain > 0)
     return;
-    }
-  if ((d[0] & 0x0f) != nl_poll_state)
+
+  const uint8_t* d = (const uint8_t*)nl_poll_buffer.data();
+  if (nl_poll_buffer.size() < 38 || d[0] != 0x61 || d[1] != 0x01)
     {
-    // not the page we were expecting, abort
-    nl_poll_state = IDLE;
+    // not the response we were expecting
     return;
     }
 
-  switch (nl_poll_state)
-    {
-    case IDLE:
-      // this isn't possible due to the idle check above
-      abort();
-    case ZERO:
-    case ONE:
-    case TWO:
-    case THREE:
-      // TODO this might not be idomatic C++ but I want to keep the delta to
-      // the v2 code small until the porting is finished
-      nl_poll_state = static_cast<PollState>(static_cast<int>(nl_poll_state) + 1);
-      break;
-    case FOUR:
-      hx = d[2];
-      hx = hx << 8;
-      hx = hx | d[3];
-      // LeafSpy calculates SOH by dividing Ah by the nominal capacity.
-      // Since SOH is derived from Ah, we don't bother storing it separately.
-      // Instead we store Ah in CAC (below) and store Hx in SOH.
-      StandardMetrics.ms_v_bat_soh->SetValue(hx / 100.0);
-      nl_poll_state = static_cast<PollState>(static_cast<int>(nl_poll_state) + 1);
-      break;
-    case FIVE:
-      ah = d[2];
-      ah = ah << 8;
-      ah = ah | d[3];
-      ah = ah << 8;
-      ah = ah | d[4];
-      StandardMetrics.ms_v_bat_cac->SetValue(ah / 10000.0);
-      nl_poll_state = IDLE;
-      break;
-    }
-  if (nl_poll_state != IDLE)
-    {
-    // request the next page of data
-    uint8_t next[] = {0x30, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
-    m_can1->WriteStandard(0x79b, 8, next);
-    }
+  uint16_t hx;
+  uint32_t ah;
+  hx = d[28];
+  hx = hx << 8;
+  hx = hx | d[29];
+  // LeafSpy calculates SOH by dividing Ah by the nominal capacity.
+  // Since SOH is derived from Ah, we don't bother storing it separately.
+  // Instead we store Ah in CAC (below) and store Hx in SOH.
+  StandardMetrics.ms_v_bat_soh->SetValue(hx / 100.0);
+
+  ah = d[35];
+  ah = ah << 8;
+  ah = ah | d[36];
+  ah = ah << 8;
+  ah = ah | d[37];
+  StandardMetrics.ms_v_bat_cac->SetValue(ah / 10000.0);
   }
 
 void OvmsVehicleNissanLeaf::IncomingFrameCan1(CAN_frame_t* p_frame)
@@ -435,9 +419,6 @@ void OvmsVehicleNissanLeaf::IncomingFrameCan1(CAN_frame_t* p_frame)
         StandardMetrics.ms_v_bat_temp->SetValue(d[2] / 2 - 40);
         }
       break;
-    case 0x7bb:
-      PollContinue(p_frame);
-      break;
     }
   }
 
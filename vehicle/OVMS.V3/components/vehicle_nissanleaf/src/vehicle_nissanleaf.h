@@ -46,17 +46,6 @@
 
 using namespace std;
 
-typedef enum
-  {
-  ZERO = 0,
-  ONE = 1,
-  TWO = 2,
-  THREE = 3,
-  FOUR = 4,
-  FIVE = 5,
-  IDLE = 6
-  } PollState;
-
 typedef enum
   {
   ENABLE_CLIMATE_CONTROL,
@@ -86,7 +75,7 @@ class OvmsVehicleNissanLeaf : public OvmsVehicle
 
   private:
     void PollStart(void);
-    void PollContinue(CAN_frame_t* p_frame);
+    void PollReceive(canisotp_session* session, uint16_t frame, uint8_t* data, uint16_t length, uint16_t remain);
     void SendCanMessage(uint16_t id, uint8_t length, uint8_t *data);
     void Ticker1(uint32_t ticker);
     void Ticker60(uint32_t ticker);
@@ -94,7 +83,7 @@ class OvmsVehicleNissanLeaf : public OvmsVehicle
     OvmsVehicle::vehicle_command_t RemoteCommandHandler(RemoteCommand command);
     OvmsVehicle::vehicle_command_t CommandStartCharge();
 
-    PollState nl_poll_state = IDLE;
+    std::string nl_poll_buffer; // LBC group 1 response
     RemoteCommand nl_remote_command; // command to send, see ticker10th()
     uint8_t nl_remote_command_ticker; // number of tenths remaining to send remote command frames
     uint16_t nl_cc_off_ticker; // seconds before we send the climate control off command
@@ -32,30 +32,65 @@
 static const char *TAG = "v-obdii";
 
 #include <stdio.h>
+#include <string.h>
+#include "esp_timer.h"
 #include "vehicle_obdii.h"
 
 static const OvmsVehicle::poll_pid_t obdii_polls[]
   =
   {
-    { 0x7df, 0, VEHICLE_POLL_TYPE_OBDIICURRENT, 0x05, {  0, 30, 30 } }, // Engine coolant temp
-    { 0x7df, 0, VEHICLE_POLL_TYPE_OBDIICURRENT, 0x0c, { 10, 10, 10 } }, // Engine RPM
-    { 0x7df, 0, VEHICLE_POLL_TYPE_OBDIICURRENT, 0x0d, {  0, 10, 10 } }, // Speed
-    { 0x7df, 0, VEHICLE_POLL_TYPE_OBDIICURRENT, 0x0f, {  0, 30, 30 } }, // Engine air intake temp
-    { 0x7df, 0, VEHICLE_POLL_TYPE_OBDIICURRENT, 0x2f, {  0, 30, 30 } }, // Fuel level
-    { 0x7df, 0, VEHICLE_POLL_TYPE_OBDIICURRENT, 0x46, {  0, 30, 30 } }, // Ambiant temp
-//    { 0x7df, 0, VEHICLE_POLL_TYPE_OBDIICURRENT, 0x5c, {  0, 30, 30 } }, // Engine oil temp
-    { 0x7df, 0, VEHICLE_POLL_TYPE_OBDIIVEHICLE, 0x02, {999,999,999 } }, // VIN
-    { 0, 0, 0x00, 0x00, { 0, 0, 0 } }
+    { 0x7df, 0, VEHICLE_POLL_TYPE_OBDIICURRENT, 0x05, {  0, 30, 30 }, {} }, // Engine coolant temp
+    { 0x7df, 0, VEHICLE_POLL_TYPE_OBDIICURRENT, 0x0c, { 10, 10, 10 }, {} }, // Engine RPM
+    { 0x7df, 0, VEHICLE_POLL_TYPE_OBDIICURRENT, 0x0d, {  0, 10, 10 }, {} }, // Speed
+    { 0x7df, 0, VEHICLE_POLL_TYPE_OBDIICURRENT, 0x0f, {  0, 30, 30 }, {} }, // Engine air intake temp
+    { 0x7df, 0, VEHICLE_POLL_TYPE_OBDIICURRENT, 0x2f, {  0, 30, 30 }, {} }, // Fuel level
+    { 0x7df, 0, VEHICLE_POLL_TYPE_OBDIICURRENT, 0x46, {  0, 30, 30 }, {} }, // Ambiant temp
+    { 0x7df, 0, VEHICLE_POLL_TYPE_OBDIICURRENT, 0x5c, {  0, 30, 30 }, {} }, // Engine oil temp
+    { 0x7df, 0, VEHICLE_POLL_TYPE_OBDIIVEHICLE, 0x02, {999,999,999 }, {} }, // VIN
+    { 0, 0, 0x00, 0x00, { 0, 0, 0 }, {} }
   };
 
+// Supported PID discovery: all bitmaps in one multi PID request,
+// repeated until an ECU answers (i.e. ignition off on startup)
+static const OvmsVehicle::poll_pid_t obdii_discovery[]
+  =
+  {
+    { 0x7df, 0, VEHICLE_POLL_TYPE_OBDIICURRENT, 0x00, { 10, 10, 10, 10 }, { 0x20, 0x40, 0x60, 0x80, 0xa0 } },
+    { 0x7df, 0, VEHICLE_POLL_TYPE_OBDIIVEHICLE, 0x02, {999,999,999 }, {} }, // VIN
+    { 0, 0, 0x00, 0x00, { 0, 0, 0 }, {} }
+  };
+
+// Mode 01 response data lengths (SAE J1979), 0 = unknown:
+static const uint8_t obdii_pidlen[0x68]
+  =
+  {
+  //0  1  2  3  4  5  6  7  8  9  a  b  c  d  e  f
+    4, 4, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 2, 1, 1, 1,   // 0x00
+    2, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2, 1, 1, 1, 2,   // 0x10
+    4, 2, 2, 2, 4, 4, 4, 4, 4, 4, 4, 4, 1, 1, 1, 1,   // 0x20
+    1, 2, 2, 1, 4, 4, 4, 4, 4, 4, 4, 4, 2, 2, 2, 2,   // 0x30
+    4, 4, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 4,   // 0x40
+    4, 1, 1, 2, 2, 2, 2, 2, 2, 2, 1, 1, 1, 2, 2, 1,   // 0x50
+    4, 1, 1, 2, 5, 2, 5, 3                            // 0x60
+  };
+
+static uint8_t obdii_datalen(uint8_t pid)
+  {
+  if ((pid & 0x1f) == 0)
+    return 4; // supported PIDs bitmap
+  return (pid < sizeof(obdii_pidlen)) ? obdii_pidlen[pid] : 0;
+  }
+
 OvmsVehicleOBDII::OvmsVehicleOBDII()
   {
   ESP_LOGI(TAG, "Generic OBDII vehicle module");
 
   memset(m_vin,0,sizeof(m_vin));
+  memset(m_supported,0,sizeof(m_supported));
+  m_discovery_due = 0;
 
   RegisterCanBus(1,CAN_MODE_ACTIVE,CAN_SPEED_500KBPS);
-  PollSetPidList(m_can1,obdii_polls);
+  PollSetPidList(m_can1,obdii_discovery);
   PollSetState(0);
   }
 
@@ -64,21 +99,140 @@ OvmsVehicleOBDII::~OvmsVehicleOBDII()
   ESP_LOGI(TAG, "Shutdown OBDII vehicle module");
   }
 
-void OvmsVehicleOBDII::IncomingPollReply(canbus* bus, uint16_t type, uint16_t pid, uint8_t* data, uint8_t length, uint16_t mlremain)
+bool OvmsVehicleOBDII::IsSupported(uint8_t pid)
   {
-  int value1 = (int)data[0];
-  int value2 = ((int)data[0] << 8) + (int)data[1];
+  if (pid == 0)
+    return true;
+  return (m_supported[(pid-1) >> 5] & (1u << (31 - ((pid-1) & 31)))) != 0;
+  }
 
-  switch (pid)
+/**
+ * Ticker1: rebuild the poll list once the discovery request has timed out,
+ *  so the bitmaps of all responding ECUs are merged
+ */
+void OvmsVehicleOBDII::Ticker1(uint32_t ticker)
+  {
+  xSemaphoreTakeRecursive(m_poll_mutex, portMAX_DELAY);
+  if (m_discovery_due != 0 && esp_timer_get_time() >= m_discovery_due)
+    {
+    m_discovery_due = 0;
+    m_rxbuf.clear();
+    BuildPollList();
+    }
+  xSemaphoreGiveRecursive(m_poll_mutex);
+  }
+
+/**
+ * BuildPollList: poll the supported PIDs, packing Mode 01 PIDs of equal
+ *  poll intervals into multi PID requests (up to 6 PIDs per request)
+ */
+void OvmsVehicleOBDII::BuildPollList()
+  {
+  m_polls.clear();
+  for (const poll_pid_t* entry = obdii_polls; entry->txmoduleid != 0; entry++)
+    {
+    if (entry->type == VEHICLE_POLL_TYPE_OBDIICURRENT)
+      {
+      if (!IsSupported(entry->pid))
+        continue;
+      bool packed = false;
+      for (poll_pid_t& group : m_polls)
+        {
+        if (group.type != VEHICLE_POLL_TYPE_OBDIICURRENT || group.txmoduleid != entry->txmoduleid
+          || memcmp(group.polltime, entry->polltime, sizeof(group.polltime)) != 0)
+          continue;
+        uint8_t* free = (uint8_t*) memchr(group.morepids, 0, sizeof(group.morepids));
+        if (free)
+          {
+          *free = entry->pid;
+          packed = true;
+          break;
+          }
+        }
+      if (packed)
+        continue;
+      }
+    m_polls.push_back(*entry);
+    }
+  ESP_LOGI(TAG, "Supported PIDs discovered, %d poll requests", m_polls.size());
+  poll_pid_t end = {};
+  m_polls.push_back(end);
+  PollSetPidList(m_can1, m_polls.data());
+  }
+
+void OvmsVehicleOBDII::IncomingPollReply(canbus* bus, uint16_t type, uint16_t pid, uint8_t* data, uint8_t length, uint16_t mlremain)
+  {
+  if (type == VEHICLE_POLL_TYPE_OBDIIVEHICLE)
     {
-    case 0x02:  // VIN (multi-line response)
+    if (pid == 0x02)  // VIN (multi-line response)
+      {
       strncat(m_vin,(char*)data,length);
       if (mlremain==0)
         {
         StandardMetrics.ms_v_vin->SetValue(m_vin);
         m_vin[0] = 0;
         }
+      }
+    return;
+    }
+
+  if (type != VEHICLE_POLL_TYPE_OBDIICURRENT)
+    return;
+
+  if (!m_poll_plcur->morepids[0])
+    {
+    // Single PID response:
+    IncomingPid(pid, data, length);
+    return;
+    }
+
+  // Multi PID response: collect <pid><data> records, then demultiplex:
+  //  (responses of multiple ECUs may interleave)
+  std::string& rxbuf = m_rxbuf[m_poll_moduleid_rec];
+  if (m_poll_ml_frame == 0)
+    rxbuf.clear();
+  rxbuf.append((char*)data, length);
+  if (mlremain != 0)
+    return;
+
+  bool discovery = false;
+  const uint8_t* rec = (const uint8_t*) rxbuf.data();
+  const uint8_t* end = rec + rxbuf.size();
+  while (rec < end)
+    {
+    uint8_t len = obdii_datalen(rec[0]);
+    if (len == 0 || rec + 1 + len > end)
+      {
+      ESP_LOGW(TAG, "Multi PID response: unknown data length for PID %02x", rec[0]);
       break;
+      }
+    if ((rec[0] & 0x1f) == 0)
+      {
+      uint32_t bits = ((uint32_t)rec[1] << 24) | ((uint32_t)rec[2] << 16) | ((uint32_t)rec[3] << 8) | rec[4];
+      if ((m_supported[rec[0] >> 5] | bits) != m_supported[rec[0] >> 5])
+        {
+        m_supported[rec[0] >> 5] |= bits;
+        discovery = true;
+        }
+      }
+    else
+      IncomingPid(rec[0], rec+1, len);
+    rec += 1 + len;
+    }
+
+  // New PIDs supported: rebuild the poll list when the discovery request
+  //  has timed out, other ECUs may still respond
+  if (discovery && m_discovery_due == 0)
+    m_discovery_due = m_poll_sent + m_poll_timeout;
+  }
+
+void OvmsVehicleOBDII::IncomingPid(uint8_t pid, const uint8_t* data, uint8_t length)
+  {
+  int value1 = (int)data[0];
+  int value2 = (length >= 2) ? ((int)data[0] << 8) + (int)data[1] : 0;
+
+  switch (pid)
+    {
     case 0x05:  // Engine coolant temperature
       StandardMetrics.ms_v_bat_temp->SetValue(value1 - 0x28);
       break;
@@ -31,6 +31,9 @@
 #ifndef __VEHICLE_OBDII_H__
 #define __VEHICLE_OBDII_H__
 
+#include <string>
+#include <vector>
+#include <map>
 #include "vehicle.h"
 
 using namespace std;
@@ -43,9 +46,17 @@ class OvmsVehicleOBDII : public OvmsVehicle
 
   protected:
     void IncomingPollReply(canbus* bus, uint16_t type, uint16_t pid, uint8_t* data, uint8_t length, uint16_t mlremain);
+    void IncomingPid(uint8_t pid, const uint8_t* data, uint8_t length);
+    bool IsSupported(uint8_t pid);
+    void BuildPollList();
+    void Ticker1(uint32_t ticker);
 
   protected:
     char m_vin[18];
+    uint32_t m_supported[8];                  // Mode 01 supported PIDs bitmaps (PID 0x00, 0x20, ...)
+    int64_t m_discovery_due;                  // Poll list rebuild after discovery [us], 0 = none
+    std::map<uint32_t, std::string> m_rxbuf;  // Mode 01 response assembly per ECU
+    std::vector<poll_pid_t> m_polls;          // Poll list (supported PIDs, packed)
   };
 
 #endif //#ifndef __VEHICLE_OBDII_H__
@@ -80,7 +80,8 @@ void OvmsVehicleRenaultTwizy::IncomingFrameCan1(CAN_frame_t* p_frame)
       {
         CAN_frame_t txframe = *p_frame;
         txframe.data.u8[0] = cfg_chargelevel;
-        txframe.Write();
+        // must be sent before the next original frame (100 ms):
+        txframe.origin->WriteClass(&txframe, CAN_TX_CONTROL, 100);
       }
       
       // Basic validation:
@@ -193,7 +194,8 @@ void OvmsVehicleRenaultTwizy::IncomingFrameCan1(CAN_frame_t* p_frame)
       {
         CAN_frame_t txframe = *p_frame;
         txframe.data.u8[0] = 0x12; // charge stop request
-        txframe.Write();
+        // must be sent before the next original frame (100 ms):
+        txframe.origin->WriteClass(&txframe, CAN_TX_CONTROL, 100);
       }
       
       // max drive (discharge) + recup (charge) power:
@@ -332,7 +332,7 @@ OvmsVehicle::vehicle_command_t OvmsVehicleTeslaRoadster::CommandSetChargeMode(ve
   frame.data.u8[5] = 0x00;
   frame.data.u8[6] = 0x00;
   frame.data.u8[7] = 0x00;
-  m_can1->Write(&frame);
+  m_can1->WriteClass(&frame, CAN_TX_CONTROL);
 
   return Success;
   }
@@ -355,7 +355,7 @@ OvmsVehicle::vehicle_command_t OvmsVehicleTeslaRoadster::CommandSetChargeCurrent
   frame.data.u8[5] = 0x00;
   frame.data.u8[6] = 0x00;
   frame.data.u8[7] = 0x00;
-  m_can1->Write(&frame);
+  m_can1->WriteClass(&frame, CAN_TX_CONTROL);
 
   return Success;
   }
@@ -378,7 +378,7 @@ OvmsVehicle::vehicle_command_t OvmsVehicleTeslaRoadster::CommandStartCharge()
   frame.data.u8[5] = 0x00;
   frame.data.u8[6] = 0x00;
   frame.data.u8[7] = 0x00;
-  m_can1->Write(&frame);
+  m_can1->WriteClass(&frame, CAN_TX_CONTROL);
 
   return Success;
   }
@@ -401,7 +401,7 @@ OvmsVehicle::vehicle_command_t OvmsVehicleTeslaRoadster::CommandStopCharge()
   frame.data.u8[5] = 0x00;
   frame.data.u8[6] = 0x00;
   frame.data.u8[7] = 0x00;
-  m_can1->Write(&frame);
+  m_can1->WriteClass(&frame, CAN_TX_CONTROL);
 
   return Success;
   }
@@ -427,7 +427,7 @@ OvmsVehicle::vehicle_command_t OvmsVehicleTeslaRoadster::CommandWakeup()
   frame.FIR.B.FF = CAN_frame_std;
   frame.MsgID = 0x102;
   frame.data.u8[0] = 0x0a;
-  m_can1->Write(&frame);
+  m_can1->WriteClass(&frame, CAN_TX_CONTROL);
 
   frame.origin = m_can1;
   frame.FIR.U = 0;
@@ -442,7 +442,7 @@ OvmsVehicle::vehicle_command_t OvmsVehicleTeslaRoadster::CommandWakeup()
   frame.data.u8[5] = 0x09;
   frame.data.u8[6] = 0x10;
   frame.data.u8[7] = 0x00;
-  m_can1->Write(&frame);
+  m_can1->WriteClass(&frame, CAN_TX_CONTROL);
   
   return Success;
   }
@@ -467,7 +467,7 @@ OvmsVehicle::vehicle_command_t OvmsVehicleTeslaRoadster::CommandLock(const char*
   frame.data.u8[5] = (lpin>>8) & 0xff;
   frame.data.u8[6] = (lpin>>16) & 0xff;
   frame.data.u8[7] = (strlen(pin)<<4) + ((lpin>>24) & 0x0f);
-  m_can1->Write(&frame);
+  m_can1->WriteClass(&frame, CAN_TX_CONTROL);
 
   return Success;
   }
@@ -492,7 +492,7 @@ OvmsVehicle::vehicle_command_t OvmsVehicleTeslaRoadster::CommandUnlock(const cha
   frame.data.u8[5] = (lpin>>8) & 0xff;
   frame.data.u8[6] = (lpin>>16) & 0xff;
   frame.data.u8[7] = (strlen(pin)<<4) + ((lpin>>24) & 0x0f);
-  m_can1->Write(&frame);
+  m_can1->WriteClass(&frame, CAN_TX_CONTROL);
 
   return Success;
   }
@@ -517,7 +517,7 @@ OvmsVehicle::vehicle_command_t OvmsVehicleTeslaRoadster::CommandActivateValet(co
   frame.data.u8[5] = (lpin>>8) & 0xff;
   frame.data.u8[6] = (lpin>>16) & 0xff;
   frame.data.u8[7] = (strlen(pin)<<4) + ((lpin>>24) & 0x0f);
-  m_can1->Write(&frame);
+  m_can1->WriteClass(&frame, CAN_TX_CONTROL);
 
   return Success;
   }
@@ -542,7 +542,7 @@ OvmsVehicle::vehicle_command_t OvmsVehicleTeslaRoadster::CommandDeactivateValet(
   frame.data.u8[5] = (lpin>>8) & 0xff;
   frame.data.u8[6] = (lpin>>16) & 0xff;
   frame.data.u8[7] = (strlen(pin)<<4) + ((lpin>>24) & 0x0f);
-  m_can1->Write(&frame);
+  m_can1->WriteClass(&frame, CAN_TX_CONTROL);
 
   return Success;
   }
@@ -560,7 +560,7 @@ OvmsVehicle::vehicle_command_t OvmsVehicleTeslaRoadster::CommandHomelink(int but
   frame.data.u8[0] = 0x09;
   frame.data.u8[1] = 0x00;
   frame.data.u8[2] = button;
-  m_can1->Write(&frame);
+  m_can1->WriteClass(&frame, CAN_TX_CONTROL);
 
   return Success;
   }
@@ -96,7 +96,8 @@ void Housekeeping::init()
   MyPeripherals = new Peripherals();
 
 #ifdef CONFIG_OVMS_COMP_ESP32CAN
-  MyPeripherals->m_esp32can->SetPowerMode(Off);
+  if (MyPeripherals->m_esp32can)
+    MyPeripherals->m_esp32can->SetPowerMode(Off);
 #endif // #ifdef CONFIG_OVMS_COMP_ESP32CAN
 
 #ifdef CONFIG_OVMS_COMP_EXT12V
@@ -33,6 +33,7 @@ static const char *TAG = "metrics";
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <math.h>
 #include <sstream>
 #include "ovms.h"
 #include "ovms_metrics.h"
@@ -409,6 +410,17 @@ void OvmsMetric::operator=(std::string value)
   {
   }
 
+/**
+ * SetFloat: set numerical value without knowing the metric type
+ *  (i.e. for table driven decoders), converted to the metric type
+ */
+void OvmsMetric::SetFloat(float value, metric_unit_t units)
+  {
+  char buf[20];
+  snprintf(buf, sizeof(buf), "%g", value);
+  SetValue(std::string(buf));
+  }
+
 uint32_t OvmsMetric::LastModified()
   {
   return m_lastmodified;
@@ -534,6 +546,12 @@ void OvmsMetricInt::SetValue(int value, metric_unit_t units)
     SetModified(false);
   }
 
+void OvmsMetricInt::SetFloat(float value, metric_unit_t units)
+  {
+  if ((units != Other)&&(units != m_units)) value=UnitConvert(units,m_units,value);
+  SetValue((int)lroundf(value));
+  }
+
 void OvmsMetricInt::SetValue(std::string value)
   {
   int nvalue = atoi(value.c_str());
@@ -595,6 +613,11 @@ void OvmsMetricBool::SetValue(bool value)
     SetModified(false);
   }
 
+void OvmsMetricBool::SetFloat(float value, metric_unit_t units)
+  {
+  SetValue(value != 0);
+  }
+
 void OvmsMetricBool::SetValue(std::string value)
   {
   bool nvalue;
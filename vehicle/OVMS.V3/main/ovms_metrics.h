@@ -108,6 +108,7 @@ class OvmsMetric
     virtual float AsFloat(const float defvalue = 0, metric_unit_t units = Other);
     virtual void SetValue(std::string value);
     virtual void operator=(std::string value);
+    virtual void SetFloat(float value, metric_unit_t units = Other);
     virtual uint32_t LastModified();
     virtual uint32_t Age();
     virtual bool IsStale();
@@ -141,6 +142,7 @@ class OvmsMetricBool : public OvmsMetric
     float AsFloat(const float defvalue = 0, metric_unit_t units = Other);
     int AsBool(const bool defvalue = false);
     void SetValue(bool value);
+    void SetFloat(float value, metric_unit_t units = Other);
     void operator=(bool value) { SetValue(value); }
     void SetValue(std::string value);
     void operator=(std::string value) { SetValue(value); }
@@ -163,6 +165,7 @@ class OvmsMetricInt : public OvmsMetric
     void operator=(int value) { SetValue(value); }
     void SetValue(std::string value);
     void operator=(std::string value) { SetValue(value); }
+    void SetFloat(float value, metric_unit_t units = Other);
     
   protected:
     int m_value;
@@ -180,6 +183,7 @@ class OvmsMetricFloat : public OvmsMetric
     int AsInt(const int defvalue = 0, metric_unit_t units = Other);
     void SetValue(float value, metric_unit_t units = Other);
     void operator=(float value) { SetValue(value); }
+    void SetFloat(float value, metric_unit_t units = Other) { SetValue(value, units); }
     void SetValue(std::string value);
     void operator=(std::string value) { SetValue(value); }
     
@@ -94,8 +94,12 @@ Peripherals::Peripherals()
 #endif // #ifdef CONFIG_OVMS_COMP_MAX7317
 
 #ifdef CONFIG_OVMS_COMP_ESP32CAN
+#if !defined(CONFIG_OVMS_COMP_VCAN) || CONFIG_OVMS_COMP_VCAN_BUS != 1
   ESP_LOGI(TAG, "  ESP32 CAN");
   m_esp32can = new esp32can("can1", ESP32CAN_PIN_TX, ESP32CAN_PIN_RX);
+#else
+  m_esp32can = NULL;
+#endif
 #endif // #ifdef CONFIG_OVMS_COMP_ESP32CAN
 
 #ifdef CONFIG_OVMS_COMP_WIFI
@@ -114,12 +118,26 @@ Peripherals::Peripherals()
 #endif // #ifdef CONFIG_OVMS_COMP_ADC
 
 #ifdef CONFIG_OVMS_COMP_MCP2515
+#if !defined(CONFIG_OVMS_COMP_VCAN) || CONFIG_OVMS_COMP_VCAN_BUS != 2
   ESP_LOGI(TAG, "  MCP2515 CAN 1/2");
   m_mcp2515_1 = new mcp2515("can2", m_spibus, VSPI_NODMA_HOST, 10000000, VSPI_PIN_MCP2515_1_CS, VSPI_PIN_MCP2515_1_INT);
+#else
+  m_mcp2515_1 = NULL;
+#endif
+#if !defined(CONFIG_OVMS_COMP_VCAN) || CONFIG_OVMS_COMP_VCAN_BUS != 3
   ESP_LOGI(TAG, "  MCP2515 CAN 2/2");
   m_mcp2515_2 = new mcp2515("can3", m_spibus, VSPI_NODMA_HOST, 10000000, VSPI_PIN_MCP2515_2_CS, VSPI_PIN_MCP2515_2_INT);
+#else
+  m_mcp2515_2 = NULL;
+#endif
 #endif // #ifdef CONFIG_OVMS_COMP_MCP2515
 
+#ifdef CONFIG_OVMS_COMP_VCAN
+  ESP_LOGI(TAG, "  Virtual CAN (can%d)", CONFIG_OVMS_COMP_VCAN_BUS);
+  static const char* const vcannames[4] = { "can1", "can2", "can3", "can4" };
+  m_vcan = new vcan(vcannames[CONFIG_OVMS_COMP_VCAN_BUS-1]); // pcp keeps the name pointer
+#endif // #ifdef CONFIG_OVMS_COMP_VCAN
+
 #ifdef CONFIG_OVMS_COMP_SDCARD
   ESP_LOGI(TAG, "  SD CARD");
   m_sdcard = new sdcard("sdcard", true, true, SDCARD_PIN_CD);
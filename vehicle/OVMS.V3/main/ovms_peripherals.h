@@ -47,6 +47,10 @@
 #include "esp32can.h"
 #endif // #ifdef CONFIG_OVMS_COMP_ESP32CAN
 
+#ifdef CONFIG_OVMS_COMP_VCAN
+#include "vcan.h"
+#endif // #ifdef CONFIG_OVMS_COMP_VCAN
+
 #ifdef CONFIG_OVMS_COMP_MAX7317
 #include "max7317.h"
 #endif // #ifdef CONFIG_OVMS_COMP_MAX7317
@@ -157,6 +161,10 @@ class Peripherals
     mcp2515* m_mcp2515_2;
 #endif // #ifdef CONFIG_OVMS_COMP_MCP2515
 
+#ifdef CONFIG_OVMS_COMP_VCAN
+    vcan* m_vcan;
+#endif // #ifdef CONFIG_OVMS_COMP_VCAN
+
 #ifdef CONFIG_OVMS_COMP_SDCARD
     sdcard* m_sdcard;
 #endif // #ifdef CONFIG_OVMS_COMP_SDCARD
@@ -37,10 +37,12 @@ static const char *TAG = "test";
 #include "esp_event.h"
 #include "esp_event_loop.h"
 #include "esp_sleep.h"
+#include "esp_timer.h"
 #include "test_framework.h"
 #include "ovms_command.h"
 #include "ovms_peripherals.h"
 #include "ovms_script.h"
+#include "can.h"
 
 void test_deepsleep(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
   {
@@ -137,6 +139,102 @@ void test_chargen(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc,
     }
   }
 
+// Compare canbitset per call extraction to cansignals batch extraction
+// on sample Twizy & Kia Soul frames.
+static uint8_t test_canbits_frames[3][4][8] =
+  {
+  // Twizy 0x556: 5 x 12 bit cell voltages
+  { { 0x33,0x53,0x35,0x33,0x53,0x35,0x33,0x50 }, { 0x33,0x63,0x36,0x33,0x43,0x34,0x33,0x50 },
+    { 0x32,0xf3,0x2f,0x33,0x03,0x31,0x32,0xf0 }, { 0x33,0x23,0x32,0x33,0x33,0x33,0x33,0x40 } },
+  // Kia Soul 0x018: doors & lights, 10 single bit flags
+  { { 0x91,0x00,0x01,0x00,0x0b,0x80,0x00,0x00 }, { 0x00,0x00,0x02,0x00,0x01,0x00,0x00,0x00 },
+    { 0x80,0x00,0x03,0x00,0x08,0x80,0x00,0x00 }, { 0x11,0x00,0x00,0x00,0x02,0x00,0x00,0x00 } },
+  // Kia Soul 0x200: extra range, range high bit, estimated range
+  { { 0x0c,0x01,0x2a,0x00,0x00,0x00,0x00,0x00 }, { 0x00,0x00,0x93,0x00,0x00,0x00,0x00,0x00 },
+    { 0x21,0x01,0x05,0x00,0x00,0x00,0x00,0x00 }, { 0x05,0x00,0xff,0x00,0x00,0x00,0x00,0x00 } },
+  };
+
+typedef cansignals< cansignal<0,12>, cansignal<12,12>, cansignal<24,12>, cansignal<36,12>,
+  cansignal<48,12> > test_twizy_556_t;
+typedef cansignals< cansignal<7,1>, cansignal<3,1>, cansignal<0,1>, cansignal<36,1>, cansignal<38,1>,
+  cansignal<40,1>, cansignal<23,1>, cansignal<22,1>, cansignal<39,1>, cansignal<37,1> > test_kia_018_t;
+typedef cansignals< cansignal<0,8>, cansignal<15,1>, cansignal<16,8> > test_kia_200_t;
+
+void test_canbits(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  int loops = 100000;
+  if (argc==1)
+    {
+    loops = atoi(argv[0]);
+    }
+  if (loops < 1)
+    loops = 1;
+
+  static const char* const names[3] = { "Twizy 0x556", "Kia 0x018", "Kia 0x200" };
+  int64_t t0, t1, t2;
+  uint32_t sum1, sum2;
+
+  writer->printf("Frame        Store  canbitset  cansignals  [ns/frame]\n");
+  for (int f = 0; f < 3; f++)
+    {
+    sum1 = sum2 = 0;
+    t0 = esp_timer_get_time();
+    for (int i = 0; i < loops; i++)
+      {
+      uint8_t* d = test_canbits_frames[f][i & 3];
+      canbitset<uint64_t> canbits(d, 8);
+      switch (f)
+        {
+        case 0:
+          sum1 += canbits.get(0,11) + canbits.get(12,23) + canbits.get(24,35)
+            + canbits.get(36,47) + canbits.get(48,59);
+          break;
+        case 1:
+          sum1 += canbits.get(7,7) + canbits.get(3,3) + canbits.get(0,0) + canbits.get(36,36)
+            + canbits.get(38,38) + canbits.get(40,40) + canbits.get(23,23) + canbits.get(22,22)
+            + canbits.get(39,39) + canbits.get(37,37);
+          break;
+        case 2:
+          sum1 += canbits.get(0,7) + canbits.get(15,15) + canbits.get(16,23);
+          break;
+        }
+      }
+    t1 = esp_timer_get_time();
+    for (int i = 0; i < loops; i++)
+      {
+      uint8_t* d = test_canbits_frames[f][i & 3];
+      switch (f)
+        {
+        case 0:
+          {
+          test_twizy_556_t s(d);
+          sum2 += s[0] + s[1] + s[2] + s[3] + s[4];
+          }
+          break;
+        case 1:
+          {
+          test_kia_018_t s(d);
+          sum2 += s[0] + s[1] + s[2] + s[3] + s[4] + s[5] + s[6] + s[7] + s[8] + s[9];
+          }
+          break;
+        case 2:
+          {
+          test_kia_200_t s(d);
+          sum2 += s[0] + s[1] + s[2];
+          }
+          break;
+        }
+      }
+    t2 = esp_timer_get_time();
+
+    int store = (f == 0) ? sizeof(test_twizy_556_t::store_type)
+      : (f == 1) ? sizeof(test_kia_018_t::store_type) : sizeof(test_kia_200_t::store_type);
+    writer->printf("%-12s %3d bit %9lld %11lld%s\n", names[f], store << 3,
+      (t1-t0) * 1000 / loops, (t2-t1) * 1000 / loops,
+      (sum1 == sum2) ? "" : "  ERROR: results differ");
+    }
+  }
+
 class TestFrameworkInit
   {
   public: TestFrameworkInit();
@@ -152,5 +250,6 @@ TestFrameworkInit::TestFrameworkInit()
   cmd_test->RegisterCommand("sdcard","Test CD CARD",test_sdcard,"",0,0,true);
 #endif // #ifdef CONFIG_OVMS_COMP_SDCARD
   cmd_test->RegisterCommand("javascript","Test Javascript",test_javascript,"",0,0,true);
+  cmd_test->RegisterCommand("canbits","CAN bit extraction benchmark [<#loops>]",test_canbits,"",0,1,true);
   cmd_test->RegisterCommand("chargen","Character generator [<#lines>]",test_chargen,"",0,1,false);
   }
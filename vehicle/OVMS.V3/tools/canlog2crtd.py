@@ -0,0 +1,84 @@
+#!/usr/bin/env python
+#
+# canlog2crtd.py: convert an OVMS binary CAN log ("can log bin") to CRTD
+#
+# Usage: canlog2crtd.py <binfile> [<crtdfile>]
+#   (output to stdout if no crtdfile is given)
+#
+# See components/can/src/canlog.h (canlog_bin) for the file format.
+#
+
+import struct
+import sys
+
+MAGIC = b"OVCL"
+VERSION = 1
+MAXDELTA = 0xfffff
+TIMESYNC = 15
+ID_EXT = 1 << 29
+
+TYPENAMES = ["RX", "TX", "TX_Queue", "TX_Fail", "Error", "Status", "Comment", "Info", "Event"]
+
+def ts(time):
+  return "%u.%06u" % (time // 1000000, time % 1000000)
+
+def convert(fin, fout):
+  hdr = fin.read(24)
+  if len(hdr) < 24 or hdr[0:4] != MAGIC:
+    raise ValueError("not a binary CAN log")
+  version, infolen, basetime, unixtime, reserved = struct.unpack("<HHqII", hdr[4:])
+  if version != VERSION:
+    raise ValueError("unsupported version %d" % version)
+  info = fin.read(infolen).decode("utf-8", "replace")
+  time = basetime
+  fout.write("%s CXX Info %s\n" % (ts(time), info))
+
+  count = 0
+  while True:
+    rec = fin.read(16)
+    if len(rec) < 16:
+      break
+    rtime, rid = struct.unpack("<II", rec[0:8])
+    data = bytearray(rec[8:16])
+    rtype = rtime >> 28
+    if rtype == TIMESYNC:
+      time = struct.unpack("<q", rec[8:16])[0]
+      continue
+    time += rtime & MAXDELTA
+    busno = (rtime >> 24) & 0x0f
+    bus = str(busno) if busno else ""
+    count += 1
+    if rtype <= 3:
+      ext = (rid & ID_EXT) != 0
+      dlc = min((rtime >> 20) & 0x0f, 8)
+      msgid = "%0*X" % (8 if ext else 3, rid & 0x1fffffff)
+      bits = "29" if ext else "11"
+      if rtype <= 1:
+        line = "%s %s%s%s %s" % (ts(time), bus, "R" if rtype == 0 else "T", bits, msgid)
+      else:
+        line = "%s %sCEV %s T%s %s" % (ts(time), bus, TYPENAMES[rtype], bits, msgid)
+      for i in range(dlc):
+        line += " %02X" % data[i]
+      fout.write(line + "\n")
+    elif rtype <= 8:
+      text = fin.read(rid).decode("utf-8", "replace")
+      tag = "CEV" if rtype in (4, 8) else "CXX"
+      fout.write("%s %s%s %s %s\n" % (ts(time), bus, tag, TYPENAMES[rtype], text))
+    else:
+      raise ValueError("invalid record type %d after %d records" % (rtype, count))
+  return count
+
+def main():
+  if len(sys.argv) < 2:
+    sys.stderr.write("Usage: %s <binfile> [<crtdfile>]\n" % sys.argv[0])
+    sys.exit(1)
+  with open(sys.argv[1], "rb") as fin:
+    if len(sys.argv) > 2:
+      with open(sys.argv[2], "w") as fout:
+        count = convert(fin, fout)
+    else:
+      count = convert(fin, sys.stdout)
+  sys.stderr.write("%d records converted\n" % count)
+
+if __name__ == "__main__":
+  main()